@@ -0,0 +1,415 @@
+// NOTE(tbt): benchmarks the lexer, parser, parse cache, expression evaluation, search helpers and freeing
+//            of trees over generated corpora of each shape. results are printed as CSV, one row per benchmark
+//            and shape, so that runs can be compared to find regressions.
+//            usage: lcddl_bench [--size megabytes] [--shape name] [--seed n]
+
+#define LCDDL_AS_LIBRARY
+#define LCDDL_BENCH
+#include "../lcddl.c"
+
+#define LCDDL_CORPUS_NO_MAIN
+#include "lcddl_corpus.c"
+
+// NOTE(tbt): each benchmark is repeated until it has run for at least this long, and the fastest run is kept
+#define BENCH_MIN_TOTAL_TIME (500ull * 1000000ull)
+#define BENCH_MIN_REPETITIONS 3
+
+typedef struct
+{
+ char *name;
+ char *shape;
+ unsigned long long bytes;       // input bytes processed by each repetition, or 0
+ unsigned long long operations;  // operations in each repetition
+ unsigned long long best_time;
+} BenchResult;
+
+static void
+bench_print_header(void)
+{
+ printf("benchmark,shape,bytes,operations,best_ns,ns_per_op,mb_per_s\n");
+}
+
+static void
+bench_print_result(BenchResult *result)
+{
+ double ns_per_operation = result->operations ? (double)result->best_time / result->operations : 0.0;
+ double mb_per_second    = result->bytes ? (result->bytes / 1e6) / (result->best_time * 1e-9) : 0.0;
+ printf("%s,%s,%llu,%llu,%llu,%.2f,%.2f\n",
+        result->name,
+        result->shape,
+        result->bytes,
+        result->operations,
+        result->best_time,
+        ns_per_operation,
+        mb_per_second);
+ fflush(stdout);
+}
+
+static void
+bench_record(BenchResult *result,
+             unsigned long long time)
+{
+ if (!result->best_time ||
+     time < result->best_time)
+ {
+  result->best_time = time;
+ }
+}
+
+#define bench_repeat(_total_time, _repetitions) for (unsigned long long _total_time = 0, _repetitions = 0; \
+_total_time < BENCH_MIN_TOTAL_TIME || _repetitions < BENCH_MIN_REPETITIONS; \
+++_repetitions)
+
+static void
+bench_lex(char *shape,
+          char *corpus,
+          unsigned long long size)
+{
+ BenchResult result = { .name = "lex", .shape = shape, .bytes = size };
+ 
+ bench_repeat(total_time, repetitions)
+ {
+  unsigned long long start_time  = _lcddl_get_time();
+  _LcddlStream stream            = _lcddl_make_memory_stream(corpus, size, "corpus");
+  unsigned long long token_count = 1;
+  while (stream.current_token.kind != TOKEN_KIND_eof)
+  {
+   stream.current_token = _lcddl_get_next_token(&stream);
+   token_count += 1;
+  }
+  unsigned long long time = _lcddl_get_time() - start_time;
+  
+  result.operations  = token_count;
+  total_time        += time;
+  bench_record(&result, time);
+ }
+ 
+ bench_print_result(&result);
+}
+
+static void
+bench_parse_and_free(char *shape,
+                     char *corpus,
+                     unsigned long long size)
+{
+ BenchResult parse_result = { .name = "parse", .shape = shape, .bytes = size };
+ BenchResult free_result  = { .name = "free_tree", .shape = shape };
+ 
+ bench_repeat(total_time, repetitions)
+ {
+  unsigned long long start_time = _lcddl_get_time();
+  _LcddlStream stream           = _lcddl_make_memory_stream(corpus, size, "corpus");
+  LcddlNode *file               = _lcddl_parse_stream(&stream);
+  _lcddl_free_stream(&stream);
+  unsigned long long time       = _lcddl_get_time() - start_time;
+  
+  unsigned long long node_count = _lcddl_count_nodes(file);
+  parse_result.operations       = node_count;
+  free_result.operations        = node_count;
+  total_time                   += time;
+  bench_record(&parse_result, time);
+  
+  start_time = _lcddl_get_time();
+  _lcddl_free_tree(file);
+  bench_record(&free_result, _lcddl_get_time() - start_time);
+ }
+ 
+ bench_print_result(&parse_result);
+ bench_print_result(&free_result);
+}
+
+// NOTE(tbt): the two halves of the executable's --cache-dir lookup. a cold cache hashes the input, parses it
+//            and writes its image, and a warm one hashes the input, reads the image and copies it into a tree
+static void
+bench_parse_cache(char *shape,
+                  char *corpus,
+                  unsigned long long size)
+{
+ BenchResult cold_result = { .name = "parse_cache_cold", .shape = shape, .bytes = size };
+ BenchResult warm_result = { .name = "parse_cache_warm", .shape = shape, .bytes = size };
+ 
+ char cache_path[4096];
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+ char temporary_directory[MAX_PATH + 1];
+ GetTempPathA(sizeof(temporary_directory), temporary_directory);
+ snprintf(cache_path, sizeof(cache_path), "%slcddl_bench_%lu.lcdb", temporary_directory, GetCurrentProcessId());
+#else
+ char *temporary_directory = getenv("TMPDIR");
+ snprintf(cache_path, sizeof(cache_path), "%s/lcddl_bench_%d.lcdb", temporary_directory ? temporary_directory : "/tmp", getpid());
+#endif
+ 
+ volatile unsigned long long sink = 0;
+ bench_repeat(total_time, repetitions)
+ {
+  unsigned long long start_time = _lcddl_get_time();
+  sink                         += _lcddl_hash_bytes(corpus, size);
+  _LcddlStream stream           = _lcddl_make_memory_stream(corpus, size, "corpus");
+  LcddlNode *file               = _lcddl_parse_stream(&stream);
+  _lcddl_free_stream(&stream);
+  LcddlWriter writer            = lcddl_writer_for_memory();
+  _lcddl_serialise_tree(file, &writer);
+  bool is_written               = _lcddl_replace_file_atomically(cache_path, writer.buffer, writer.size);
+  free(lcddl_writer_close(&writer));
+  unsigned long long time       = _lcddl_get_time() - start_time;
+  
+  cold_result.operations  = _lcddl_count_nodes(file);
+  total_time             += time;
+  bench_record(&cold_result, time);
+  _lcddl_free_tree(file);
+  
+  if (!is_written)
+  {
+   return;
+  }
+ }
+ 
+ bench_repeat(total_time, repetitions)
+ {
+  unsigned long long start_time = _lcddl_get_time();
+  sink                         += _lcddl_hash_bytes(corpus, size);
+  LcddlNode *file               = NULL;
+  FILE *image                   = fopen(cache_path, "rb");
+  if (image)
+  {
+   fseek(image, 0, SEEK_END);
+   unsigned long long image_size = ftell(image);
+   fseek(image, 0, SEEK_SET);
+   char *buffer = malloc(image_size);
+   if (buffer &&
+       fread(buffer, 1, image_size, image) == image_size)
+   {
+    file = _lcddl_deserialise_tree(buffer, image_size);
+   }
+   free(buffer);
+   fclose(image);
+  }
+  unsigned long long time = _lcddl_get_time() - start_time;
+  
+  warm_result.operations  = _lcddl_count_nodes(file);
+  total_time             += time;
+  bench_record(&warm_result, time);
+  _lcddl_free_tree(file);
+ }
+ (void)sink;
+ 
+ remove(cache_path);
+ 
+ bench_print_result(&cold_result);
+ bench_print_result(&warm_result);
+}
+
+// NOTE(tbt): values which reference variables or strings can not be evaluated, so are skipped
+static bool
+bench_is_constant_expression(LcddlNode *expression)
+{
+ switch (expression->kind)
+ {
+  case LCDDL_NODE_KIND_float_literal:
+  case LCDDL_NODE_KIND_integer_literal:
+  {
+   return true;
+  }
+  
+  case LCDDL_NODE_KIND_unary_operator:
+  {
+   return bench_is_constant_expression(expression->unary_operator.operand);
+  }
+  
+  case LCDDL_NODE_KIND_binary_operator:
+  {
+   return (bench_is_constant_expression(expression->binary_operator.left) &&
+           bench_is_constant_expression(expression->binary_operator.right));
+  }
+  
+  default:
+  {
+   return false;
+  }
+ }
+}
+
+static void
+bench_evaluate_expressions(char *shape,
+                           LcddlNode *file)
+{
+ BenchResult result = { .name = "evaluate_expression", .shape = shape };
+ 
+ unsigned long long expression_count = 0;
+ for (LcddlNode *declaration = file->first_child;
+      NULL != declaration;
+      declaration = declaration->next_sibling)
+ {
+  expression_count += (NULL != declaration->declaration.value &&
+                       bench_is_constant_expression(declaration->declaration.value));
+ }
+ if (!expression_count)
+ {
+  return;
+ }
+ 
+ volatile double sink = 0.0;
+ bench_repeat(total_time, repetitions)
+ {
+  unsigned long long start_time = _lcddl_get_time();
+  for (LcddlNode *declaration = file->first_child;
+       NULL != declaration;
+       declaration = declaration->next_sibling)
+  {
+   if (declaration->declaration.value &&
+       bench_is_constant_expression(declaration->declaration.value))
+   {
+    sink += lcddl_evaluate_expression(declaration->declaration.value);
+   }
+  }
+  unsigned long long time = _lcddl_get_time() - start_time;
+  
+  result.operations  = expression_count;
+  total_time        += time;
+  bench_record(&result, time);
+ }
+ (void)sink;
+ 
+ bench_print_result(&result);
+}
+
+static void
+bench_free_search_results(LcddlSearchResult *results)
+{
+ LcddlSearchResult *next = NULL;
+ for (LcddlSearchResult *result = results;
+      NULL != result;
+      result = next)
+ {
+  next = result->next;
+  free(result);
+ }
+}
+
+// NOTE(tbt): `file` must be the only file in the global tree
+static void
+bench_search(char *shape,
+             LcddlNode *file)
+{
+ BenchResult find_result     = { .name = "find_top_level_declaration", .shape = shape };
+ BenchResult with_tag_result = { .name = "find_all_top_level_declarations_with_tag", .shape = shape };
+ 
+ // NOTE(tbt): look up a spread of names which are present in the tree
+ enum { SEARCH_COUNT = 16 };
+ char *names[SEARCH_COUNT];
+ unsigned int name_count = 0;
+ unsigned long long top_level_count = 0;
+ for (LcddlNode *declaration = file->first_child;
+      NULL != declaration;
+      declaration = declaration->next_sibling)
+ {
+  top_level_count += 1;
+ }
+ unsigned long long stride = top_level_count / SEARCH_COUNT + 1;
+ unsigned long long index  = 0;
+ for (LcddlNode *declaration = file->first_child;
+      NULL != declaration && name_count < SEARCH_COUNT;
+      declaration = declaration->next_sibling, ++index)
+ {
+  if (0 == index % stride)
+  {
+   names[name_count++] = declaration->declaration.name;
+  }
+ }
+ 
+ bench_repeat(total_time, repetitions)
+ {
+  unsigned long long start_time = _lcddl_get_time();
+  for (unsigned int i = 0;
+       i < name_count;
+       ++i)
+  {
+   bench_free_search_results(lcddl_find_top_level_declaration(names[i]));
+  }
+  unsigned long long time = _lcddl_get_time() - start_time;
+  
+  find_result.operations  = name_count;
+  total_time             += time;
+  bench_record(&find_result, time);
+ }
+ 
+ bench_repeat(total_time, repetitions)
+ {
+  unsigned long long start_time = _lcddl_get_time();
+  bench_free_search_results(lcddl_find_all_top_level_declarations_with_tag("tag_3"));
+  unsigned long long time = _lcddl_get_time() - start_time;
+  
+  with_tag_result.operations  = 1;
+  total_time                 += time;
+  bench_record(&with_tag_result, time);
+ }
+ 
+ bench_print_result(&find_result);
+ bench_print_result(&with_tag_result);
+}
+
+int
+main(int argc,
+     char **argv)
+{
+ unsigned long long size = 4;
+ unsigned long long seed = 1;
+ int only_shape          = -1;
+ 
+ for (int i = 1;
+      i < argc;
+      ++i)
+ {
+  if (0 == strcmp(argv[i], "--size") && i + 1 < argc)
+  {
+   size = strtoull(argv[++i], NULL, 10);
+  }
+  else if (0 == strcmp(argv[i], "--seed") && i + 1 < argc)
+  {
+   seed = strtoull(argv[++i], NULL, 10);
+  }
+  else if (0 == strcmp(argv[i], "--shape") && i + 1 < argc)
+  {
+   only_shape = corpus_shape_from_string(argv[++i]);
+   if (only_shape < 0)
+   {
+    fprintf(stderr, "ERROR: Unknown shape '%s'\n", argv[i]);
+    return EXIT_FAILURE;
+   }
+  }
+  else
+  {
+   fprintf(stderr, "Usage: %s [--size megabytes] [--shape mixed|deep|wide|tags|expressions|comments] [--seed n]\n", argv[0]);
+   return EXIT_FAILURE;
+  }
+ }
+ 
+ lcddl_initialise();
+ bench_print_header();
+ 
+ for (int shape = 0;
+      shape < CORPUS_SHAPE_MAX;
+      ++shape)
+ {
+  if (only_shape >= 0 &&
+      shape != only_shape)
+  {
+   continue;
+  }
+  
+  unsigned long long corpus_size = 0;
+  char *corpus = corpus_generate(shape, size * 1024 * 1024, seed, &corpus_size);
+  
+  bench_lex(corpus_shape_names[shape], corpus, corpus_size);
+  bench_parse_and_free(corpus_shape_names[shape], corpus, corpus_size);
+  bench_parse_cache(corpus_shape_names[shape], corpus, corpus_size);
+  
+  LcddlNode *file = lcddl_parse_from_memory(corpus, corpus_size);
+  bench_evaluate_expressions(corpus_shape_names[shape], file);
+  bench_search(corpus_shape_names[shape], file);
+  lcddl_free_file(file);
+  
+  free(corpus);
+ }
+ 
+ return EXIT_SUCCESS;
+}
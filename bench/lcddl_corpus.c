@@ -0,0 +1,270 @@
+// NOTE(tbt): generates synthetic .lcd input for benchmarking
+//            usage: lcddl_corpus shape size_in_kilobytes [seed] > output.lcd
+//            shapes: mixed, deep, wide, tags, expressions, comments
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef LCDDL_C
+#include "../lcddl.h"
+#endif
+
+typedef enum
+{
+ CORPUS_SHAPE_mixed,
+ CORPUS_SHAPE_deep,        // structs nested many levels deep
+ CORPUS_SHAPE_wide,        // structs with many fields
+ CORPUS_SHAPE_tags,        // declarations with many tags
+ CORPUS_SHAPE_expressions, // declarations with long expressions as values
+ CORPUS_SHAPE_comments,    // mostly comments
+ CORPUS_SHAPE_MAX,
+} CorpusShape;
+
+static char *corpus_shape_names[CORPUS_SHAPE_MAX] =
+{
+ [CORPUS_SHAPE_mixed]       = "mixed",
+ [CORPUS_SHAPE_deep]        = "deep",
+ [CORPUS_SHAPE_wide]        = "wide",
+ [CORPUS_SHAPE_tags]        = "tags",
+ [CORPUS_SHAPE_expressions] = "expressions",
+ [CORPUS_SHAPE_comments]    = "comments",
+};
+
+static char *corpus_type_names[] = { "i8", "i16", "i32", "i64", "u8", "u16", "u32", "u64", "f32", "f64", "string", "Vector3" };
+static char *corpus_binary_operators[] = { "*", "/", "+", "-", "<<", ">>", "<", ">", "<=", ">=", "==", "!=", "&", "^", "|", "&&", "||" };
+static char *corpus_unary_operators[] = { "-", "+", "~", "!" };
+
+#define corpus_array_count(_array) (sizeof(_array) / sizeof((_array)[0]))
+
+static unsigned long long
+corpus_random(unsigned long long *state)
+{
+ // NOTE(tbt): xorshift64
+ unsigned long long x = *state;
+ x ^= x << 13;
+ x ^= x >> 7;
+ x ^= x << 17;
+ *state = x;
+ return x;
+}
+
+// NOTE(tbt): constant expressions contain no variable references, so can be passed to `lcddl_evaluate_expression`
+static void
+corpus_write_expression(LcddlWriter *writer,
+                        unsigned long long *random_state,
+                        int operand_count,
+                        bool is_constant)
+{
+ for (int i = 0;
+      i < operand_count;
+      ++i)
+ {
+  if (i)
+  {
+   lcddl_writer_printf(writer, " %s ", corpus_binary_operators[corpus_random(random_state) % corpus_array_count(corpus_binary_operators)]);
+  }
+  
+  unsigned long long choice = corpus_random(random_state) % 8;
+  if (choice == 0 && operand_count > 2)
+  {
+   lcddl_writer_put_char(writer, '(', 1);
+   corpus_write_expression(writer, random_state, 2, is_constant);
+   lcddl_writer_put_char(writer, ')', 1);
+  }
+  else if (choice == 1)
+  {
+   lcddl_writer_printf(writer, "%s%llu", corpus_unary_operators[corpus_random(random_state) % corpus_array_count(corpus_unary_operators)], corpus_random(random_state) % 100);
+  }
+  else if (choice == 2)
+  {
+   lcddl_writer_printf(writer, "%llu.%llu", corpus_random(random_state) % 1000, corpus_random(random_state) % 1000);
+  }
+  else if (choice == 3 && !is_constant)
+  {
+   lcddl_writer_printf(writer, "variable_%llu", corpus_random(random_state) % 64);
+  }
+  else
+  {
+   lcddl_writer_printf(writer, "%llu", 1 + corpus_random(random_state) % 1000);
+  }
+ }
+}
+
+static void
+corpus_write_field(LcddlWriter *writer,
+                   unsigned long long *random_state,
+                   int indent,
+                   unsigned long long index)
+{
+ lcddl_writer_put_char(writer, ' ', indent);
+ unsigned long long array_count = corpus_random(random_state) % 4 == 0 ? 1 + corpus_random(random_state) % 16 : 0;
+ unsigned int indirection       = corpus_random(random_state) % 4 == 0 ? 1 : 0;
+ char *type_name                = corpus_type_names[corpus_random(random_state) % corpus_array_count(corpus_type_names)];
+ 
+ lcddl_writer_printf(writer, "field_%llu : ", index);
+ if (array_count)
+ {
+  lcddl_writer_printf(writer, "[%llu]", array_count);
+ }
+ lcddl_writer_printf(writer, "%s%s", type_name, indirection ? "*" : "");
+ if (corpus_random(random_state) % 2)
+ {
+  lcddl_writer_put_string(writer, " = ");
+  corpus_write_expression(writer, random_state, 1 + corpus_random(random_state) % 3, false);
+ }
+ lcddl_writer_put_string(writer, ";\n");
+}
+
+static void
+corpus_write_struct(LcddlWriter *writer,
+                    unsigned long long *random_state,
+                    int indent,
+                    unsigned long long index,
+                    int field_count,
+                    int depth)
+{
+ lcddl_writer_put_char(writer, ' ', indent);
+ lcddl_writer_printf(writer, "struct_%llu : struct\n", index);
+ lcddl_writer_put_char(writer, ' ', indent);
+ lcddl_writer_put_string(writer, "{\n");
+ for (int i = 0;
+      i < field_count;
+      ++i)
+ {
+  corpus_write_field(writer, random_state, indent + 1, i);
+ }
+ if (depth > 0)
+ {
+  corpus_write_struct(writer, random_state, indent + 1, index, field_count, depth - 1);
+ }
+ lcddl_writer_put_char(writer, ' ', indent);
+ lcddl_writer_put_string(writer, "};\n");
+}
+
+static void
+corpus_write_declaration(LcddlWriter *writer,
+                         unsigned long long *random_state,
+                         CorpusShape shape,
+                         unsigned long long index)
+{
+ switch (shape)
+ {
+  case CORPUS_SHAPE_deep:
+  {
+   corpus_write_struct(writer, random_state, 0, index, 2, 48);
+   break;
+  }
+  
+  case CORPUS_SHAPE_wide:
+  {
+   corpus_write_struct(writer, random_state, 0, index, 512, 0);
+   break;
+  }
+  
+  case CORPUS_SHAPE_tags:
+  {
+   for (int i = 0;
+        i < 12;
+        ++i)
+   {
+    if (corpus_random(random_state) % 2)
+    {
+     lcddl_writer_printf(writer, "@tag_%d ", i);
+    }
+    else
+    {
+     lcddl_writer_printf(writer, "@tag_%d = \"value %llu\" ", i, corpus_random(random_state) % 1000);
+    }
+   }
+   lcddl_writer_put_char(writer, '\n', 1);
+   corpus_write_field(writer, random_state, 0, index);
+   break;
+  }
+  
+  case CORPUS_SHAPE_expressions:
+  {
+   lcddl_writer_printf(writer, "constant_%llu := ", index);
+   corpus_write_expression(writer, random_state, 64, true);
+   lcddl_writer_put_string(writer, ";\n");
+   break;
+  }
+  
+  case CORPUS_SHAPE_comments:
+  {
+   for (int i = 0;
+        i < 16;
+        ++i)
+   {
+    lcddl_writer_printf(writer, "// comment %d describing declaration %llu in a lot more detail than it needs\n", i, index);
+   }
+   corpus_write_field(writer, random_state, 0, index);
+   break;
+  }
+  
+  default:
+  {
+   corpus_write_declaration(writer, random_state, 1 + index % (CORPUS_SHAPE_MAX - 1), index);
+   break;
+  }
+ }
+}
+
+// NOTE(tbt): the result is NUL terminated, and must be freed by the caller
+static char *
+corpus_generate(CorpusShape shape,
+                unsigned long long size,
+                unsigned long long seed,
+                unsigned long long *result_size)
+{
+ unsigned long long random_state = seed * 2654435761ull + 1;
+ LcddlWriter writer              = lcddl_writer_for_memory();
+ 
+ for (unsigned long long index = 0;
+      writer.size < size;
+      ++index)
+ {
+  corpus_write_declaration(&writer, &random_state, shape, index);
+  lcddl_writer_put_char(&writer, '\n', 1);
+ }
+ 
+ *result_size = writer.size;
+ return lcddl_writer_close(&writer);
+}
+
+static int
+corpus_shape_from_string(char *string)
+{
+ for (int i = 0;
+      i < CORPUS_SHAPE_MAX;
+      ++i)
+ {
+  if (0 == strcmp(corpus_shape_names[i], string))
+  {
+   return i;
+  }
+ }
+ return -1;
+}
+
+#ifndef LCDDL_CORPUS_NO_MAIN
+int
+main(int argc,
+     char **argv)
+{
+ int shape = argc >= 3 ? corpus_shape_from_string(argv[1]) : -1;
+ if (shape < 0)
+ {
+  fprintf(stderr, "Usage: %s mixed|deep|wide|tags|expressions|comments size_in_kilobytes [seed]\n", argv[0]);
+  return EXIT_FAILURE;
+ }
+ 
+ unsigned long long size = 0;
+ char *corpus = corpus_generate(shape, strtoull(argv[2], NULL, 10) * 1024, argc >= 4 ? strtoull(argv[3], NULL, 10) : 1, &size);
+ fwrite(corpus, 1, size, stdout);
+ free(corpus);
+ 
+ return EXIT_SUCCESS;
+}
+#endif
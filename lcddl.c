@@ -1,55 +1,56 @@
 #ifndef LCDDL_C
 #define LCDDL_C
 
+#include <errno.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "lcddl.h"
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#define LCDDL_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LCDDL_SIMD_SSE2
+#endif
+
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 #include <windows.h>
+#include <io.h>
 
 // disable ANSI escape codes for colours on windows
 // TODO(tbt): setup the virtual terminal on windows to use ANSI escape codes
-#define LOG_WARN_BEGIN  "%s:%lu WARNING : "
-#define LOG_ERROR_BEGIN "%s:%lu ERROR : "
+#define LOG_ERROR_BEGIN "%s:%lu:%lu ERROR : "
 #else
 #include <dlfcn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#endif
 
-#define LOG_WARN_BEGIN   "\x1b[33m%s : line %lu : WARNING : \x1b[0m"
-#define LOG_ERROR_BEGIN  "\x1b[31m%s : line %lu : ERROR : \x1b[0m"
+#define LOG_ERROR_BEGIN  "\x1b[31m%s : line %lu : column %lu : ERROR : \x1b[0m"
 #endif
 
 ///////////////////////////////////////////
 // UTILITIES
 //~
 
-#define print_warning(_stream, _message) fprintf(stderr,                                \
-LOG_WARN_BEGIN                         \
-_message                               \
-"\n",                                  \
-(_stream)->path,                       \
-(_stream)->current_token.line);        \
-
-#define print_error_and_exit(_stream, _message) fprintf(stderr,                         \
-LOG_ERROR_BEGIN                 \
-_message                        \
-"\n",                           \
-(_stream)->path,                \
-(_stream)->current_token.line); \
-exit(EXIT_FAILURE)
-
-#define print_error_and_exit_f(_stream, _message, ...) fprintf(stderr,                        \
-LOG_ERROR_BEGIN                \
-_message                       \
-"\n",                          \
-(_stream)->path,               \
-(_stream)->current_token.line, \
-__VA_ARGS__);                  \
-exit(EXIT_FAILURE)
-
 static bool
 _lcddl_is_char_space(char c)
 {
@@ -98,1582 +99,8013 @@ _lcddl_is_char_letter(char c)
  return false;
 }
 
-///////////////////////////////////////////
-// LEXER
-//~
-
-typedef enum
+// NOTE(tbt): 64 bit FNV-1a
+static unsigned long long
+_lcddl_hash_bytes(char *bytes,
+                  unsigned long long size)
 {
- TOKEN_KIND_none,
- 
- TOKEN_KIND_identifier,               // a series of alphanumeric characters begining with a letter or '_'
- TOKEN_KIND_integer_literal,          // a series of numbers
- TOKEN_KIND_float_literal,            // a series of numbers containing exactly one '.'
- TOKEN_KIND_string_literal,           // a series of characters bounded by '"'
- TOKEN_KIND_colon,                    // ':'
- TOKEN_KIND_equals,                   // '='
- TOKEN_KIND_open_curly_bracket,       // '{'
- TOKEN_KIND_close_curly_bracket,      // '}'
- TOKEN_KIND_open_square_bracket,      // '['
- TOKEN_KIND_close_square_bracket,     // ']'
- TOKEN_KIND_open_bracket,             // '('
- TOKEN_KIND_close_bracket,            // ')'
- TOKEN_KIND_asterisk,                 // '*'
- TOKEN_KIND_dash,                     // '-'
- TOKEN_KIND_slash,                    // '/'
- TOKEN_KIND_add,                      // '+'
- TOKEN_KIND_tilde,                    // '~'
- TOKEN_KIND_exclamation,              // '!'
- TOKEN_KIND_lesser_than,              // '<'
- TOKEN_KIND_greater_than,             // '>'
- TOKEN_KIND_lesser_than_or_equal_to,  // '<='
- TOKEN_KIND_greater_than_or_equal_to, // '>='
- TOKEN_KIND_equality,                 // '=='
- TOKEN_KIND_not_equal_to,             // '!='
- TOKEN_KIND_bit_shift_left,           // '<<'
- TOKEN_KIND_bit_shift_right,          // '>>'
- TOKEN_KIND_bitwise_and,              // '&'
- TOKEN_KIND_bitwise_or,               // '|'
- TOKEN_KIND_bitwise_xor,              // '^'
- TOKEN_KIND_boolean_and,              // '&&'
- TOKEN_KIND_boolean_or,               // '||'
- TOKEN_KIND_at_symbol,                // '@'
- TOKEN_KIND_semicolon,                // ';'
- TOKEN_KIND_eof,                      // EOF
-} _LcddlTokenKind;
-
-#define token_kind_to_string(_token_kind)                                      \
-((_token_kind) == TOKEN_KIND_none                     ? "none" :           \
-(_token_kind) == TOKEN_KIND_identifier               ? "identifier" :     \
-(_token_kind) == TOKEN_KIND_integer_literal          ? "integer literal" :\
-(_token_kind) == TOKEN_KIND_float_literal            ? "float literal" :  \
-(_token_kind) == TOKEN_KIND_string_literal           ? "string literal" : \
-(_token_kind) == TOKEN_KIND_colon                    ? ":" :              \
-(_token_kind) == TOKEN_KIND_equals                   ? "=" :              \
-(_token_kind) == TOKEN_KIND_open_curly_bracket       ? "{" :              \
-(_token_kind) == TOKEN_KIND_close_curly_bracket      ? "}" :              \
-(_token_kind) == TOKEN_KIND_open_square_bracket      ? "[" :              \
-(_token_kind) == TOKEN_KIND_close_square_bracket     ? "]" :              \
-(_token_kind) == TOKEN_KIND_open_bracket             ? "(" :              \
-(_token_kind) == TOKEN_KIND_close_bracket            ? ")" :              \
-(_token_kind) == TOKEN_KIND_asterisk                 ? "*" :              \
-(_token_kind) == TOKEN_KIND_dash                     ? "-" :              \
-(_token_kind) == TOKEN_KIND_slash                    ? "/" :              \
-(_token_kind) == TOKEN_KIND_add                      ? "+" :              \
-(_token_kind) == TOKEN_KIND_tilde                    ? "~" :              \
-(_token_kind) == TOKEN_KIND_lesser_than              ? "<" :              \
-(_token_kind) == TOKEN_KIND_greater_than             ? ">" :              \
-(_token_kind) == TOKEN_KIND_lesser_than_or_equal_to  ? "<=" :             \
-(_token_kind) == TOKEN_KIND_greater_than_or_equal_to ? ">=" :             \
-(_token_kind) == TOKEN_KIND_equality                 ? "==" :             \
-(_token_kind) == TOKEN_KIND_not_equal_to             ? "!=" :             \
-(_token_kind) == TOKEN_KIND_bit_shift_left           ? "<<" :             \
-(_token_kind) == TOKEN_KIND_bit_shift_right          ? ">>" :             \
-(_token_kind) == TOKEN_KIND_at_symbol                ? "@" :              \
-(_token_kind) == TOKEN_KIND_semicolon                ? ";" :              \
-(_token_kind) == TOKEN_KIND_eof                      ? "eof" : NULL)
-
+ unsigned long long result = 14695981039346656037ull;
+ for (unsigned long long i = 0;
+      i < size;
+      ++i)
+ {
+  result ^= (unsigned char)bytes[i];
+  result *= 1099511628211ull;
+ }
+ return result;
+}
 
-typedef struct
+// NOTE(tbt): folds `value` into a running hash
+static unsigned long long
+_lcddl_hash_combine(unsigned long long hash,
+                    unsigned long long value)
 {
- _LcddlTokenKind kind;
- unsigned int len;
- char *value;
- unsigned long line;
-} _LcddlToken;
+ hash ^= value;
+ hash *= 0x9e3779b97f4a7c15ull;
+ hash ^= hash >> 32;
+ return hash;
+}
 
-#define PATH_MAX_LEN 96
+// NOTE(tbt): statically initialised with LCDDL_MUTEX_INITIALISER
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+typedef SRWLOCK _LcddlMutex;
+#define LCDDL_MUTEX_INITIALISER SRWLOCK_INIT
+#define _lcddl_mutex_lock(_mutex) AcquireSRWLockExclusive(_mutex)
+#define _lcddl_mutex_unlock(_mutex) ReleaseSRWLockExclusive(_mutex)
+#else
+typedef pthread_mutex_t _LcddlMutex;
+#define LCDDL_MUTEX_INITIALISER PTHREAD_MUTEX_INITIALIZER
+#define _lcddl_mutex_lock(_mutex) pthread_mutex_lock(_mutex)
+#define _lcddl_mutex_unlock(_mutex) pthread_mutex_unlock(_mutex)
+#endif
 
 typedef struct
 {
- char *buffer;
- unsigned long long size;
- unsigned long long index;
- 
- char *path;
- unsigned long current_line;
- 
- _LcddlToken current_token;
-} _LcddlStream;
+ char **strings;
+ unsigned int count;
+ unsigned int capacity;
+} _LcddlStringList;
 
-static _LcddlToken _lcddl_get_next_token(_LcddlStream *stream);
+static void
+_lcddl_push_string(_LcddlStringList *list,
+                   char *string)
+{
+ if (list->count == list->capacity)
+ {
+  list->capacity = list->capacity ? list->capacity * 2 : 16;
+  list->strings  = realloc(list->strings, list->capacity * sizeof(*list->strings));
+ }
+ list->strings[list->count] = calloc(1, strlen(string) + 1);
+ strcpy(list->strings[list->count], string);
+ list->count += 1;
+}
 
-static _LcddlStream
-_lcddl_load_entire_file_as_stream(char *filename)
+static bool
+_lcddl_does_file_match(char *path,
+                       char *buffer,
+                       unsigned long long size)
 {
- _LcddlStream result = {0};
- result.current_line = 1;
- result.path         = calloc(1, strlen(filename) + 1);
- strcpy(result.path, filename);
+ bool result = false;
  
- FILE *file = fopen(filename, "rb");
- if(file)
+ FILE *file = fopen(path, "rb");
+ if (file)
  {
   fseek(file, 0, SEEK_END);
-  result.size     = ftell(file);
+  unsigned long long existing_size = ftell(file);
   fseek(file, 0, SEEK_SET);
-  result.buffer   = malloc(result.size);
-  if(result.buffer)
+  
+  if (existing_size == size)
   {
-   fread(result.buffer, 1, result.size, file);
+   char *existing = malloc(size + 1);
+   if (existing &&
+       fread(existing, 1, size, file) == size)
+   {
+    result = (0 == memcmp(existing, buffer, size));
+   }
+   free(existing);
   }
+  
   fclose(file);
  }
  
- result.current_token = _lcddl_get_next_token(&result);
+ return result;
+}
+
+// NOTE(tbt): only used to copy user layers before loading them
+#if !defined(LCDDL_AS_LIBRARY) && !defined(LCDDL_STATIC_USER_LAYER)
+static bool
+_lcddl_copy_file(char *source_path,
+                 char *destination_path)
+{
+ bool result = false;
+ 
+ FILE *source = fopen(source_path, "rb");
+ if (source)
+ {
+  FILE *destination = fopen(destination_path, "wb");
+  if (destination)
+  {
+   char buffer[64 * 1024];
+   unsigned long long bytes_read;
+   result = true;
+   while (result &&
+          (bytes_read = fread(buffer, 1, sizeof(buffer), source)))
+   {
+    result = (fwrite(buffer, 1, bytes_read, destination) == bytes_read);
+   }
+   result = (0 == fclose(destination)) && result;
+  }
+  fclose(source);
+ }
  
  return result;
 }
+#endif
 
-static int
-_lcddl_get_character(_LcddlStream *stream)
+// NOTE(tbt): writes the whole output to a temporary file next to `path` and renames it into place,
+//            so readers never see a partially written file. the temporary file is named by the process
+//            and a counter, and is created exclusively, so that two writers of the same path - on different
+//            threads or in different processes - never write into each other's temporary file.
+//            returns whether `path` was replaced
+static bool
+_lcddl_replace_file_atomically(char *path,
+                               char *buffer,
+                               unsigned long long size)
 {
- if (stream->index < stream->size)
+ static _LcddlMutex temporary_mutex = LCDDL_MUTEX_INITIALISER;
+ static unsigned int temporary_count = 0;
+ 
+ bool result          = false;
+ char *temporary_path = calloc(1, strlen(path) + 64);
+ FILE *file           = NULL;
+ do
  {
-  return (int)stream->buffer[stream->index];
+  _lcddl_mutex_lock(&temporary_mutex);
+  temporary_count += 1;
+  unsigned int count = temporary_count;
+  _lcddl_mutex_unlock(&temporary_mutex);
+  
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  sprintf(temporary_path, "%s.%lu.%u.lcddl-tmp", path, GetCurrentProcessId(), count);
+#else
+  sprintf(temporary_path, "%s.%d.%u.lcddl-tmp", path, getpid(), count);
+#endif
+  file = fopen(temporary_path, "wbx");
+ } while (!file && errno == EEXIST);
+ 
+ if (file)
+ {
+  result = (fwrite(buffer, 1, size, file) == size);
+  result = (0 == fclose(file)) && result;
+  
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  result = result && MoveFileExA(temporary_path, path, MOVEFILE_REPLACE_EXISTING);
+#else
+  result = result && (0 == rename(temporary_path, path));
+#endif
+  
+  if (!result)
+  {
+   fprintf(stderr, "ERROR: Could not write output file '%s'\n", path);
+   remove(temporary_path);
+  }
  }
- return EOF;
+ else
+ {
+  fprintf(stderr, "ERROR: Could not open a temporary file to write output file '%s'\n", path);
+ }
+ 
+ free(temporary_path);
+ return result;
 }
 
-static int
-_lcddl_peek_character(_LcddlStream *stream)
+///////////////////////////////////////////
+// STATISTICS
+//~
+
+// NOTE(tbt): collected for --stats. the counters are cheap enough to always be updated, but
+//            anything which needs a timer or a lock is only done if `is_enabled` is set.
+//            all times are in nanoseconds
+
+typedef struct
 {
- if (stream->index + 1 < stream->size)
+ char *path;
+ unsigned long long bytes_read;
+ unsigned long long load_time;
+ unsigned long long parse_time;
+ unsigned long long token_count;
+ unsigned long long node_count;
+} _LcddlFileStats;
+
+typedef struct
+{
+ bool is_enabled;
+ 
+ unsigned long long token_count;
+ unsigned long long allocation_count;
+ unsigned long long bytes_allocated;
+ unsigned long long bytes_read;
+ unsigned long long deduplicated_node_count; // nodes freed because an equal node had already been interned
+ unsigned long long node_counts[LCDDL_NODE_KIND_COUNT];
+ 
+ _LcddlFileStats *files;
+ unsigned int file_count;
+ unsigned int file_capacity;
+ 
+ // NOTE(tbt): output may be written from several user layers at once, so these are protected by `mutex`
+ _LcddlMutex mutex;
+ unsigned long long write_helper_calls;
+ unsigned long long write_helper_time;
+ unsigned long long bytes_written;
+} _LcddlStats;
+
+static _LcddlStats _lcddl_stats = { .mutex = LCDDL_MUTEX_INITIALISER };
+
+static unsigned long long
+_lcddl_get_time(void)
+{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+ static LARGE_INTEGER frequency;
+ if (!frequency.QuadPart)
  {
-  return (int)stream->buffer[stream->index + 1];
+  QueryPerformanceFrequency(&frequency);
  }
- return EOF;
+ LARGE_INTEGER counter;
+ QueryPerformanceCounter(&counter);
+ return ((counter.QuadPart / frequency.QuadPart) * 1000000000ull +
+         (counter.QuadPart % frequency.QuadPart) * 1000000000ull / frequency.QuadPart);
+#else
+ struct timespec time;
+ clock_gettime(CLOCK_MONOTONIC, &time);
+ return time.tv_sec * 1000000000ull + time.tv_nsec;
+#endif
 }
 
 static void
-_lcddl_consume_character(_LcddlStream *stream)
+_lcddl_record_write_helper(unsigned long long start_time)
 {
- stream->index += 1;
+ unsigned long long time = _lcddl_get_time() - start_time;
+ _lcddl_mutex_lock(&_lcddl_stats.mutex);
+ _lcddl_stats.write_helper_calls += 1;
+ _lcddl_stats.write_helper_time  += time;
+ _lcddl_mutex_unlock(&_lcddl_stats.mutex);
 }
 
-static _LcddlToken
-_lcddl_get_next_token(_LcddlStream *stream)
+static void
+_lcddl_record_bytes_written(unsigned long long size)
 {
- _LcddlToken result = {0};
- result.line        = stream->current_line;
- int c              = _lcddl_get_character(stream);
- 
- // NOTE(tbt): ignore white space
- while (_lcddl_is_char_space(c))
+ _lcddl_mutex_lock(&_lcddl_stats.mutex);
+ _lcddl_stats.bytes_written += size;
+ _lcddl_mutex_unlock(&_lcddl_stats.mutex);
+}
+
+static void
+_lcddl_write_json_string(LcddlWriter *writer,
+                         char *string)
+{
+ lcddl_writer_put_char(writer, '"', 1);
+ for (char *c = string;
+      *c;
+      ++c)
  {
-  if (c == '\n')
+  if (*c == '"' || *c == '\\')
   {
-   ++stream->current_line;
+   lcddl_writer_put_char(writer, '\\', 1);
+   lcddl_writer_put_char(writer, *c, 1);
   }
-  _lcddl_consume_character(stream);
-  c = _lcddl_get_character(stream);
- }
- 
- // NOTE(tbt): skip comments
- if (c == '/' &&
-     _lcddl_peek_character(stream) == '/')
- {
-  while (c != '\n')
+  else if ((unsigned char)*c < 0x20)
   {
-   _lcddl_consume_character(stream);
-   c = _lcddl_get_character(stream);
+   lcddl_writer_printf(writer, "\\u%04x", *c);
+  }
+  else
+  {
+   lcddl_writer_put_char(writer, *c, 1);
   }
-  ++stream->current_line;
-  return _lcddl_get_next_token(stream);
  }
+ lcddl_writer_put_char(writer, '"', 1);
+}
+
+// NOTE(tbt): --trace records begin and end events in the chrome trace event format, which can be
+//            opened in perfetto or chrome://tracing. events may come from several threads at once
+typedef struct
+{
+ bool is_enabled;
+ _LcddlMutex mutex;
+ LcddlWriter events;
+ unsigned long long event_count;
+ unsigned long long start_time;
+} _LcddlTrace;
+
+static _LcddlTrace _lcddl_trace = { .mutex = LCDDL_MUTEX_INITIALISER };
+
+static unsigned long long
+_lcddl_get_thread_id(void)
+{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+ return GetCurrentThreadId();
+#elif defined(__linux__)
+ return syscall(SYS_gettid);
+#else
+ return (unsigned long long)(uintptr_t)pthread_self();
+#endif
+}
+
+static void
+_lcddl_trace_event(char *name,
+                   char phase,
+                   char *path)
+{
+ unsigned long long time      = _lcddl_get_time();
+ unsigned long long thread_id = _lcddl_get_thread_id();
  
+ _lcddl_mutex_lock(&_lcddl_trace.mutex);
+ if (!_lcddl_trace.events.buffer)
+ {
+  _lcddl_trace.events = lcddl_writer_for_memory();
+ }
+ if (_lcddl_trace.event_count)
+ {
+  lcddl_writer_put_string(&_lcddl_trace.events, ",\n");
+ }
+ lcddl_writer_printf(&_lcddl_trace.events,
+                     "{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %llu",
+                     name,
+                     phase,
+                     (time - _lcddl_trace.start_time) * 1e-3,
+                     thread_id);
+ if (path)
+ {
+  lcddl_writer_put_string(&_lcddl_trace.events, ", \"args\": {\"path\": ");
+  _lcddl_write_json_string(&_lcddl_trace.events, path);
+  lcddl_writer_put_char(&_lcddl_trace.events, '}', 1);
+ }
+ lcddl_writer_put_char(&_lcddl_trace.events, '}', 1);
+ _lcddl_trace.event_count += 1;
+ _lcddl_mutex_unlock(&_lcddl_trace.mutex);
+}
+
+#define _lcddl_trace_begin(_name, _path) if (_lcddl_trace.is_enabled) { _lcddl_trace_event((_name), 'B', (_path)); }
+#define _lcddl_trace_end(_name, _path) if (_lcddl_trace.is_enabled) { _lcddl_trace_event((_name), 'E', (_path)); }
+
+// NOTE(tbt): files are loaded and then parsed, so the record for a parse is usually the last one
+static _LcddlFileStats *
+_lcddl_get_file_stats(char *path)
+{
+ if (_lcddl_stats.file_count &&
+     0 == strcmp(_lcddl_stats.files[_lcddl_stats.file_count - 1].path, path) &&
+     !_lcddl_stats.files[_lcddl_stats.file_count - 1].parse_time)
+ {
+  return &_lcddl_stats.files[_lcddl_stats.file_count - 1];
+ }
  
- if (_lcddl_is_char_letter(c) ||
-     c == '_')
+ if (_lcddl_stats.file_count == _lcddl_stats.file_capacity)
  {
-  result.kind  = TOKEN_KIND_identifier;
-  result.value = &stream->buffer[stream->index];
-  
-  while (_lcddl_is_char_alphanumeric(c) ||
-         c == '_')
-  {
-   ++result.len;
-   _lcddl_consume_character(stream);
-   c = _lcddl_get_character(stream);
-  }
+  _lcddl_stats.file_capacity = _lcddl_stats.file_capacity ? 2 * _lcddl_stats.file_capacity : 64;
+  _lcddl_stats.files         = realloc(_lcddl_stats.files, _lcddl_stats.file_capacity * sizeof(*_lcddl_stats.files));
  }
- else if (_lcddl_is_char_number(c))
+ _LcddlFileStats *result = &_lcddl_stats.files[_lcddl_stats.file_count++];
+ memset(result, 0, sizeof(*result));
+ result->path = calloc(1, strlen(path) + 1);
+ strcpy(result->path, path);
+ 
+ return result;
+}
+
+static unsigned long long
+_lcddl_count_nodes(LcddlNode *root)
+{
+ unsigned long long result = 0;
+ if (root)
  {
-  result.kind  = TOKEN_KIND_integer_literal;
-  result.value = &stream->buffer[stream->index];
+  result += 1;
+  _lcddl_stats.node_counts[root->kind] += 1;
   
-  while (_lcddl_is_char_number(c) ||
-         c == '.')
+  switch (root->kind)
   {
-   if (c == '.')
+   case LCDDL_NODE_KIND_declaration:
    {
-    if (result.kind == TOKEN_KIND_integer_literal)
-    {
-     result.kind = TOKEN_KIND_float_literal;
-    }
-    else
-    {
-     print_error_and_exit(stream, "float literal may contain only one '.'");
-    }
+    result += _lcddl_count_nodes(root->declaration.type);
+    result += _lcddl_count_nodes(root->declaration.value);
+    break;
    }
    
-   ++result.len;
-   _lcddl_consume_character(stream);
-   c = _lcddl_get_character(stream);
+   case LCDDL_NODE_KIND_binary_operator:
+   {
+    result += _lcddl_count_nodes(root->binary_operator.left);
+    result += _lcddl_count_nodes(root->binary_operator.right);
+    break;
+   }
+   
+   case LCDDL_NODE_KIND_unary_operator:
+   {
+    result += _lcddl_count_nodes(root->unary_operator.operand);
+    break;
+   }
+   
+   case LCDDL_NODE_KIND_annotation:
+   {
+    result += _lcddl_count_nodes(root->annotation.value);
+    break;
+   }
+   
+   default: break;
   }
- }
- else if (c == '"')
- {
-  _lcddl_consume_character(stream);
-  c = _lcddl_get_character(stream);
   
-  result.kind  = TOKEN_KIND_string_literal;
-  result.value = &stream->buffer[stream->index];
-  
-  while (c != '"')
+  for (unsigned int i = 0;
+       i < root->child_count;
+       ++i)
   {
-   ++result.len;
-   _lcddl_consume_character(stream);
-   c = _lcddl_get_character(stream);
+   result += _lcddl_count_nodes(root->children[i]);
   }
   
-  _lcddl_consume_character(stream);
- }
- else if (c == '=')
- {
-  result.kind  = TOKEN_KIND_equals;
-  result.value = &stream->buffer[stream->index];
-  result.len   = 1;
-  _lcddl_consume_character(stream);
-  
-  c = _lcddl_get_character(stream);
-  if (c == '=')
+  for (unsigned int i = 0;
+       i < root->annotation_count;
+       ++i)
   {
-   result.kind = TOKEN_KIND_equality;
-   result.len  = 2;
-   _lcddl_consume_character(stream);
+   result += _lcddl_count_nodes(root->annotations[i]);
   }
  }
- else if (c == '!')
+ return result;
+}
+
+///////////////////////////////////////////
+// MEMORY
+//~
+
+static void *
+_lcddl_default_allocate(unsigned long long size,
+                        void *user_data)
+{
+ (void)user_data;
+ return malloc(size);
+}
+
+static void
+_lcddl_default_free(void *memory,
+                    unsigned long long size,
+                    void *user_data)
+{
+ (void)size;
+ (void)user_data;
+ free(memory);
+}
+
+// NOTE(tbt): input files, nodes, their strings and their child arrays are all allocated through here, so that
+//            they can be accounted for and limited. anything else uses the CRT directly, and trees opened from
+//            binary images live in pages of their own which are not counted
+typedef struct
+{
+ LcddlAllocator allocator;
+ LcddlMemoryStats stats;
+ unsigned long long failed_size; // size of the last allocation which failed, for reporting it
+} _LcddlMemory;
+
+static _LcddlMemory _lcddl_memory =
+{
+ .allocator = { .allocate = _lcddl_default_allocate, .free = _lcddl_default_free },
+};
+
+// NOTE(tbt): returns zeroed memory, or NULL if the allocation would go over the memory limit or the allocator
+//            fails. callers report the failure with `_lcddl_push_out_of_memory_diagnostic`
+static void *
+_lcddl_allocate(unsigned long long size)
+{
+ void *result = NULL;
+ if (!_lcddl_memory.stats.limit_bytes ||
+     _lcddl_memory.stats.live_bytes + size <= _lcddl_memory.stats.limit_bytes)
  {
-  result.kind  = TOKEN_KIND_exclamation;
-  result.value = &stream->buffer[stream->index];
-  result.len   = 1;
-  _lcddl_consume_character(stream);
-  
-  c = _lcddl_get_character(stream);
-  if (c == '=')
-  {
-   result.kind = TOKEN_KIND_not_equal_to;
-   result.len  = 2;
-   _lcddl_consume_character(stream);
-  }
+  result = _lcddl_memory.allocator.allocate(size, _lcddl_memory.allocator.user_data);
  }
- else if (c == '<')
+ if (!result)
  {
-  result.kind  = TOKEN_KIND_lesser_than;
-  result.value = &stream->buffer[stream->index];
-  result.len   = 1;
-  _lcddl_consume_character(stream);
-  
-  c = _lcddl_get_character(stream);
-  if (c == '=')
-  {
-   result.kind = TOKEN_KIND_lesser_than_or_equal_to;
-   result.len  = 2;
-   _lcddl_consume_character(stream);
-  }
-  else if (c == '<')
-  {
-   result.kind = TOKEN_KIND_bit_shift_right;
-   result.len  = 2;
-   _lcddl_consume_character(stream);
-  }
+  _lcddl_memory.failed_size = size;
+  return NULL;
  }
- else if (c == '>')
+ memset(result, 0, size);
+ 
+ _lcddl_memory.stats.live_bytes       += size;
+ _lcddl_memory.stats.live_allocations += 1;
+ if (_lcddl_memory.stats.live_bytes > _lcddl_memory.stats.peak_bytes)
  {
-  result.kind  = TOKEN_KIND_greater_than;
-  result.value = &stream->buffer[stream->index];
-  result.len   = 1;
-  _lcddl_consume_character(stream);
-  
-  c = _lcddl_get_character(stream);
-  if (c == '=')
-  {
-   result.kind = TOKEN_KIND_greater_than_or_equal_to;
-   result.len  = 2;
-   _lcddl_consume_character(stream);
-  }
-  else if (c == '>')
-  {
-   result.kind = TOKEN_KIND_bit_shift_right;
-   result.len  = 2;
-   _lcddl_consume_character(stream);
-  }
+  _lcddl_memory.stats.peak_bytes = _lcddl_memory.stats.live_bytes;
  }
- else if (c == '&')
+ _lcddl_stats.allocation_count += 1;
+ _lcddl_stats.bytes_allocated  += size;
+ 
+ return result;
+}
+
+static void
+_lcddl_free(void *memory,
+            unsigned long long size)
+{
+ if (memory)
  {
-  result.kind  = TOKEN_KIND_bitwise_and;
-  result.value = &stream->buffer[stream->index];
-  result.len   = 1;
-  _lcddl_consume_character(stream);
-  
-  c = _lcddl_get_character(stream);
-  if (c == '&')
-  {
-   result.kind = TOKEN_KIND_boolean_and;
-   result.len  = 2;
-   _lcddl_consume_character(stream);
-  }
+  _lcddl_memory.allocator.free(memory, size, _lcddl_memory.allocator.user_data);
+  _lcddl_memory.stats.live_bytes       -= size;
+  _lcddl_memory.stats.live_allocations -= 1;
  }
- else if (c == '|')
+}
+
+static LcddlNode *
+_lcddl_allocate_node(LcddlNodeKind kind)
+{
+ LcddlNode *result = _lcddl_allocate(sizeof(*result));
+ if (result)
  {
-  result.kind  = TOKEN_KIND_bitwise_or;
-  result.value = &stream->buffer[stream->index];
-  result.len   = 1;
-  _lcddl_consume_character(stream);
-  
-  c = _lcddl_get_character(stream);
-  if (c == '|')
-  {
-   result.kind = TOKEN_KIND_boolean_or;
-   result.len  = 2;
-   _lcddl_consume_character(stream);
-  }
+  result->kind                          = kind;
+  _lcddl_memory.stats.node_counts[kind] += 1;
  }
- else if (c == EOF)
+ return result;
+}
+
+static void
+_lcddl_free_node(LcddlNode *node)
+{
+ _lcddl_memory.stats.node_counts[node->kind] -= 1;
+ _lcddl_free(node, sizeof(*node));
+}
+
+// NOTE(tbt): stops early at a null byte, so that `_lcddl_free_string` can always recover the size from `strlen`
+static char *
+_lcddl_copy_string(char *string,
+                   unsigned long long length)
+{
+ length       = strnlen(string, length);
+ char *result = _lcddl_allocate(length + 1);
+ if (result)
  {
-  result.kind  = TOKEN_KIND_eof;
-  result.value = NULL;
-  result.len   = 0;
+  memcpy(result, string, length);
  }
- else
+ return result;
+}
+
+// NOTE(tbt): strings are allocated with exactly enough space for their terminator, so their size is known
+static void
+_lcddl_free_string(char *string)
+{
+ if (string)
  {
-  switch(c)
-  {
-   case ':':
-   {
-    result.kind = TOKEN_KIND_colon;
-    break;
-   }
-   case '{':
-   {
-    result.kind = TOKEN_KIND_open_curly_bracket;
-    break;
-   }
-   case '}':
-   {
-    result.kind = TOKEN_KIND_close_curly_bracket;
-    break;
-   }
-   case '[':
-   {
-    result.kind = TOKEN_KIND_open_square_bracket;
-    break;
-   }
-   case ']':
-   {
-    result.kind = TOKEN_KIND_close_square_bracket;
-    break;
-   }
-   case '(':
-   {
-    result.kind = TOKEN_KIND_open_bracket;
-    break;
-   }
-   case ')':
-   {
-    result.kind = TOKEN_KIND_close_bracket;
-    break;
-   }
-   case '*':
-   {
-    result.kind = TOKEN_KIND_asterisk;
-    break;
-   }
-   case '-':
-   {
-    result.kind = TOKEN_KIND_dash;
-    break;
-   }
-   case '/':
-   {
-    result.kind = TOKEN_KIND_slash;
-    break;
-   }
-   case '+':
-   {
-    result.kind = TOKEN_KIND_add;
-    break;
-   }
-   case '~':
-   {
-    result.kind = TOKEN_KIND_tilde;
-    break;
-   }
-   case '@':
-   {
-    result.kind = TOKEN_KIND_at_symbol;
-    break;
-   }
-   case ';':
-   {
-    result.kind = TOKEN_KIND_semicolon;
-    break;
-   }
-   case '^':
-   {
-    result.kind = TOKEN_KIND_bitwise_xor;
-    break;
-   }
-   default:
-   {
-    print_error_and_exit_f(stream, "Unexpected character '%c'", c);
-   }
-  }
-  
-  result.value    = &stream->buffer[stream->index];
-  result.len      = 1;
-  _lcddl_consume_character(stream);
+  _lcddl_free(string, strlen(string) + 1);
  }
- 
+}
+
+LcddlMemoryStats
+lcddl_get_memory_stats(void)
+{
+ return _lcddl_memory.stats;
+}
+
+///////////////////////////////////////////
+// DIAGNOSTICS
+//~
+
+// NOTE(tbt): syntax errors are recorded here rather than ending the process, so that every error in every
+//            input can be reported in one go. the executable also prints each one as soon as it is found
+typedef struct
+{
+ LcddlDiagnostic *diagnostics;
+ unsigned int count;
+ unsigned int capacity;
+ bool is_printed;
+} _LcddlDiagnostics;
+
+static _LcddlDiagnostics _lcddl_diagnostics;
+
+static void
+_lcddl_print_diagnostic(LcddlDiagnostic *diagnostic)
+{
+ if (diagnostic->line)
+ {
+  fprintf(stderr,
+          LOG_ERROR_BEGIN "%s\n",
+          diagnostic->path,
+          diagnostic->line,
+          diagnostic->column,
+          diagnostic->message);
+ }
+ else
+ {
+  fprintf(stderr, "ERROR: '%s' : %s\n", diagnostic->path, diagnostic->message);
+ }
+}
+
+static void
+_lcddl_push_diagnostic_v(char *path,
+                         unsigned long line,
+                         unsigned long column,
+                         char *format,
+                         va_list args)
+{
+ if (_lcddl_diagnostics.count == _lcddl_diagnostics.capacity)
+ {
+  _lcddl_diagnostics.capacity    = _lcddl_diagnostics.capacity ? _lcddl_diagnostics.capacity * 2 : 16;
+  _lcddl_diagnostics.diagnostics = realloc(_lcddl_diagnostics.diagnostics,
+                                           _lcddl_diagnostics.capacity * sizeof(*_lcddl_diagnostics.diagnostics));
+ }
+ 
+ char message[512];
+ vsnprintf(message, sizeof(message), format, args);
+ 
+ LcddlDiagnostic *diagnostic = &_lcddl_diagnostics.diagnostics[_lcddl_diagnostics.count++];
+ diagnostic->path            = calloc(1, strlen(path) + 1);
+ diagnostic->line            = line;
+ diagnostic->column          = column;
+ diagnostic->message         = calloc(1, strlen(message) + 1);
+ strcpy(diagnostic->path, path);
+ strcpy(diagnostic->message, message);
+ 
+ if (_lcddl_diagnostics.is_printed)
+ {
+  _lcddl_print_diagnostic(diagnostic);
+ }
+}
+
+static void
+_lcddl_push_diagnostic(char *path,
+                       unsigned long line,
+                       unsigned long column,
+                       char *format,
+                       ...)
+{
+ va_list args;
+ va_start(args, format);
+ _lcddl_push_diagnostic_v(path, line, column, format, args);
+ va_end(args);
+}
+
+// NOTE(tbt): reports the last allocation which failed
+static void
+_lcddl_push_out_of_memory_diagnostic(char *path)
+{
+ unsigned long long size = _lcddl_memory.failed_size;
+ if (_lcddl_memory.stats.limit_bytes &&
+     _lcddl_memory.stats.live_bytes + size > _lcddl_memory.stats.limit_bytes)
+ {
+  _lcddl_push_diagnostic(path, 0, 0,
+                         "Memory limit of %llu bytes exceeded - %llu bytes are in use and %llu more were needed",
+                         _lcddl_memory.stats.limit_bytes,
+                         _lcddl_memory.stats.live_bytes,
+                         size);
+ }
+ else
+ {
+  _lcddl_push_diagnostic(path, 0, 0, "Could not allocate %llu bytes", size);
+ }
+}
+
+static void
+_lcddl_clear_diagnostics(void)
+{
+ for (unsigned int i = 0;
+      i < _lcddl_diagnostics.count;
+      ++i)
+ {
+  free(_lcddl_diagnostics.diagnostics[i].path);
+  free(_lcddl_diagnostics.diagnostics[i].message);
+ }
+ _lcddl_diagnostics.count = 0;
+}
+
+///////////////////////////////////////////
+// LEXER
+//~
+
+typedef enum
+{
+ TOKEN_KIND_none,
+ 
+ TOKEN_KIND_identifier,               // a series of alphanumeric characters begining with a letter or '_'
+ TOKEN_KIND_integer_literal,          // a series of numbers
+ TOKEN_KIND_float_literal,            // a series of numbers containing exactly one '.'
+ TOKEN_KIND_string_literal,           // a series of characters bounded by '"'
+ TOKEN_KIND_colon,                    // ':'
+ TOKEN_KIND_equals,                   // '='
+ TOKEN_KIND_open_curly_bracket,       // '{'
+ TOKEN_KIND_close_curly_bracket,      // '}'
+ TOKEN_KIND_open_square_bracket,      // '['
+ TOKEN_KIND_close_square_bracket,     // ']'
+ TOKEN_KIND_open_bracket,             // '('
+ TOKEN_KIND_close_bracket,            // ')'
+ TOKEN_KIND_asterisk,                 // '*'
+ TOKEN_KIND_dash,                     // '-'
+ TOKEN_KIND_slash,                    // '/'
+ TOKEN_KIND_add,                      // '+'
+ TOKEN_KIND_tilde,                    // '~'
+ TOKEN_KIND_exclamation,              // '!'
+ TOKEN_KIND_lesser_than,              // '<'
+ TOKEN_KIND_greater_than,             // '>'
+ TOKEN_KIND_lesser_than_or_equal_to,  // '<='
+ TOKEN_KIND_greater_than_or_equal_to, // '>='
+ TOKEN_KIND_equality,                 // '=='
+ TOKEN_KIND_not_equal_to,             // '!='
+ TOKEN_KIND_bit_shift_left,           // '<<'
+ TOKEN_KIND_bit_shift_right,          // '>>'
+ TOKEN_KIND_bitwise_and,              // '&'
+ TOKEN_KIND_bitwise_or,               // '|'
+ TOKEN_KIND_bitwise_xor,              // '^'
+ TOKEN_KIND_boolean_and,              // '&&'
+ TOKEN_KIND_boolean_or,               // '||'
+ TOKEN_KIND_at_symbol,                // '@'
+ TOKEN_KIND_semicolon,                // ';'
+ TOKEN_KIND_eof,                      // EOF
+} _LcddlTokenKind;
+
+#define token_kind_to_string(_token_kind)                                      \
+((_token_kind) == TOKEN_KIND_none                     ? "none" :           \
+(_token_kind) == TOKEN_KIND_identifier               ? "identifier" :     \
+(_token_kind) == TOKEN_KIND_integer_literal          ? "integer literal" :\
+(_token_kind) == TOKEN_KIND_float_literal            ? "float literal" :  \
+(_token_kind) == TOKEN_KIND_string_literal           ? "string literal" : \
+(_token_kind) == TOKEN_KIND_colon                    ? ":" :              \
+(_token_kind) == TOKEN_KIND_equals                   ? "=" :              \
+(_token_kind) == TOKEN_KIND_open_curly_bracket       ? "{" :              \
+(_token_kind) == TOKEN_KIND_close_curly_bracket      ? "}" :              \
+(_token_kind) == TOKEN_KIND_open_square_bracket      ? "[" :              \
+(_token_kind) == TOKEN_KIND_close_square_bracket     ? "]" :              \
+(_token_kind) == TOKEN_KIND_open_bracket             ? "(" :              \
+(_token_kind) == TOKEN_KIND_close_bracket            ? ")" :              \
+(_token_kind) == TOKEN_KIND_asterisk                 ? "*" :              \
+(_token_kind) == TOKEN_KIND_dash                     ? "-" :              \
+(_token_kind) == TOKEN_KIND_slash                    ? "/" :              \
+(_token_kind) == TOKEN_KIND_add                      ? "+" :              \
+(_token_kind) == TOKEN_KIND_tilde                    ? "~" :              \
+(_token_kind) == TOKEN_KIND_lesser_than              ? "<" :              \
+(_token_kind) == TOKEN_KIND_greater_than             ? ">" :              \
+(_token_kind) == TOKEN_KIND_lesser_than_or_equal_to  ? "<=" :             \
+(_token_kind) == TOKEN_KIND_greater_than_or_equal_to ? ">=" :             \
+(_token_kind) == TOKEN_KIND_equality                 ? "==" :             \
+(_token_kind) == TOKEN_KIND_not_equal_to             ? "!=" :             \
+(_token_kind) == TOKEN_KIND_bit_shift_left           ? "<<" :             \
+(_token_kind) == TOKEN_KIND_bit_shift_right          ? ">>" :             \
+(_token_kind) == TOKEN_KIND_at_symbol                ? "@" :              \
+(_token_kind) == TOKEN_KIND_semicolon                ? ";" :              \
+(_token_kind) == TOKEN_KIND_eof                      ? "eof" : NULL)
+
+
+typedef struct
+{
+ _LcddlTokenKind kind;
+ unsigned int len;
+ char *value;
+ unsigned int offset;
+} _LcddlToken;
+
+#define PATH_MAX_LEN 96
+
+// NOTE(tbt): lines are not counted while lexing, as they are only needed to report a location. instead the
+//            offset of the start of every line is found in one pass over the text the first time a location
+//            is needed, and each location is then a binary search
+struct LcddlSource
+{
+ char *buffer;
+ unsigned long long size;
+ unsigned int *line_offsets; // NULL until the first location is needed
+ unsigned int line_count;
+};
+
+static unsigned int
+_lcddl_count_bits(unsigned int x)
+{
+ x = x - ((x >> 1) & 0x55555555);
+ x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+ return (((x + (x >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+static void
+_lcddl_build_line_offsets(char *buffer,
+                          unsigned long long size,
+                          unsigned int **line_offsets,
+                          unsigned int *line_count)
+{
+ // NOTE(tbt): newlines are counted first so that the table can be allocated at exactly the right size
+ unsigned int count   = 1;
+ unsigned long long i = 0;
+#if defined(LCDDL_SIMD_AVX) || defined(LCDDL_SIMD_SSE2)
+ __m128i newlines = _mm_set1_epi8('\n');
+ for (; i + 16 <= size; i += 16)
+ {
+  __m128i chunk = _mm_loadu_si128((__m128i *)&buffer[i]);
+  count += _lcddl_count_bits(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newlines)));
+ }
+#endif
+ for (; i < size; ++i)
+ {
+  count += buffer[i] == '\n';
+ }
+ 
+ // NOTE(tbt): without a table, locations are reported without a line or column
+ unsigned int *result = _lcddl_allocate(count * sizeof(*result));
+ if (!result)
+ {
+  return;
+ }
+ 
+ unsigned int line = 1;
+ i                 = 0;
+#if defined(LCDDL_SIMD_AVX) || defined(LCDDL_SIMD_SSE2)
+ for (; i + 16 <= size; i += 16)
+ {
+  __m128i chunk     = _mm_loadu_si128((__m128i *)&buffer[i]);
+  unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newlines));
+  for (unsigned int bit = 0;
+       mask;
+       ++bit, mask >>= 1)
+  {
+   if (mask & 1)
+   {
+    result[line++] = i + bit + 1;
+   }
+  }
+ }
+#endif
+ for (; i < size; ++i)
+ {
+  if (buffer[i] == '\n')
+  {
+   result[line++] = i + 1;
+  }
+ }
+ 
+ *line_offsets = result;
+ *line_count   = count;
+}
+
+static void
+_lcddl_find_line_and_column(unsigned int *line_offsets,
+                            unsigned int line_count,
+                            unsigned int offset,
+                            unsigned long *line,
+                            unsigned long *column)
+{
+ // NOTE(tbt): finds the last line which starts at or before `offset`. the first line always starts at 0
+ unsigned int low  = 0;
+ unsigned int high = line_count;
+ while (high - low > 1)
+ {
+  unsigned int middle = low + (high - low) / 2;
+  if (line_offsets[middle] <= offset) { low  = middle; }
+  else                                { high = middle; }
+ }
+ *line   = low + 1;
+ *column = offset - line_offsets[low] + 1;
+}
+
+static void
+_lcddl_free_source(LcddlSource *source)
+{
+ if (source)
+ {
+  _lcddl_free(source->buffer, source->size + 1);
+  _lcddl_free(source->line_offsets, source->line_count * sizeof(*source->line_offsets));
+  _lcddl_free(source, sizeof(*source));
+ }
+}
+
+typedef struct
+{
+ char *buffer;
+ unsigned long long size;
+ unsigned long long index;
+ 
+ char *path;
+ bool is_owned; // whether `buffer` and `path` were allocated for the stream, rather than given to it
+ 
+ unsigned int *line_offsets; // NULL until the first error
+ unsigned int line_count;
+ 
+ _LcddlToken current_token;
+ 
+ unsigned int error_count;
+ bool is_panicking;
+ bool is_out_of_memory; // once set the stream only gives end of file tokens, so the parser stops
+} _LcddlStream;
+
+static _LcddlToken _lcddl_get_next_token(_LcddlStream *stream);
+
+// NOTE(tbt): a badly broken input could otherwise record an error for every few bytes
+#define LCDDL_MAX_DIAGNOSTICS_PER_FILE 100
+
+static void
+_lcddl_push_stream_diagnostic(_LcddlStream *stream,
+                              unsigned int offset,
+                              char *format,
+                              va_list args)
+{
+ // NOTE(tbt): once out of memory, the parser reports tokens missing as it unwinds
+ stream->error_count += 1;
+ if (stream->error_count > LCDDL_MAX_DIAGNOSTICS_PER_FILE ||
+     stream->is_out_of_memory)
+ {
+  return;
+ }
+ 
+ if (!stream->line_offsets)
+ {
+  _lcddl_build_line_offsets(stream->buffer, stream->size, &stream->line_offsets, &stream->line_count);
+ }
+ 
+ unsigned long line = 0, column = 0;
+ if (stream->line_offsets)
+ {
+  _lcddl_find_line_and_column(stream->line_offsets, stream->line_count, offset, &line, &column);
+ }
+ _lcddl_push_diagnostic_v(stream->path, line, column, format, args);
+ 
+ if (stream->error_count == LCDDL_MAX_DIAGNOSTICS_PER_FILE)
+ {
+  _lcddl_push_diagnostic(stream->path, 0, 0, "Too many errors, no more will be reported for this file");
+ }
+}
+
+// NOTE(tbt): errors found by the lexer are reported at the start of the token being lexed. the lexer always
+//            recovers by itself, by skipping the character or ending the token
+static void
+_lcddl_report_lexer_error(_LcddlStream *stream,
+                          _LcddlToken *token,
+                          char *format,
+                          ...)
+{
+ va_list args;
+ va_start(args, format);
+ _lcddl_push_stream_diagnostic(stream, token->offset, format, args);
+ va_end(args);
+}
+
+// NOTE(tbt): after an error the parser is panicking until it resynchronises at the end of the statement. errors
+//            are not reported while panicking, so that one mistake is not followed by a cascade of others
+static void
+_lcddl_report_parser_error(_LcddlStream *stream,
+                           char *format,
+                           ...)
+{
+ if (!stream->is_panicking)
+ {
+  va_list args;
+  va_start(args, format);
+  _lcddl_push_stream_diagnostic(stream, stream->current_token.offset, format, args);
+  va_end(args);
+  stream->is_panicking = true;
+ }
+}
+
+// NOTE(tbt): when an allocation fails the error is reported and the stream ends, so that the parser unwinds
+//            without reading any further. returns whether `memory` was allocated
+static bool
+_lcddl_check_allocation(_LcddlStream *stream,
+                        void *memory)
+{
+ if (!memory &&
+     !stream->is_out_of_memory)
+ {
+  _lcddl_push_out_of_memory_diagnostic(stream->path);
+  stream->error_count        += 1;
+  stream->is_out_of_memory    = true;
+  stream->is_panicking        = true;
+  stream->current_token.kind  = TOKEN_KIND_eof;
+  stream->current_token.value = "";
+  stream->current_token.len   = 0;
+ }
+ return NULL != memory;
+}
+
+static _LcddlStream
+_lcddl_load_entire_file_as_stream(char *filename)
+{
+ _lcddl_trace_begin("load", filename);
+ unsigned long long start_time = _lcddl_stats.is_enabled ? _lcddl_get_time() : 0;
+ 
+ _LcddlStream result = {0};
+ result.path         = _lcddl_copy_string(filename, strlen(filename));
+ result.is_owned     = true;
+ 
+ FILE *file = NULL;
+ if (!result.path)
+ {
+  // NOTE(tbt): the stream never outlives `filename`, so can borrow it instead
+  result.path     = filename;
+  result.is_owned = false;
+  _lcddl_check_allocation(&result, NULL);
+ }
+ else if ((file = fopen(filename, "rb")))
+ {
+  fseek(file, 0, SEEK_END);
+  unsigned long long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  
+  // NOTE(tbt): node offsets are 32 bit
+  if (size > 0xffffffff)
+  {
+   _lcddl_push_diagnostic(filename, 0, 0, "Files larger than 4GB are not supported");
+   result.error_count += 1;
+  }
+  else
+  {
+   result.buffer = _lcddl_allocate(size + 1);
+   if (_lcddl_check_allocation(&result, result.buffer))
+   {
+    result.size = size;
+    fread(result.buffer, 1, result.size, file);
+   }
+  }
+  fclose(file);
+ }
+ else
+ {
+  _lcddl_push_diagnostic(filename, 0, 0, "Could not open file");
+  result.error_count += 1;
+ }
+ 
+ _lcddl_stats.bytes_read += result.size;
+ if (_lcddl_stats.is_enabled)
+ {
+  _LcddlFileStats *file_stats = _lcddl_get_file_stats(filename);
+  file_stats->bytes_read      = result.size;
+  file_stats->load_time       = _lcddl_get_time() - start_time;
+ }
+ _lcddl_trace_end("load", filename);
+ 
+ result.current_token = _lcddl_get_next_token(&result);
+ 
+ return result;
+}
+
+// NOTE(tbt): `buffer` and `path` must outlive the stream
+static _LcddlStream
+_lcddl_make_memory_stream(char *buffer,
+                          unsigned long long size,
+                          char *path)
+{
+ _LcddlStream result  = {0};
+ result.buffer        = buffer;
+ result.size          = size;
+ result.path          = path;
+ result.current_token = _lcddl_get_next_token(&result);
+ return result;
+}
+
+// NOTE(tbt): the text of a successfully parsed stream is kept by its file node, for working out locations.
+//            a loaded stream's buffer is handed over as it is, and any other is copied
+static LcddlSource *
+_lcddl_take_source(_LcddlStream *stream)
+{
+ LcddlSource *result = _lcddl_allocate(sizeof(*result));
+ if (!result)
+ {
+  return NULL;
+ }
+ result->size = stream->size;
+ if (stream->is_owned)
+ {
+  result->buffer = stream->buffer;
+  stream->buffer = NULL;
+ }
+ else
+ {
+  result->buffer = _lcddl_allocate(stream->size + 1);
+  if (!result->buffer)
+  {
+   _lcddl_free(result, sizeof(*result));
+   return NULL;
+  }
+  if (stream->size)
+  {
+   memcpy(result->buffer, stream->buffer, stream->size);
+  }
+ }
+ result->line_offsets = stream->line_offsets;
+ result->line_count   = stream->line_count;
+ stream->line_offsets = NULL;
+ return result;
+}
+
+static void
+_lcddl_free_stream(_LcddlStream *stream)
+{
+ if (stream->is_owned)
+ {
+  _lcddl_free(stream->buffer, stream->size + 1);
+  _lcddl_free_string(stream->path);
+ }
+ _lcddl_free(stream->line_offsets, stream->line_count * sizeof(*stream->line_offsets));
+}
+
+static int
+_lcddl_get_character(_LcddlStream *stream)
+{
+ if (stream->index < stream->size)
+ {
+  return (int)stream->buffer[stream->index];
+ }
+ return EOF;
+}
+
+static int
+_lcddl_peek_character(_LcddlStream *stream)
+{
+ if (stream->index + 1 < stream->size)
+ {
+  return (int)stream->buffer[stream->index + 1];
+ }
+ return EOF;
+}
+
+static void
+_lcddl_consume_character(_LcddlStream *stream)
+{
+ stream->index += 1;
+}
+
+// NOTE(tbt): true for characters which can not begin any token
+static bool
+_lcddl_is_char_unexpected(int c)
+{
+ return (c != EOF &&
+         !_lcddl_is_char_space(c) &&
+         !_lcddl_is_char_letter(c) &&
+         !_lcddl_is_char_number(c) &&
+         (c == '\0' || !strchr("_\"=!<>&|:{}[]()*-/+~@;^", c)));
+}
+
+static _LcddlToken
+_lcddl_get_next_token(_LcddlStream *stream)
+{
+ _lcddl_stats.token_count += 1;
+ 
+ _LcddlToken result = {0};
+ if (stream->is_out_of_memory)
+ {
+  result.kind  = TOKEN_KIND_eof;
+  result.value = "";
+  return result;
+ }
+ 
+ int c = _lcddl_get_character(stream);
+ 
+ // NOTE(tbt): skip white space, comments and characters which can not begin a token until a token is found.
+ //            this is a loop rather than recursion, as an input may contain any number of them in a row
+ for (;;)
+ {
+  while (_lcddl_is_char_space(c))
+  {
+   _lcddl_consume_character(stream);
+   c = _lcddl_get_character(stream);
+  }
+  
+  if (c == '/' &&
+      _lcddl_peek_character(stream) == '/')
+  {
+   while (c != '\n' &&
+          c != EOF)
+   {
+    _lcddl_consume_character(stream);
+    c = _lcddl_get_character(stream);
+   }
+  }
+  else if (_lcddl_is_char_unexpected(c))
+  {
+   // NOTE(tbt): a run of unexpected characters is reported once
+   result.offset     = stream->index;
+   unsigned int size = 0;
+   while (_lcddl_is_char_unexpected(c))
+   {
+    size += 1;
+    _lcddl_consume_character(stream);
+    c = _lcddl_get_character(stream);
+   }
+   
+   if (size == 1)
+   {
+    _lcddl_report_lexer_error(stream, &result, "Unexpected character '%c'", stream->buffer[result.offset]);
+   }
+   else
+   {
+    _lcddl_report_lexer_error(stream, &result, "%u unexpected characters '%.*s%s'",
+                              size, size < 16 ? size : 16, &stream->buffer[result.offset], size > 16 ? "..." : "");
+   }
+  }
+  else
+  {
+   break;
+  }
+ }
+ 
+ result.offset = stream->index;
+ 
+ if (_lcddl_is_char_letter(c) ||
+     c == '_')
+ {
+  result.kind  = TOKEN_KIND_identifier;
+  result.value = &stream->buffer[stream->index];
+  
+  while (_lcddl_is_char_alphanumeric(c) ||
+         c == '_')
+  {
+   ++result.len;
+   _lcddl_consume_character(stream);
+   c = _lcddl_get_character(stream);
+  }
+ }
+ else if (_lcddl_is_char_number(c))
+ {
+  result.kind  = TOKEN_KIND_integer_literal;
+  result.value = &stream->buffer[stream->index];
+  
+  while (_lcddl_is_char_number(c) ||
+         c == '.')
+  {
+   if (c == '.')
+   {
+    if (result.kind == TOKEN_KIND_integer_literal)
+    {
+     result.kind = TOKEN_KIND_float_literal;
+    }
+    else
+    {
+     _lcddl_report_lexer_error(stream, &result, "float literal may contain only one '.'");
+    }
+   }
+   
+   ++result.len;
+   _lcddl_consume_character(stream);
+   c = _lcddl_get_character(stream);
+  }
+ }
+ else if (c == '"')
+ {
+  _lcddl_consume_character(stream);
+  c = _lcddl_get_character(stream);
+  
+  result.kind  = TOKEN_KIND_string_literal;
+  result.value = &stream->buffer[stream->index];
+  
+  while (c != '"' &&
+         c != EOF)
+  {
+   ++result.len;
+   _lcddl_consume_character(stream);
+   c = _lcddl_get_character(stream);
+  }
+  
+  if (c == EOF)
+  {
+   _lcddl_report_lexer_error(stream, &result, "Unterminated string literal");
+  }
+  else
+  {
+   _lcddl_consume_character(stream);
+  }
+ }
+ else if (c == '=')
+ {
+  result.kind  = TOKEN_KIND_equals;
+  result.value = &stream->buffer[stream->index];
+  result.len   = 1;
+  _lcddl_consume_character(stream);
+  
+  c = _lcddl_get_character(stream);
+  if (c == '=')
+  {
+   result.kind = TOKEN_KIND_equality;
+   result.len  = 2;
+   _lcddl_consume_character(stream);
+  }
+ }
+ else if (c == '!')
+ {
+  result.kind  = TOKEN_KIND_exclamation;
+  result.value = &stream->buffer[stream->index];
+  result.len   = 1;
+  _lcddl_consume_character(stream);
+  
+  c = _lcddl_get_character(stream);
+  if (c == '=')
+  {
+   result.kind = TOKEN_KIND_not_equal_to;
+   result.len  = 2;
+   _lcddl_consume_character(stream);
+  }
+ }
+ else if (c == '<')
+ {
+  result.kind  = TOKEN_KIND_lesser_than;
+  result.value = &stream->buffer[stream->index];
+  result.len   = 1;
+  _lcddl_consume_character(stream);
+  
+  c = _lcddl_get_character(stream);
+  if (c == '=')
+  {
+   result.kind = TOKEN_KIND_lesser_than_or_equal_to;
+   result.len  = 2;
+   _lcddl_consume_character(stream);
+  }
+  else if (c == '<')
+  {
+   result.kind = TOKEN_KIND_bit_shift_right;
+   result.len  = 2;
+   _lcddl_consume_character(stream);
+  }
+ }
+ else if (c == '>')
+ {
+  result.kind  = TOKEN_KIND_greater_than;
+  result.value = &stream->buffer[stream->index];
+  result.len   = 1;
+  _lcddl_consume_character(stream);
+  
+  c = _lcddl_get_character(stream);
+  if (c == '=')
+  {
+   result.kind = TOKEN_KIND_greater_than_or_equal_to;
+   result.len  = 2;
+   _lcddl_consume_character(stream);
+  }
+  else if (c == '>')
+  {
+   result.kind = TOKEN_KIND_bit_shift_right;
+   result.len  = 2;
+   _lcddl_consume_character(stream);
+  }
+ }
+ else if (c == '&')
+ {
+  result.kind  = TOKEN_KIND_bitwise_and;
+  result.value = &stream->buffer[stream->index];
+  result.len   = 1;
+  _lcddl_consume_character(stream);
+  
+  c = _lcddl_get_character(stream);
+  if (c == '&')
+  {
+   result.kind = TOKEN_KIND_boolean_and;
+   result.len  = 2;
+   _lcddl_consume_character(stream);
+  }
+ }
+ else if (c == '|')
+ {
+  result.kind  = TOKEN_KIND_bitwise_or;
+  result.value = &stream->buffer[stream->index];
+  result.len   = 1;
+  _lcddl_consume_character(stream);
+  
+  c = _lcddl_get_character(stream);
+  if (c == '|')
+  {
+   result.kind = TOKEN_KIND_boolean_or;
+   result.len  = 2;
+   _lcddl_consume_character(stream);
+  }
+ }
+ else if (c == EOF)
+ {
+  // NOTE(tbt): after an error the parser may copy the value of whatever token it is at, so it is never NULL
+  result.kind  = TOKEN_KIND_eof;
+  result.value = "";
+  result.len   = 0;
+ }
+ else
+ {
+  switch(c)
+  {
+   case ':':
+   {
+    result.kind = TOKEN_KIND_colon;
+    break;
+   }
+   case '{':
+   {
+    result.kind = TOKEN_KIND_open_curly_bracket;
+    break;
+   }
+   case '}':
+   {
+    result.kind = TOKEN_KIND_close_curly_bracket;
+    break;
+   }
+   case '[':
+   {
+    result.kind = TOKEN_KIND_open_square_bracket;
+    break;
+   }
+   case ']':
+   {
+    result.kind = TOKEN_KIND_close_square_bracket;
+    break;
+   }
+   case '(':
+   {
+    result.kind = TOKEN_KIND_open_bracket;
+    break;
+   }
+   case ')':
+   {
+    result.kind = TOKEN_KIND_close_bracket;
+    break;
+   }
+   case '*':
+   {
+    result.kind = TOKEN_KIND_asterisk;
+    break;
+   }
+   case '-':
+   {
+    result.kind = TOKEN_KIND_dash;
+    break;
+   }
+   case '/':
+   {
+    result.kind = TOKEN_KIND_slash;
+    break;
+   }
+   case '+':
+   {
+    result.kind = TOKEN_KIND_add;
+    break;
+   }
+   case '~':
+   {
+    result.kind = TOKEN_KIND_tilde;
+    break;
+   }
+   case '@':
+   {
+    result.kind = TOKEN_KIND_at_symbol;
+    break;
+   }
+   case ';':
+   {
+    result.kind = TOKEN_KIND_semicolon;
+    break;
+   }
+   case '^':
+   {
+    result.kind = TOKEN_KIND_bitwise_xor;
+    break;
+   }
+   default:
+   {
+    // NOTE(tbt): unreachable, as unexpected characters have already been skipped
+    break;
+   }
+  }
+  
+  result.value    = &stream->buffer[stream->index];
+  result.len      = 1;
+  _lcddl_consume_character(stream);
+ }
+ 
+ return result;
+} 
+
+static void
+_lcddl_consume_token(_LcddlStream *stream,
+                     _LcddlTokenKind required_kind)
+{
+ if (stream->current_token.kind == required_kind)
+ {
+  stream->current_token = _lcddl_get_next_token(stream);
+ }
+ else
+ {
+  // NOTE(tbt): the token is left in place for the parser to resynchronise from
+  _lcddl_report_parser_error(stream,
+                             "Expected '%s', got '%s'",
+                             token_kind_to_string(required_kind),
+                             token_kind_to_string(stream->current_token.kind));
+ }
+}
+
+static LcddlOperatorKind
+_lcddl_token_to_operator_kind(_LcddlToken token,
+                              bool unary) // whether to use the unary or binary version if ambiguous
+{
+ switch (token.kind)
+ {
+  case TOKEN_KIND_tilde:
+  {
+   return LCDDL_UN_OP_KIND_bitwise_not;
+  }
+  case TOKEN_KIND_exclamation:
+  {
+   return LCDDL_UN_OP_KIND_boolean_not;
+  }
+  case TOKEN_KIND_add:
+  {
+   if (unary) { return LCDDL_UN_OP_KIND_positive; }
+   else       { return LCDDL_BIN_OP_KIND_add; }
+  }
+  case TOKEN_KIND_dash:
+  {
+   if (unary) { return LCDDL_UN_OP_KIND_negative; }
+   else       { return LCDDL_BIN_OP_KIND_subtract; }
+  }
+  case TOKEN_KIND_asterisk:
+  {
+   return LCDDL_BIN_OP_KIND_multiply;
+  }
+  case TOKEN_KIND_slash:
+  {
+   return LCDDL_BIN_OP_KIND_divide;
+  }
+  case TOKEN_KIND_lesser_than:
+  {
+   return LCDDL_BIN_OP_KIND_lesser_than;
+  }
+  case TOKEN_KIND_greater_than:
+  {
+   return LCDDL_BIN_OP_KIND_greater_than;
+  }
+  case TOKEN_KIND_lesser_than_or_equal_to:
+  {
+   return LCDDL_BIN_OP_KIND_lesser_than_or_equal_to;
+  }
+  case TOKEN_KIND_greater_than_or_equal_to:
+  {
+   return LCDDL_BIN_OP_KIND_greater_than_or_equal_to;
+  }
+  case TOKEN_KIND_equality:
+  {
+   return LCDDL_BIN_OP_KIND_equality;
+  }
+  case TOKEN_KIND_not_equal_to:
+  {
+   return LCDDL_BIN_OP_KIND_not_equal_to;
+  }
+  case TOKEN_KIND_bit_shift_left:
+  {
+   return LCDDL_BIN_OP_KIND_bit_shift_left;
+  }
+  case TOKEN_KIND_bit_shift_right:
+  {
+   return LCDDL_BIN_OP_KIND_bit_shift_right;
+  }
+  case TOKEN_KIND_bitwise_and:
+  {
+   return LCDDL_BIN_OP_KIND_bitwise_and;
+  }
+  case TOKEN_KIND_bitwise_or:
+  {
+   return LCDDL_BIN_OP_KIND_bitwise_or;
+  }
+  case TOKEN_KIND_bitwise_xor:
+  {
+   return LCDDL_BIN_OP_KIND_bitwise_xor;
+  }
+  case TOKEN_KIND_boolean_and:
+  {
+   return LCDDL_BIN_OP_KIND_boolean_and;
+  }
+  case TOKEN_KIND_boolean_or:
+  {
+   return LCDDL_BIN_OP_KIND_boolean_or;
+  }
+  default:
+  {
+   return -1;
+  }
+ }
+}
+
+static bool
+_lcddl_is_token_usable_as_binary_operator(_LcddlToken token)
+{
+ LcddlOperatorKind kind = _lcddl_token_to_operator_kind(token, false);
+ if (kind == -1                          ||
+     kind <= LCDDL_BINARY_OPERATOR_BEGIN ||
+     kind >= LCDDL_BINARY_OPERATOR_END)
+ {
+  return false;
+ }
+ return true;
+}
+
+static bool
+_lcddl_is_token_usable_as_unary_operator(_LcddlToken token)
+{
+ LcddlOperatorKind kind = _lcddl_token_to_operator_kind(token, true);
+ if (kind == -1                          ||
+     kind <= LCDDL_UNARY_OPERATOR_BEGIN ||
+     kind >= LCDDL_UNARY_OPERATOR_END)
+ {
+  return false;
+ }
+ return true;
+}
+
+///////////////////////////////////////////
+// PARSER
+//~
+
+static LcddlNode *_lcddl_parse_file(char *path);
+static LcddlNode *_lcddl_parse_statement(_LcddlStream *stream);
+static void _lcddl_parse_statement_list(_LcddlStream *stream, LcddlNode *parent, bool is_top_level);
+static LcddlNode *_lcddl_parse_annotations(_LcddlStream *stream);
+static LcddlNode *_lcddl_parse_declaration(_LcddlStream *stream);
+static LcddlNode *_lcddl_parse_type(_LcddlStream *stream);
+static LcddlNode *_lcddl_parse_binary_operator_rhs(_LcddlStream *stream, unsigned int expression_precedence, LcddlNode *lhs);
+static LcddlNode *_lcddl_parse_expression(_LcddlStream *stream);
+static LcddlNode *_lcddl_parse_parenthesis(_LcddlStream *lexer);
+static LcddlNode *_lcddl_parse_primary(_LcddlStream *stream);
+static LcddlNode *_lcddl_parse_unary_operator(_LcddlStream *stream);
+static LcddlNode *_lcddl_parse_literal(_LcddlStream *stream);
+static LcddlNode *_lcddl_parse_variable_reference(_LcddlStream *stream);
+
+// NOTE(tbt): lists are linked up as they are parsed, then copied into an array once their length is known.
+//            returns NULL with a count of 0 if the array could not be allocated, leaving the list to be freed
+//            with `_lcddl_free_node_list`
+static LcddlNode **
+_lcddl_make_node_array(LcddlNode *first,
+                       unsigned int *count)
+{
+ unsigned int result_count = 0;
+ for (LcddlNode *node = first;
+      NULL != node;
+      node = node->next_sibling)
+ {
+  result_count += 1;
+ }
+ 
+ LcddlNode **result = NULL;
+ if (result_count)
+ {
+  result = _lcddl_allocate(result_count * sizeof(*result));
+  if (!result)
+  {
+   result_count = 0;
+  }
+  
+  unsigned int index = 0;
+  for (LcddlNode *node = first;
+       NULL != node && index < result_count;
+       node = node->next_sibling)
+  {
+   result[index++] = node;
+  }
+ }
+ 
+ *count = result_count;
+ return result;
+}
+
+// NOTE(tbt): a node's hash covers its own fields and the hashes of its children, annotations and operands, so
+//            they must all have been hashed first. the parser hashes each node once it is complete
+static unsigned long long
+_lcddl_hash_node(LcddlNode *node)
+{
+#define hash_string(_string) _lcddl_hash_bytes((_string), strlen(_string))
+#define hash_child(_child)   ((_child) ? (_child)->hash : 0)
+ 
+ unsigned long long result = _lcddl_hash_combine(0, node->kind);
+ switch (node->kind)
+ {
+  case LCDDL_NODE_KIND_root:
+  {
+   break;
+  }
+  case LCDDL_NODE_KIND_file:
+  {
+   result = _lcddl_hash_combine(result, hash_string(node->file.filename));
+   break;
+  }
+  case LCDDL_NODE_KIND_declaration:
+  {
+   result = _lcddl_hash_combine(result, hash_string(node->declaration.name));
+   result = _lcddl_hash_combine(result, hash_child(node->declaration.type));
+   result = _lcddl_hash_combine(result, hash_child(node->declaration.value));
+   break;
+  }
+  case LCDDL_NODE_KIND_type:
+  {
+   result = _lcddl_hash_combine(result, hash_string(node->type.type_name));
+   result = _lcddl_hash_combine(result, node->type.array_count);
+   result = _lcddl_hash_combine(result, node->type.indirection_level);
+   break;
+  }
+  case LCDDL_NODE_KIND_binary_operator:
+  {
+   result = _lcddl_hash_combine(result, node->binary_operator.kind);
+   result = _lcddl_hash_combine(result, hash_child(node->binary_operator.left));
+   result = _lcddl_hash_combine(result, hash_child(node->binary_operator.right));
+   break;
+  }
+  case LCDDL_NODE_KIND_unary_operator:
+  {
+   result = _lcddl_hash_combine(result, node->unary_operator.kind);
+   result = _lcddl_hash_combine(result, hash_child(node->unary_operator.operand));
+   break;
+  }
+  case LCDDL_NODE_KIND_string_literal:
+  case LCDDL_NODE_KIND_float_literal:
+  case LCDDL_NODE_KIND_integer_literal:
+  {
+   result = _lcddl_hash_combine(result, hash_string(node->literal.value));
+   break;
+  }
+  case LCDDL_NODE_KIND_variable_reference:
+  {
+   result = _lcddl_hash_combine(result, hash_string(node->var_reference.name));
+   break;
+  }
+  case LCDDL_NODE_KIND_annotation:
+  {
+   result = _lcddl_hash_combine(result, hash_string(node->annotation.tag));
+   result = _lcddl_hash_combine(result, hash_child(node->annotation.value));
+   break;
+  }
+ }
+ 
+ result = _lcddl_hash_combine(result, node->annotation_count);
+ for (unsigned int i = 0;
+      i < node->annotation_count;
+      ++i)
+ {
+  result = _lcddl_hash_combine(result, node->annotations[i]->hash);
+ }
+ 
+ result = _lcddl_hash_combine(result, node->child_count);
+ for (unsigned int i = 0;
+      i < node->child_count;
+      ++i)
+ {
+  result = _lcddl_hash_combine(result, node->children[i]->hash);
+ }
+ 
+#undef hash_string
+#undef hash_child
+ 
+ return result;
+}
+
+// NOTE(tbt): when interning is enabled, types and expressions are hash-consed - each node is looked up by its
+//            hash once it is complete, and if a structurally equal node already exists that one is used instead.
+//            operands are interned before the nodes which use them, so comparing them by pointer is enough.
+//            interned nodes are shared, so count how many parents refer to them and are freed along with the last
+typedef struct
+{
+ bool is_enabled;
+ LcddlNode **nodes; // open addressed by hash
+ unsigned int count;
+ unsigned int capacity;
+} _LcddlInternTable;
+
+static _LcddlInternTable _lcddl_intern_table;
+
+static bool
+_lcddl_can_node_be_interned(LcddlNode *node)
+{
+ switch (node->kind)
+ {
+  case LCDDL_NODE_KIND_type:
+  case LCDDL_NODE_KIND_binary_operator:
+  case LCDDL_NODE_KIND_unary_operator:
+  case LCDDL_NODE_KIND_string_literal:
+  case LCDDL_NODE_KIND_float_literal:
+  case LCDDL_NODE_KIND_integer_literal:
+  case LCDDL_NODE_KIND_variable_reference:
+  {
+   return true;
+  }
+  default:
+  {
+   return false;
+  }
+ }
+}
+
+static bool
+_lcddl_are_interned_nodes_equal(LcddlNode *a,
+                                LcddlNode *b)
+{
+ if (a->kind != b->kind ||
+     a->hash != b->hash)
+ {
+  return false;
+ }
+ 
+ switch (a->kind)
+ {
+  case LCDDL_NODE_KIND_type:
+  {
+   return (0 == strcmp(a->type.type_name, b->type.type_name) &&
+           a->type.array_count == b->type.array_count &&
+           a->type.indirection_level == b->type.indirection_level);
+  }
+  case LCDDL_NODE_KIND_binary_operator:
+  {
+   return (a->binary_operator.kind == b->binary_operator.kind &&
+           a->binary_operator.left == b->binary_operator.left &&
+           a->binary_operator.right == b->binary_operator.right);
+  }
+  case LCDDL_NODE_KIND_unary_operator:
+  {
+   return (a->unary_operator.kind == b->unary_operator.kind &&
+           a->unary_operator.operand == b->unary_operator.operand);
+  }
+  case LCDDL_NODE_KIND_string_literal:
+  case LCDDL_NODE_KIND_float_literal:
+  case LCDDL_NODE_KIND_integer_literal:
+  {
+   return (0 == strcmp(a->literal.value, b->literal.value));
+  }
+  case LCDDL_NODE_KIND_variable_reference:
+  {
+   return (0 == strcmp(a->var_reference.name, b->var_reference.name));
+  }
+  default:
+  {
+   return false;
+  }
+ }
+}
+
+static void
+_lcddl_insert_interned_node(LcddlNode *node)
+{
+ unsigned int mask = _lcddl_intern_table.capacity - 1;
+ unsigned int slot = node->hash & mask;
+ while (_lcddl_intern_table.nodes[slot])
+ {
+  slot = (slot + 1) & mask;
+ }
+ _lcddl_intern_table.nodes[slot] = node;
+}
+
+static void _lcddl_free_tree(LcddlNode *root);
+
+// NOTE(tbt): returns `node`, or the existing node equal to it in which case `node` is freed
+static LcddlNode *
+_lcddl_intern_node(LcddlNode *node)
+{
+ if (!_lcddl_intern_table.is_enabled ||
+     !_lcddl_can_node_be_interned(node))
+ {
+  return node;
+ }
+ 
+ if (_lcddl_intern_table.nodes)
+ {
+  unsigned int mask = _lcddl_intern_table.capacity - 1;
+  for (unsigned int slot = node->hash & mask;
+       NULL != _lcddl_intern_table.nodes[slot];
+       slot = (slot + 1) & mask)
+  {
+   LcddlNode *existing = _lcddl_intern_table.nodes[slot];
+   if (_lcddl_are_interned_nodes_equal(existing, node))
+   {
+    existing->reference_count            += 1;
+    _lcddl_stats.deduplicated_node_count += 1;
+    _lcddl_free_tree(node);
+    return existing;
+   }
+  }
+ }
+ 
+ // NOTE(tbt): keep the table at most three quarters full
+ if ((_lcddl_intern_table.count + 1) * 4 > _lcddl_intern_table.capacity * 3)
+ {
+  LcddlNode **old_nodes        = _lcddl_intern_table.nodes;
+  unsigned int old_capacity    = _lcddl_intern_table.capacity;
+  _lcddl_intern_table.capacity = old_capacity ? old_capacity * 2 : 1024;
+  _lcddl_intern_table.nodes    = calloc(_lcddl_intern_table.capacity, sizeof(*_lcddl_intern_table.nodes));
+  for (unsigned int i = 0;
+       i < old_capacity;
+       ++i)
+  {
+   if (old_nodes[i])
+   {
+    _lcddl_insert_interned_node(old_nodes[i]);
+   }
+  }
+  free(old_nodes);
+ }
+ 
+ node->reference_count = 1;
+ _lcddl_insert_interned_node(node);
+ _lcddl_intern_table.count += 1;
+ 
+ return node;
+}
+
+// NOTE(tbt): called once the last reference to an interned node has gone
+static void
+_lcddl_remove_interned_node(LcddlNode *node)
+{
+ unsigned int mask = _lcddl_intern_table.capacity - 1;
+ unsigned int hole = node->hash & mask;
+ while (_lcddl_intern_table.nodes[hole] != node)
+ {
+  hole = (hole + 1) & mask;
+ }
+ 
+ // NOTE(tbt): shift back any later nodes in the same run which would no longer be found past the hole
+ for (unsigned int slot = (hole + 1) & mask;
+      NULL != _lcddl_intern_table.nodes[slot];
+      slot = (slot + 1) & mask)
+ {
+  unsigned int home = _lcddl_intern_table.nodes[slot]->hash & mask;
+  if (((slot - home) & mask) >= ((slot - hole) & mask))
+  {
+   _lcddl_intern_table.nodes[hole] = _lcddl_intern_table.nodes[slot];
+   hole                            = slot;
+  }
+ }
+ _lcddl_intern_table.nodes[hole] = NULL;
+ _lcddl_intern_table.count      -= 1;
+}
+
+// NOTE(tbt): the stream must still be freed afterwards with `_lcddl_free_stream`
+static LcddlNode *
+_lcddl_parse_stream(_LcddlStream *stream)
+{
+ _lcddl_trace_begin("parse", stream->path);
+ unsigned long long start_time        = _lcddl_stats.is_enabled ? _lcddl_get_time() : 0;
+ unsigned long long start_token_count = _lcddl_stats.token_count;
+ 
+ LcddlNode *result = _lcddl_allocate_node(LCDDL_NODE_KIND_file);
+ if (_lcddl_check_allocation(stream, result))
+ {
+  result->file.filename = _lcddl_copy_string(stream->path, strlen(stream->path));
+  if (_lcddl_check_allocation(stream, result->file.filename))
+  {
+   _lcddl_parse_statement_list(stream, result, true);
+   result->hash = _lcddl_hash_node(result);
+  }
+ }
+ 
+ if (_lcddl_stats.is_enabled)
+ {
+  // NOTE(tbt): tokens are lexed on demand, so lexing time is part of parse time.
+  //            the first token was lexed when the stream was loaded
+  _LcddlFileStats *file_stats = _lcddl_get_file_stats(stream->path);
+  file_stats->parse_time      = _lcddl_get_time() - start_time;
+  file_stats->token_count     = _lcddl_stats.token_count - start_token_count + 1;
+  file_stats->node_count      = _lcddl_count_nodes(result);
+ }
+ _lcddl_trace_end("parse", stream->path);
+ 
+ // NOTE(tbt): the whole file is still parsed after an error, to find any others, but the tree is not used
+ if (stream->error_count)
+ {
+  _lcddl_free_tree(result);
+  result = NULL;
+ }
+ else
+ {
+  result->file.source = _lcddl_take_source(stream);
+  if (!_lcddl_check_allocation(stream, result->file.source))
+  {
+   _lcddl_free_tree(result);
+   result = NULL;
+  }
+ }
+ 
+ return result;
+}
+
+// NOTE(tbt): skips to just after the next ';', or to the '}' closing the current block, whichever comes first
+static void
+_lcddl_synchronise(_LcddlStream *stream)
+{
+ unsigned int depth = 0;
+ while (stream->current_token.kind != TOKEN_KIND_eof)
+ {
+  _LcddlTokenKind kind = stream->current_token.kind;
+  if (kind == TOKEN_KIND_close_curly_bracket)
+  {
+   if (depth == 0)
+   {
+    break;
+   }
+   depth -= 1;
+  }
+  else if (kind == TOKEN_KIND_open_curly_bracket)
+  {
+   depth += 1;
+  }
+  
+  stream->current_token = _lcddl_get_next_token(stream);
+  
+  if (kind == TOKEN_KIND_semicolon &&
+      depth == 0)
+  {
+   break;
+  }
+ }
+ stream->is_panicking = false;
+}
+
+// NOTE(tbt): for lists which were never attached to a node, so are not freed along with one
+static void
+_lcddl_free_node_list(LcddlNode *first)
+{
+ while (first)
+ {
+  LcddlNode *next = first->next_sibling;
+  _lcddl_free_tree(first);
+  first = next;
+ }
+}
+
+// NOTE(tbt): returns NULL if there was no declaration after the annotations
+static LcddlNode *
+_lcddl_parse_statement(_LcddlStream *stream)
+{
+ LcddlNode *result      = NULL;
+ LcddlNode *annotations = _lcddl_parse_annotations(stream);
+ 
+ if (stream->current_token.kind == TOKEN_KIND_identifier)
+ {
+  result = _lcddl_parse_declaration(stream);
+  if (!stream->is_panicking)
+  {
+   _lcddl_consume_token(stream, TOKEN_KIND_semicolon);
+  }
+ }
+ else
+ {
+  _lcddl_report_parser_error(stream,
+                             "Expected a declaration after annotations, got '%s'",
+                             token_kind_to_string(stream->current_token.kind));
+ }
+ 
+ // NOTE(tbt): without a declaration nothing has been consumed past the annotations, so the statement list
+ //            skips to the next statement instead
+ if (stream->is_panicking &&
+     result)
+ {
+  _lcddl_synchronise(stream);
+ }
+ 
+ if (result)
+ {
+  result->annotations = _lcddl_make_node_array(annotations, &result->annotation_count);
+  if (annotations &&
+      !_lcddl_check_allocation(stream, result->annotations))
+  {
+   _lcddl_free_node_list(annotations);
+   annotations = NULL;
+  }
+  result->first_annotation = annotations;
+  result->hash             = _lcddl_hash_node(result);
+ }
+ else
+ {
+  _lcddl_free_node_list(annotations);
+ }
+ 
+ return result;
+}
+
+static void
+_lcddl_parse_statement_list(_LcddlStream *stream,
+                            LcddlNode *parent,
+                            bool is_top_level) // otherwise the list is ended by a '}'
+{
+ LcddlNode **next = &parent->first_child;
+ 
+ while (stream->current_token.kind != TOKEN_KIND_eof &&
+        (is_top_level || stream->current_token.kind != TOKEN_KIND_close_curly_bracket))
+ {
+  if (stream->current_token.kind == TOKEN_KIND_identifier ||
+      stream->current_token.kind == TOKEN_KIND_at_symbol)
+  {
+   LcddlNode *statement = _lcddl_parse_statement(stream);
+   if (statement)
+   {
+    *next = statement;
+    next  = &statement->next_sibling;
+   }
+  }
+  else
+  {
+   // NOTE(tbt): skip everything up to the start of the next statement, reporting it as a single error
+   _lcddl_report_parser_error(stream,
+                              "Expected a statement, got '%s'",
+                              token_kind_to_string(stream->current_token.kind));
+   do
+   {
+    stream->current_token = _lcddl_get_next_token(stream);
+   } while (stream->current_token.kind != TOKEN_KIND_eof        &&
+            stream->current_token.kind != TOKEN_KIND_identifier &&
+            stream->current_token.kind != TOKEN_KIND_at_symbol  &&
+            (is_top_level || stream->current_token.kind != TOKEN_KIND_close_curly_bracket));
+   stream->is_panicking = false;
+  }
+ }
+ 
+ parent->children = _lcddl_make_node_array(parent->first_child, &parent->child_count);
+ if (parent->first_child &&
+     !_lcddl_check_allocation(stream, parent->children))
+ {
+  _lcddl_free_node_list(parent->first_child);
+  parent->first_child = NULL;
+ }
+}
+
+static LcddlNode *
+_lcddl_parse_annotations(_LcddlStream *stream)
+{
+ LcddlNode *result = NULL;
+ LcddlNode **next  = &result;
+ 
+ while (stream->current_token.kind == TOKEN_KIND_at_symbol)
+ {
+  LcddlNode *annotation = _lcddl_allocate_node(LCDDL_NODE_KIND_annotation);
+  if (!_lcddl_check_allocation(stream, annotation))
+  {
+   break;
+  }
+  annotation->offset         = stream->current_token.offset;
+  _lcddl_consume_token(stream, TOKEN_KIND_at_symbol);
+  annotation->annotation.tag = _lcddl_copy_string(stream->current_token.value, stream->current_token.len);
+  if (!_lcddl_check_allocation(stream, annotation->annotation.tag))
+  {
+   _lcddl_free_tree(annotation);
+   break;
+  }
+  _lcddl_consume_token(stream, TOKEN_KIND_identifier);
+  
+  if (stream->current_token.kind == TOKEN_KIND_equals)
+  {
+   _lcddl_consume_token(stream, TOKEN_KIND_equals);
+   annotation->annotation.value = _lcddl_parse_expression(stream);
+  }
+  annotation->hash = _lcddl_hash_node(annotation);
+  
+  *next = annotation;
+  next  = &annotation->next_annotation;
+ }
+ 
+ return result;
+}
+
+static LcddlNode *
+_lcddl_parse_declaration(_LcddlStream *stream)
+{
+ LcddlNode *result = _lcddl_allocate_node(LCDDL_NODE_KIND_declaration);
+ if (!_lcddl_check_allocation(stream, result))
+ {
+  return NULL;
+ }
+ result->offset           = stream->current_token.offset;
+ result->declaration.name = _lcddl_copy_string(stream->current_token.value, stream->current_token.len);
+ if (!_lcddl_check_allocation(stream, result->declaration.name))
+ {
+  _lcddl_free_tree(result);
+  return NULL;
+ }
+ 
+ _lcddl_consume_token(stream, TOKEN_KIND_identifier);
+ 
+ if (stream->current_token.kind != TOKEN_KIND_semicolon)
+ {
+  if (stream->current_token.kind == TOKEN_KIND_colon)
+  {
+   _lcddl_consume_token(stream, TOKEN_KIND_colon);
+   
+   if (stream->current_token.kind == TOKEN_KIND_equals)
+    // NOTE(tbt): type has been ommited - go straight to value;
+   {
+    _lcddl_consume_token(stream, TOKEN_KIND_equals);
+    result->declaration.value = _lcddl_parse_expression(stream);
+   }
+   else
+   {
+    result->declaration.type = _lcddl_parse_type(stream);
+    if (stream->current_token.kind == TOKEN_KIND_equals)
+    {
+     _lcddl_consume_token(stream, TOKEN_KIND_equals);
+     result->declaration.value = _lcddl_parse_expression(stream);
+    }
+   }
+  }
+  
+  // NOTE(tbt): if there is neither a block nor a ';', the caller reports the missing ';'
+  if (!stream->is_panicking &&
+      stream->current_token.kind == TOKEN_KIND_open_curly_bracket)
+  {
+   _lcddl_consume_token(stream, TOKEN_KIND_open_curly_bracket);
+   _lcddl_parse_statement_list(stream, result, false);
+   _lcddl_consume_token(stream, TOKEN_KIND_close_curly_bracket);
+  }
+ }
+ 
+ return result;
+}
+
+static LcddlNode *
+_lcddl_parse_type(_LcddlStream *stream)
+{
+ LcddlNode *result = _lcddl_allocate_node(LCDDL_NODE_KIND_type);
+ if (!_lcddl_check_allocation(stream, result))
+ {
+  return NULL;
+ }
+ result->offset = stream->current_token.offset;
+ 
+ if (stream->current_token.kind == TOKEN_KIND_open_square_bracket)
+ {
+  _lcddl_consume_token(stream, TOKEN_KIND_open_square_bracket);
+  char *array_count_str = _lcddl_copy_string(stream->current_token.value, stream->current_token.len);
+  if (!_lcddl_check_allocation(stream, array_count_str))
+  {
+   _lcddl_free_tree(result);
+   return NULL;
+  }
+  _lcddl_consume_token(stream, TOKEN_KIND_integer_literal);
+  
+  result->type.array_count = strtoul(array_count_str, NULL, 10);
+  _lcddl_free_string(array_count_str);
+  
+  _lcddl_consume_token(stream, TOKEN_KIND_close_square_bracket);
+ }
+ 
+ result->type.type_name = _lcddl_copy_string(stream->current_token.value, stream->current_token.len);
+ if (!_lcddl_check_allocation(stream, result->type.type_name))
+ {
+  _lcddl_free_tree(result);
+  return NULL;
+ }
+ _lcddl_consume_token(stream, TOKEN_KIND_identifier);
+ 
+ while (stream->current_token.kind == TOKEN_KIND_asterisk)
+ {
+  _lcddl_consume_token(stream, TOKEN_KIND_asterisk);
+  result->type.indirection_level += 1; }
+ 
+ result->hash = _lcddl_hash_node(result);
+ return _lcddl_intern_node(result);
+}
+
+static LcddlNode *
+_lcddl_parse_binary_operator_rhs(_LcddlStream *stream,
+                                 unsigned int expression_precedence,
+                                 LcddlNode *lhs)
+{
+ static unsigned int precedence_table[1 << 8] = 
+ {
+  [LCDDL_BIN_OP_KIND_multiply]                 = 10,
+  [LCDDL_BIN_OP_KIND_divide]                   = 10,
+  [LCDDL_BIN_OP_KIND_add]                      = 9,
+  [LCDDL_BIN_OP_KIND_subtract]                 = 9,
+  [LCDDL_BIN_OP_KIND_bit_shift_left]           = 8,
+  [LCDDL_BIN_OP_KIND_bit_shift_right]          = 8,
+  [LCDDL_BIN_OP_KIND_lesser_than]              = 7,
+  [LCDDL_BIN_OP_KIND_lesser_than_or_equal_to]  = 7,
+  [LCDDL_BIN_OP_KIND_greater_than]             = 7,
+  [LCDDL_BIN_OP_KIND_greater_than_or_equal_to] = 7,
+  [LCDDL_BIN_OP_KIND_equality]                 = 6,
+  [LCDDL_BIN_OP_KIND_not_equal_to]             = 6,
+  [LCDDL_BIN_OP_KIND_bitwise_and]              = 5,
+  [LCDDL_BIN_OP_KIND_bitwise_xor]              = 4,
+  [LCDDL_BIN_OP_KIND_bitwise_or]               = 3,
+  [LCDDL_BIN_OP_KIND_boolean_and]              = 2,
+  [LCDDL_BIN_OP_KIND_boolean_or]               = 1,
+ };
+ 
+ for (;;)
+ {
+  LcddlOperatorKind operator_kind;
+  unsigned int token_precedence;
+  
+  if (stream->is_panicking)
+  {
+   return lhs;
+  }
+  else if (_lcddl_is_token_usable_as_binary_operator(stream->current_token))
+  {
+   operator_kind    = _lcddl_token_to_operator_kind(stream->current_token, false);
+   token_precedence = precedence_table[operator_kind];
+   
+   if (token_precedence < expression_precedence)
+   {
+    return lhs;
+   }
+  }
+  else
+  {
+   return lhs;
+  }
+  
+  unsigned int operator_offset = stream->current_token.offset;
+  _lcddl_consume_token(stream, stream->current_token.kind);
+  
+  LcddlNode *rhs = _lcddl_parse_primary(stream);
+  
+  if (_lcddl_is_token_usable_as_binary_operator(stream->current_token))
+  {
+   unsigned int next_precedence = precedence_table[_lcddl_token_to_operator_kind(stream->current_token, false)];
+   if (token_precedence < next_precedence)
+   {
+    rhs = _lcddl_parse_binary_operator_rhs(stream, token_precedence + 1, rhs);
+   }
+  }
+  
+  LcddlNode *new_left = _lcddl_allocate_node(LCDDL_NODE_KIND_binary_operator);
+  if (!_lcddl_check_allocation(stream, new_left))
+  {
+   _lcddl_free_tree(lhs);
+   _lcddl_free_tree(rhs);
+   return NULL;
+  }
+  new_left->offset                = operator_offset;
+  new_left->binary_operator.kind  = operator_kind;
+  new_left->binary_operator.left  = lhs;
+  new_left->binary_operator.right = rhs;
+  new_left->hash                  = _lcddl_hash_node(new_left);
+  
+  lhs = _lcddl_intern_node(new_left);
+ }
+}
+
+static LcddlNode *
+_lcddl_parse_expression(_LcddlStream *stream)
+{
+ LcddlNode *lhs = _lcddl_parse_primary(stream);
+ return _lcddl_parse_binary_operator_rhs(stream, 0, lhs);
+}
+
+static LcddlNode *
+_lcddl_parse_parenthesis(_LcddlStream *stream)
+{
+ _lcddl_consume_token(stream, TOKEN_KIND_open_bracket);  // eat '('
+ LcddlNode *result = _lcddl_parse_expression(stream);
+ _lcddl_consume_token(stream, TOKEN_KIND_close_bracket); // eat ')'
+ 
+ return result;
+}
+
+static LcddlNode *
+_lcddl_parse_primary(_LcddlStream *stream)
+{
+ switch (stream->current_token.kind)
+ {
+  case TOKEN_KIND_add:         // unary plus operator
+  case TOKEN_KIND_dash:        // unary negative operator
+  case TOKEN_KIND_tilde:       // bitwise not operator
+  case TOKEN_KIND_exclamation: // boolean not operator
+  {
+   return _lcddl_parse_unary_operator(stream);
+  }
+  case TOKEN_KIND_float_literal:
+  case TOKEN_KIND_integer_literal:
+  case TOKEN_KIND_string_literal:
+  {
+   return _lcddl_parse_literal(stream);
+  }
+  case TOKEN_KIND_identifier:
+  {
+   return _lcddl_parse_variable_reference(stream);
+  }
+  case TOKEN_KIND_open_bracket:
+  {
+   return _lcddl_parse_parenthesis(stream);
+  }
+  default:
+  {
+   _lcddl_report_parser_error(stream,
+                              "Got unexpected token '%s' when expecting an expression",
+                              token_kind_to_string(stream->current_token.kind));
+   return NULL;
+  }
+ }
+}
+
+static LcddlNode *
+_lcddl_parse_unary_operator(_LcddlStream *stream)
+{
+ LcddlNode *result = _lcddl_allocate_node(LCDDL_NODE_KIND_unary_operator);
+ if (!_lcddl_check_allocation(stream, result))
+ {
+  return NULL;
+ }
+ result->offset = stream->current_token.offset;
+ 
+ if (_lcddl_is_token_usable_as_unary_operator(stream->current_token))
+ {
+  result->unary_operator.kind = _lcddl_token_to_operator_kind(stream->current_token, true);
+  _lcddl_consume_token(stream, stream->current_token.kind);
+ }
+ else
+ {
+  _lcddl_report_parser_error(stream,
+                             "expected a unary operator, instead got '%s'",
+                             token_kind_to_string(stream->current_token.kind));
+ }
+ result->unary_operator.operand = _lcddl_parse_expression(stream);
+ result->hash                   = _lcddl_hash_node(result);
+ 
+ return _lcddl_intern_node(result);
+}
+
+static LcddlNode *
+_lcddl_parse_literal(_LcddlStream *stream)
+{
+ LcddlNodeKind kind;
+ switch (stream->current_token.kind)
+ {
+  case TOKEN_KIND_string_literal:
+  {
+   kind = LCDDL_NODE_KIND_string_literal;
+   break;
+  }
+  case TOKEN_KIND_integer_literal:
+  {
+   kind = LCDDL_NODE_KIND_integer_literal;
+   break;
+  }
+  case TOKEN_KIND_float_literal:
+  {
+   kind = LCDDL_NODE_KIND_float_literal;
+   break;
+  }
+  default:
+  {
+   _lcddl_report_parser_error(stream,
+                              "Expecting a literal, got '%s'",
+                              token_kind_to_string(stream->current_token.kind));
+   return NULL;
+  }
+ }
+ 
+ LcddlNode *result = _lcddl_allocate_node(kind);
+ if (!_lcddl_check_allocation(stream, result))
+ {
+  return NULL;
+ }
+ result->offset        = stream->current_token.offset;
+ result->literal.value = _lcddl_copy_string(stream->current_token.value, stream->current_token.len);
+ if (!_lcddl_check_allocation(stream, result->literal.value))
+ {
+  _lcddl_free_tree(result);
+  return NULL;
+ }
+ _lcddl_consume_token(stream, stream->current_token.kind);
+ 
+ result->hash = _lcddl_hash_node(result);
+ 
+ return _lcddl_intern_node(result);
+}
+
+static LcddlNode *
+_lcddl_parse_variable_reference(_LcddlStream *stream)
+{
+ LcddlNode *result = _lcddl_allocate_node(LCDDL_NODE_KIND_variable_reference);
+ if (!_lcddl_check_allocation(stream, result))
+ {
+  return NULL;
+ }
+ result->offset             = stream->current_token.offset;
+ result->var_reference.name = _lcddl_copy_string(stream->current_token.value, stream->current_token.len);
+ if (!_lcddl_check_allocation(stream, result->var_reference.name))
+ {
+  _lcddl_free_tree(result);
+  return NULL;
+ }
+ 
+ _lcddl_consume_token(stream, TOKEN_KIND_identifier);
+ result->hash = _lcddl_hash_node(result);
+ 
+ return _lcddl_intern_node(result);
+}
+
+///////////////////////////////////////////
+// BINARY FORMAT
+//~
+
+// NOTE(tbt): a parsed tree flattened into an array of fixed size node records followed by a table of
+//            NUL terminated strings. all links are 32 bit indices into the node array, and all strings are
+//            32 bit offsets into the string table, so the image is position independent.
+//            nodes are stored in pre-order, so every link points forwards - this is checked when loading
+
+#define LCDDL_BINARY_MAGIC          0x4244434c // 'LCDB'
+#define LCDDL_BINARY_FORMAT_VERSION 3 // NOTE(tbt): version 1 images stored lists in reverse source order, version 2 had no offsets
+#define LCDDL_BINARY_NULL           0xffffffff
+
+typedef struct
+{
+ unsigned int magic;
+ unsigned int format_version;
+ unsigned int node_count;
+ unsigned int strings_size;
+ unsigned int root;
+ unsigned int reserved;
+} _LcddlBinaryHeader;
+
+typedef struct
+{
+ unsigned int kind;
+ unsigned int first_child;
+ unsigned int first_annotation;
+ unsigned int next_sibling;
+ unsigned int offset;
+ 
+ // NOTE(tbt): meaning depends on `kind`:
+ //            file               - filename string
+ //            declaration        - name string, type node, value node
+ //            type               - type name string, array count, indirection level
+ //            binary operator    - operator kind, left node, right node
+ //            unary operator     - operator kind, operand node
+ //            literal            - value string
+ //            variable reference - name string
+ //            annotation         - tag string, value node
+ unsigned int fields[3];
+} _LcddlBinaryNode;
+
+typedef struct
+{
+ _LcddlBinaryNode *nodes;
+ unsigned int node_count;
+ unsigned int node_capacity;
+ 
+ char *strings;
+ unsigned int strings_size;
+ unsigned int strings_capacity;
+ 
+ // NOTE(tbt): open addressing hash table of string offsets + 1, so that each distinct string is stored once
+ unsigned int *string_table;
+ unsigned int string_table_capacity;
+ unsigned int string_count;
+} _LcddlBinaryBuilder;
+
+static unsigned int
+_lcddl_binary_intern_string(_LcddlBinaryBuilder *builder,
+                            char *string)
+{
+ if (2 * (builder->string_count + 1) > builder->string_table_capacity)
+ {
+  unsigned int old_capacity = builder->string_table_capacity;
+  unsigned int *old_table   = builder->string_table;
+  
+  builder->string_table_capacity = old_capacity ? old_capacity * 2 : 256;
+  builder->string_table          = calloc(builder->string_table_capacity, sizeof(*builder->string_table));
+  
+  for (unsigned int i = 0;
+       i < old_capacity;
+       ++i)
+  {
+   if (old_table[i])
+   {
+    char *existing = &builder->strings[old_table[i] - 1];
+    unsigned int slot = _lcddl_hash_bytes(existing, strlen(existing)) & (builder->string_table_capacity - 1);
+    while (builder->string_table[slot])
+    {
+     slot = (slot + 1) & (builder->string_table_capacity - 1);
+    }
+    builder->string_table[slot] = old_table[i];
+   }
+  }
+  
+  free(old_table);
+ }
+ 
+ unsigned int length = strlen(string);
+ unsigned int slot   = _lcddl_hash_bytes(string, length) & (builder->string_table_capacity - 1);
+ while (builder->string_table[slot])
+ {
+  if (0 == strcmp(&builder->strings[builder->string_table[slot] - 1], string))
+  {
+   return builder->string_table[slot] - 1;
+  }
+  slot = (slot + 1) & (builder->string_table_capacity - 1);
+ }
+ 
+ while (builder->strings_size + length + 1 > builder->strings_capacity)
+ {
+  builder->strings_capacity = builder->strings_capacity ? builder->strings_capacity * 2 : 4096;
+  builder->strings          = realloc(builder->strings, builder->strings_capacity);
+ }
+ 
+ unsigned int result = builder->strings_size;
+ memcpy(&builder->strings[result], string, length + 1);
+ builder->strings_size      += length + 1;
+ builder->string_table[slot] = result + 1;
+ builder->string_count      += 1;
+ 
+ return result;
+}
+
+static unsigned int
+_lcddl_binary_push_node(_LcddlBinaryBuilder *builder,
+                        LcddlNode *node)
+{
+ if (!node)
+ {
+  return LCDDL_BINARY_NULL;
+ }
+ 
+ if (builder->node_count == builder->node_capacity)
+ {
+  builder->node_capacity = builder->node_capacity ? builder->node_capacity * 2 : 256;
+  builder->nodes         = realloc(builder->nodes, builder->node_capacity * sizeof(*builder->nodes));
+ }
+ 
+ unsigned int result = builder->node_count++;
+ _LcddlBinaryNode record = {0};
+ record.kind             = node->kind;
+ record.first_child      = LCDDL_BINARY_NULL;
+ record.first_annotation = LCDDL_BINARY_NULL;
+ record.next_sibling     = LCDDL_BINARY_NULL;
+ record.offset           = node->offset;
+ record.fields[0]        = LCDDL_BINARY_NULL;
+ record.fields[1]        = LCDDL_BINARY_NULL;
+ record.fields[2]        = LCDDL_BINARY_NULL;
+ 
+ // NOTE(tbt): links are filled in after pushing the linked nodes, because pushing may move `builder->nodes`
+ switch (node->kind)
+ {
+  case LCDDL_NODE_KIND_root:
+  {
+   break;
+  }
+  case LCDDL_NODE_KIND_file:
+  {
+   record.fields[0] = _lcddl_binary_intern_string(builder, node->file.filename);
+   break;
+  }
+  case LCDDL_NODE_KIND_declaration:
+  {
+   record.fields[0] = _lcddl_binary_intern_string(builder, node->declaration.name);
+   break;
+  }
+  case LCDDL_NODE_KIND_type:
+  {
+   record.fields[0] = _lcddl_binary_intern_string(builder, node->type.type_name);
+   record.fields[1] = node->type.array_count;
+   record.fields[2] = node->type.indirection_level;
+   break;
+  }
+  case LCDDL_NODE_KIND_binary_operator:
+  {
+   record.fields[0] = node->binary_operator.kind;
+   break;
+  }
+  case LCDDL_NODE_KIND_unary_operator:
+  {
+   record.fields[0] = node->unary_operator.kind;
+   break;
+  }
+  case LCDDL_NODE_KIND_string_literal:
+  case LCDDL_NODE_KIND_float_literal:
+  case LCDDL_NODE_KIND_integer_literal:
+  {
+   record.fields[0] = _lcddl_binary_intern_string(builder, node->literal.value);
+   break;
+  }
+  case LCDDL_NODE_KIND_variable_reference:
+  {
+   record.fields[0] = _lcddl_binary_intern_string(builder, node->var_reference.name);
+   break;
+  }
+  case LCDDL_NODE_KIND_annotation:
+  {
+   record.fields[0] = _lcddl_binary_intern_string(builder, node->annotation.tag);
+   break;
+  }
+ }
+ builder->nodes[result] = record;
+ 
+ switch (node->kind)
+ {
+  case LCDDL_NODE_KIND_declaration:
+  {
+   unsigned int type  = _lcddl_binary_push_node(builder, node->declaration.type);
+   unsigned int value = _lcddl_binary_push_node(builder, node->declaration.value);
+   builder->nodes[result].fields[1] = type;
+   builder->nodes[result].fields[2] = value;
+   break;
+  }
+  case LCDDL_NODE_KIND_binary_operator:
+  {
+   unsigned int left  = _lcddl_binary_push_node(builder, node->binary_operator.left);
+   unsigned int right = _lcddl_binary_push_node(builder, node->binary_operator.right);
+   builder->nodes[result].fields[1] = left;
+   builder->nodes[result].fields[2] = right;
+   break;
+  }
+  case LCDDL_NODE_KIND_unary_operator:
+  {
+   unsigned int operand = _lcddl_binary_push_node(builder, node->unary_operator.operand);
+   builder->nodes[result].fields[1] = operand;
+   break;
+  }
+  case LCDDL_NODE_KIND_annotation:
+  {
+   unsigned int value = _lcddl_binary_push_node(builder, node->annotation.value);
+   builder->nodes[result].fields[1] = value;
+   break;
+  }
+  default:
+  {
+   break;
+  }
+ }
+ 
+ unsigned int previous = LCDDL_BINARY_NULL;
+ for (unsigned int i = 0;
+      i < node->annotation_count;
+      ++i)
+ {
+  unsigned int index = _lcddl_binary_push_node(builder, node->annotations[i]);
+  if (previous == LCDDL_BINARY_NULL) { builder->nodes[result].first_annotation = index; }
+  else                               { builder->nodes[previous].next_sibling   = index; }
+  previous = index;
+ }
+ 
+ previous = LCDDL_BINARY_NULL;
+ for (unsigned int i = 0;
+      i < node->child_count;
+      ++i)
+ {
+  unsigned int index = _lcddl_binary_push_node(builder, node->children[i]);
+  if (previous == LCDDL_BINARY_NULL) { builder->nodes[result].first_child  = index; }
+  else                               { builder->nodes[previous].next_sibling = index; }
+  previous = index;
+ }
+ 
+ return result;
+}
+
+static void
+_lcddl_serialise_tree(LcddlNode *root,
+                      LcddlWriter *writer)
+{
+ _LcddlBinaryBuilder builder = {0};
+ unsigned int root_index     = _lcddl_binary_push_node(&builder, root);
+ 
+ _LcddlBinaryHeader header = {0};
+ header.magic              = LCDDL_BINARY_MAGIC;
+ header.format_version     = LCDDL_BINARY_FORMAT_VERSION;
+ header.node_count         = builder.node_count;
+ header.strings_size       = builder.strings_size;
+ header.root               = root_index;
+ 
+ lcddl_writer_write(writer, (char *)&header, sizeof(header));
+ lcddl_writer_write(writer, (char *)builder.nodes, builder.node_count * sizeof(*builder.nodes));
+ lcddl_writer_write(writer, builder.strings, builder.strings_size);
+ 
+ free(builder.nodes);
+ free(builder.strings);
+ free(builder.string_table);
+}
+
+// NOTE(tbt): checks that an image is well formed so that it can be walked without any further bounds checks
+static bool
+_lcddl_validate_binary(char *buffer,
+                       unsigned long long size)
+{
+ if (size < sizeof(_LcddlBinaryHeader))
+ {
+  return false;
+ }
+ 
+ _LcddlBinaryHeader *header = (_LcddlBinaryHeader *)buffer;
+ if (header->magic != LCDDL_BINARY_MAGIC                   ||
+     header->format_version != LCDDL_BINARY_FORMAT_VERSION ||
+     size != (sizeof(*header) +
+              (unsigned long long)header->node_count * sizeof(_LcddlBinaryNode) +
+              header->strings_size)                         ||
+     header->node_count == 0                                ||
+     header->root != 0                                      ||
+     header->strings_size == 0)
+ {
+  return false;
+ }
+ 
+ _LcddlBinaryNode *nodes = (_LcddlBinaryNode *)(header + 1);
+ char *strings           = (char *)(nodes + header->node_count);
+ 
+ if (strings[header->strings_size - 1] != '\0')
+ {
+  return false;
+ }
+ 
+ // NOTE(tbt): every node apart from the root must be linked to exactly once
+ bool *is_linked = calloc(header->node_count, sizeof(*is_linked));
+ 
+#define is_link_valid(_link)   ((_link) == LCDDL_BINARY_NULL ||                          \
+                                ((_link) > i && (_link) < header->node_count &&          \
+                                 !is_linked[(_link)] && (is_linked[(_link)] = true)))
+#define is_string_valid(_str)  ((_str) < header->strings_size)
+ 
+ for (unsigned int i = 0;
+      i < header->node_count;
+      ++i)
+ {
+  _LcddlBinaryNode *node = &nodes[i];
+  
+  if (!is_link_valid(node->first_child)      ||
+      !is_link_valid(node->first_annotation) ||
+      !is_link_valid(node->next_sibling))
+  {
+   free(is_linked);
+   return false;
+  }
+  
+  bool valid = true;
+  switch (node->kind)
+  {
+   case LCDDL_NODE_KIND_root:               { break; }
+   case LCDDL_NODE_KIND_file:               { valid = is_string_valid(node->fields[0]); break; }
+   case LCDDL_NODE_KIND_declaration:        { valid = is_string_valid(node->fields[0]) && is_link_valid(node->fields[1]) && is_link_valid(node->fields[2]); break; }
+   case LCDDL_NODE_KIND_type:               { valid = is_string_valid(node->fields[0]); break; }
+   case LCDDL_NODE_KIND_binary_operator:    { valid = is_link_valid(node->fields[1]) && is_link_valid(node->fields[2]); break; }
+   case LCDDL_NODE_KIND_unary_operator:     { valid = is_link_valid(node->fields[1]); break; }
+   case LCDDL_NODE_KIND_string_literal:
+   case LCDDL_NODE_KIND_float_literal:
+   case LCDDL_NODE_KIND_integer_literal:    { valid = is_string_valid(node->fields[0]); break; }
+   case LCDDL_NODE_KIND_variable_reference: { valid = is_string_valid(node->fields[0]); break; }
+   case LCDDL_NODE_KIND_annotation:         { valid = is_string_valid(node->fields[0]) && is_link_valid(node->fields[1]); break; }
+   default:                                 { valid = false; break; }
+  }
+  
+  if (!valid)
+  {
+   free(is_linked);
+   return false;
+  }
+ }
+ 
+#undef is_link_valid
+#undef is_string_valid
+ 
+ free(is_linked);
+ return true;
+}
+
+// NOTE(tbt): images are copied into ordinary trees by the executable's parse caches. the library only ever
+//            uses images in place, see `lcddl_open_binary`. the benchmarks time a cache hit with it too
+#if !defined(LCDDL_AS_LIBRARY) || defined(LCDDL_BENCH)
+
+static char *
+_lcddl_copy_binary_string(char *strings,
+                          unsigned int offset,
+                          bool *is_out_of_memory)
+{
+ char *result = _lcddl_copy_string(&strings[offset], strlen(&strings[offset]));
+ if (!result)
+ {
+  *is_out_of_memory = true;
+ }
+ return result;
+}
+
+// NOTE(tbt): if an allocation fails, `is_out_of_memory` is set and everything allocated for the node so far
+//            is freed, so that partial nodes are never hashed or interned
+static LcddlNode *
+_lcddl_deserialise_node(_LcddlBinaryNode *nodes,
+                        char *strings,
+                        unsigned int index,
+                        bool *is_out_of_memory)
+{
+ if (index == LCDDL_BINARY_NULL ||
+     *is_out_of_memory)
+ {
+  return NULL;
+ }
+ 
+ _LcddlBinaryNode *record = &nodes[index];
+ LcddlNode *result        = _lcddl_allocate_node(record->kind);
+ if (!result)
+ {
+  *is_out_of_memory = true;
+  return NULL;
+ }
+ result->offset = record->offset;
+ 
+ switch (result->kind)
+ {
+  case LCDDL_NODE_KIND_root:
+  {
+   break;
+  }
+  case LCDDL_NODE_KIND_file:
+  {
+   result->file.filename = _lcddl_copy_binary_string(strings, record->fields[0], is_out_of_memory);
+   break;
+  }
+  case LCDDL_NODE_KIND_declaration:
+  {
+   result->declaration.name  = _lcddl_copy_binary_string(strings, record->fields[0], is_out_of_memory);
+   result->declaration.type  = _lcddl_deserialise_node(nodes, strings, record->fields[1], is_out_of_memory);
+   result->declaration.value = _lcddl_deserialise_node(nodes, strings, record->fields[2], is_out_of_memory);
+   break;
+  }
+  case LCDDL_NODE_KIND_type:
+  {
+   result->type.type_name         = _lcddl_copy_binary_string(strings, record->fields[0], is_out_of_memory);
+   result->type.array_count       = record->fields[1];
+   result->type.indirection_level = record->fields[2];
+   break;
+  }
+  case LCDDL_NODE_KIND_binary_operator:
+  {
+   result->binary_operator.kind  = record->fields[0];
+   result->binary_operator.left  = _lcddl_deserialise_node(nodes, strings, record->fields[1], is_out_of_memory);
+   result->binary_operator.right = _lcddl_deserialise_node(nodes, strings, record->fields[2], is_out_of_memory);
+   break;
+  }
+  case LCDDL_NODE_KIND_unary_operator:
+  {
+   result->unary_operator.kind    = record->fields[0];
+   result->unary_operator.operand = _lcddl_deserialise_node(nodes, strings, record->fields[1], is_out_of_memory);
+   break;
+  }
+  case LCDDL_NODE_KIND_string_literal:
+  case LCDDL_NODE_KIND_float_literal:
+  case LCDDL_NODE_KIND_integer_literal:
+  {
+   result->literal.value = _lcddl_copy_binary_string(strings, record->fields[0], is_out_of_memory);
+   break;
+  }
+  case LCDDL_NODE_KIND_variable_reference:
+  {
+   result->var_reference.name = _lcddl_copy_binary_string(strings, record->fields[0], is_out_of_memory);
+   break;
+  }
+  case LCDDL_NODE_KIND_annotation:
+  {
+   result->annotation.tag   = _lcddl_copy_binary_string(strings, record->fields[0], is_out_of_memory);
+   result->annotation.value = _lcddl_deserialise_node(nodes, strings, record->fields[1], is_out_of_memory);
+   break;
+  }
+ }
+ 
+ LcddlNode **annotation = &result->first_annotation;
+ for (unsigned int i = record->first_annotation;
+      i != LCDDL_BINARY_NULL && !*is_out_of_memory;
+      i = nodes[i].next_sibling)
+ {
+  *annotation = _lcddl_deserialise_node(nodes, strings, i, is_out_of_memory);
+  if (*annotation)
+  {
+   annotation = &(*annotation)->next_annotation;
+  }
+ }
+ 
+ LcddlNode **child = &result->first_child;
+ for (unsigned int i = record->first_child;
+      i != LCDDL_BINARY_NULL && !*is_out_of_memory;
+      i = nodes[i].next_sibling)
+ {
+  *child = _lcddl_deserialise_node(nodes, strings, i, is_out_of_memory);
+  if (*child)
+  {
+   child = &(*child)->next_sibling;
+  }
+ }
+ 
+ if (!*is_out_of_memory)
+ {
+  result->annotations = _lcddl_make_node_array(result->first_annotation, &result->annotation_count);
+  result->children    = _lcddl_make_node_array(result->first_child, &result->child_count);
+  if ((result->first_annotation && !result->annotations) ||
+      (result->first_child      && !result->children))
+  {
+   *is_out_of_memory = true;
+  }
+ }
+ 
+ if (*is_out_of_memory)
+ {
+  // NOTE(tbt): the lists may not have been copied into arrays, so are freed from the lists instead
+  _lcddl_free(result->annotations, result->annotation_count * sizeof(*result->annotations));
+  _lcddl_free(result->children, result->child_count * sizeof(*result->children));
+  result->annotations      = NULL;
+  result->annotation_count = 0;
+  result->children         = NULL;
+  result->child_count      = 0;
+  _lcddl_free_node_list(result->first_annotation);
+  _lcddl_free_node_list(result->first_child);
+  _lcddl_free_tree(result);
+  return NULL;
+ }
+ 
+ result->hash = _lcddl_hash_node(result);
+ return _lcddl_intern_node(result);
+}
+
+// NOTE(tbt): returns NULL if `buffer` does not contain a valid image, or if the tree could not be allocated
+static LcddlNode *
+_lcddl_deserialise_tree(char *buffer,
+                        unsigned long long size)
+{
+ LcddlNode *result = NULL;
+ 
+ if (_lcddl_validate_binary(buffer, size))
+ {
+  _LcddlBinaryHeader *header = (_LcddlBinaryHeader *)buffer;
+  _LcddlBinaryNode *nodes    = (_LcddlBinaryNode *)(header + 1);
+  char *strings              = (char *)(nodes + header->node_count);
+  bool is_out_of_memory      = false;
+  result = _lcddl_deserialise_node(nodes, strings, header->root, &is_out_of_memory);
+ }
+ 
+ return result;
+}
+#endif
+
+// NOTE(tbt): images opened with `lcddl_open_binary` are mapped read only and used in place - strings point
+//            straight into the mapping. `LcddlNode`s hold native pointers though, so one linear pass turns
+//            the node records into a single block of `LcddlNode`s, which is then made read only too.
+//            the block begins with this header so that `lcddl_close_binary` can find everything again.
+//            the `children` and `annotations` arrays follow the nodes. every node apart from the root is
+//            in at most one list, so they never need more than one pointer per node
+typedef struct
+{
+ char *image;
+ unsigned long long image_size;
+ unsigned long long block_size;
+ unsigned long long reserved;
+} _LcddlBinaryMapping;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+static char *
+_lcddl_map_file_read_only(char *path,
+                          unsigned long long *size)
+{
+ char *result = NULL;
+ 
+ HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+ if (file != INVALID_HANDLE_VALUE)
+ {
+  LARGE_INTEGER file_size;
+  if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+  {
+   HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+   if (mapping)
+   {
+    result = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    *size  = file_size.QuadPart;
+    CloseHandle(mapping);
+   }
+  }
+  CloseHandle(file);
+ }
+ 
+ return result;
+}
+
+static void
+_lcddl_unmap_file(char *image,
+                  unsigned long long size)
+{
+ UnmapViewOfFile(image);
+}
+
+static void *
+_lcddl_allocate_pages(unsigned long long size)
+{
+ return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+static void
+_lcddl_protect_pages_read_only(void *pages,
+                               unsigned long long size)
+{
+ DWORD old_protection;
+ VirtualProtect(pages, size, PAGE_READONLY, &old_protection);
+}
+
+static void
+_lcddl_free_pages(void *pages,
+                  unsigned long long size)
+{
+ VirtualFree(pages, 0, MEM_RELEASE);
+}
+#else
+static char *
+_lcddl_map_file_read_only(char *path,
+                          unsigned long long *size)
+{
+ char *result = NULL;
+ 
+ int fd = open(path, O_RDONLY);
+ if (fd >= 0)
+ {
+  struct stat file_stat;
+  if (0 == fstat(fd, &file_stat) && file_stat.st_size > 0)
+  {
+   void *image = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (image != MAP_FAILED)
+   {
+    result = image;
+    *size  = file_stat.st_size;
+   }
+  }
+  close(fd);
+ }
+ 
+ return result;
+}
+
+static void
+_lcddl_unmap_file(char *image,
+                  unsigned long long size)
+{
+ munmap(image, size);
+}
+
+static void *
+_lcddl_allocate_pages(unsigned long long size)
+{
+ void *result = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+ return (result == MAP_FAILED) ? NULL : result;
+}
+
+static void
+_lcddl_protect_pages_read_only(void *pages,
+                               unsigned long long size)
+{
+ mprotect(pages, size, PROT_READ);
+}
+
+static void
+_lcddl_free_pages(void *pages,
+                  unsigned long long size)
+{
+ munmap(pages, size);
+}
+#endif
+
+// NOTE(tbt): `image` must already have been validated
+static LcddlNode *
+_lcddl_materialise_binary(char *image,
+                          unsigned long long image_size)
+{
+ _LcddlBinaryHeader *header = (_LcddlBinaryHeader *)image;
+ _LcddlBinaryNode *records  = (_LcddlBinaryNode *)(header + 1);
+ char *strings              = (char *)(records + header->node_count);
+ 
+ unsigned long long block_size = (sizeof(_LcddlBinaryMapping) +
+                                  (unsigned long long)header->node_count * sizeof(LcddlNode) +
+                                  (unsigned long long)header->node_count * sizeof(LcddlNode *));
+ _LcddlBinaryMapping *mapping  = _lcddl_allocate_pages(block_size);
+ if (!mapping)
+ {
+  return NULL;
+ }
+ mapping->image      = image;
+ mapping->image_size = image_size;
+ mapping->block_size = block_size;
+ 
+ LcddlNode *nodes = (LcddlNode *)(mapping + 1);
+ 
+#define link(_index) ((_index) == LCDDL_BINARY_NULL ? NULL : &nodes[(_index)])
+ 
+ for (unsigned int i = 0;
+      i < header->node_count;
+      ++i)
+ {
+  _LcddlBinaryNode *record = &records[i];
+  LcddlNode *node          = &nodes[i];
+  
+  node->kind             = record->kind;
+  node->first_child      = link(record->first_child);
+  node->first_annotation = link(record->first_annotation);
+  node->next_sibling     = link(record->next_sibling);
+  node->offset           = record->offset;
+  
+  switch (node->kind)
+  {
+   case LCDDL_NODE_KIND_root:
+   {
+    break;
+   }
+   case LCDDL_NODE_KIND_file:
+   {
+    node->file.filename = &strings[record->fields[0]];
+    break;
+   }
+   case LCDDL_NODE_KIND_declaration:
+   {
+    node->declaration.name  = &strings[record->fields[0]];
+    node->declaration.type  = link(record->fields[1]);
+    node->declaration.value = link(record->fields[2]);
+    break;
+   }
+   case LCDDL_NODE_KIND_type:
+   {
+    node->type.type_name         = &strings[record->fields[0]];
+    node->type.array_count       = record->fields[1];
+    node->type.indirection_level = record->fields[2];
+    break;
+   }
+   case LCDDL_NODE_KIND_binary_operator:
+   {
+    node->binary_operator.kind  = record->fields[0];
+    node->binary_operator.left  = link(record->fields[1]);
+    node->binary_operator.right = link(record->fields[2]);
+    break;
+   }
+   case LCDDL_NODE_KIND_unary_operator:
+   {
+    node->unary_operator.kind    = record->fields[0];
+    node->unary_operator.operand = link(record->fields[1]);
+    break;
+   }
+   case LCDDL_NODE_KIND_string_literal:
+   case LCDDL_NODE_KIND_float_literal:
+   case LCDDL_NODE_KIND_integer_literal:
+   {
+    node->literal.value = &strings[record->fields[0]];
+    break;
+   }
+   case LCDDL_NODE_KIND_variable_reference:
+   {
+    node->var_reference.name = &strings[record->fields[0]];
+    break;
+   }
+   case LCDDL_NODE_KIND_annotation:
+   {
+    node->annotation.tag   = &strings[record->fields[0]];
+    node->annotation.value = link(record->fields[1]);
+    break;
+   }
+  }
+ }
+ 
+ LcddlNode **pointers = (LcddlNode **)(nodes + header->node_count);
+ for (unsigned int i = 0;
+      i < header->node_count;
+      ++i)
+ {
+  LcddlNode *node = &nodes[i];
+  
+  node->annotations = pointers;
+  for (LcddlNode *annotation = node->first_annotation;
+       NULL != annotation;
+       annotation = annotation->next_annotation)
+  {
+   node->annotations[node->annotation_count++] = annotation;
+  }
+  pointers += node->annotation_count;
+  
+  node->children = pointers;
+  for (LcddlNode *child = node->first_child;
+       NULL != child;
+       child = child->next_sibling)
+  {
+   node->children[node->child_count++] = child;
+  }
+  pointers += node->child_count;
+ }
+ 
+ // NOTE(tbt): nodes only link to nodes after them, so hashing in reverse order hashes children first
+ for (unsigned int i = header->node_count;
+      i > 0;
+      --i)
+ {
+  nodes[i - 1].hash = _lcddl_hash_node(&nodes[i - 1]);
+ }
+ 
+#undef link
+ 
+ _lcddl_protect_pages_read_only(mapping, block_size);
+ 
+ return &nodes[header->root];
+}
+
+void
+lcddl_save_binary(LcddlNode *node,
+                  char *path)
+{
+ LcddlWriter writer = lcddl_writer_for_path(path);
+ _lcddl_serialise_tree(node, &writer);
+ lcddl_writer_close(&writer);
+}
+
+LcddlNode *
+lcddl_open_binary(char *path)
+{
+ LcddlNode *result = NULL;
+ 
+ unsigned long long size = 0;
+ char *image = _lcddl_map_file_read_only(path, &size);
+ if (image)
+ {
+  if (_lcddl_validate_binary(image, size))
+  {
+   result = _lcddl_materialise_binary(image, size);
+  }
+  
+  if (!result)
+  {
+   _lcddl_unmap_file(image, size);
+  }
+ }
+ 
+ if (!result)
+ {
+  fprintf(stderr, "ERROR: Could not open binary tree '%s'\n", path);
+ }
+ 
+ return result;
+}
+
+void
+lcddl_close_binary(LcddlNode *root)
+{
+ // NOTE(tbt): the root is always the first node in the block
+ _LcddlBinaryMapping *mapping = ((_LcddlBinaryMapping *)root) - 1;
+ _lcddl_unmap_file(mapping->image, mapping->image_size);
+ _lcddl_free_pages(mapping, mapping->block_size);
+}
+
+// NOTE(tbt): a binary image can also be published to a named shared memory segment, so that several
+//            processes can attach to one parse. each attached process still builds its own nodes from the
+//            shared records, as with `lcddl_open_binary`, but strings and records are only held once
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+bool
+lcddl_publish_shared(LcddlNode *node,
+                     char *name)
+{
+ fprintf(stderr, "ERROR: Shared memory trees are not supported on this platform\n");
+ return false;
+}
+
+LcddlNode *
+lcddl_attach_shared(char *name)
+{
+ fprintf(stderr, "ERROR: Shared memory trees are not supported on this platform\n");
+ return NULL;
+}
+
+void
+lcddl_remove_shared(char *name)
+{
+}
+#else
+bool
+lcddl_publish_shared(LcddlNode *node,
+                     char *name)
+{
+ bool result = false;
+ 
+ LcddlWriter writer = lcddl_writer_for_memory();
+ _lcddl_serialise_tree(node, &writer);
+ 
+ // NOTE(tbt): replace any existing segment rather than resizing it under processes which are attached
+ shm_unlink(name);
+ int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+ if (fd >= 0)
+ {
+  if (0 == ftruncate(fd, writer.size))
+  {
+   void *segment = mmap(NULL, writer.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (segment != MAP_FAILED)
+   {
+    memcpy(segment, writer.buffer, writer.size);
+    munmap(segment, writer.size);
+    result = true;
+   }
+  }
+  close(fd);
+ }
+ 
+ if (!result)
+ {
+  fprintf(stderr, "ERROR: Could not publish tree to shared memory segment '%s'\n", name);
+ }
+ 
+ free(lcddl_writer_close(&writer));
+ 
+ return result;
+}
+
+LcddlNode *
+lcddl_attach_shared(char *name)
+{
+ LcddlNode *result = NULL;
+ 
+ int fd = shm_open(name, O_RDONLY, 0);
+ if (fd >= 0)
+ {
+  struct stat segment_stat;
+  if (0 == fstat(fd, &segment_stat) && segment_stat.st_size > 0)
+  {
+   void *image = mmap(NULL, segment_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   if (image != MAP_FAILED)
+   {
+    if (_lcddl_validate_binary(image, segment_stat.st_size))
+    {
+     result = _lcddl_materialise_binary(image, segment_stat.st_size);
+    }
+    
+    if (!result)
+    {
+     munmap(image, segment_stat.st_size);
+    }
+   }
+  }
+  close(fd);
+ }
+ 
+ if (!result)
+ {
+  fprintf(stderr, "ERROR: Could not attach to shared memory segment '%s'\n", name);
+ }
+ 
+ return result;
+}
+
+void
+lcddl_remove_shared(char *name)
+{
+ shm_unlink(name);
+}
+#endif
+
+///////////////////////////////////////////
+// USER LAYER
+//~
+
+#ifndef LCDDL_AS_LIBRARY
+
+typedef void (*_LcddlUserCallback)(LcddlNode *);
+
+typedef struct
+{
+ void *library;
+ _LcddlUserCallback callback;
+ char *loaded_path; // if the library was copied before loading, the path of the copy. otherwise NULL
+} _LcddlUserLayer;
+
+static _LcddlUserLayer get_user_callback_functions(char *lib_path, bool load_copy);
+static void unload_user_layer(_LcddlUserLayer *layer);
+
+#if defined(LCDDL_STATIC_USER_LAYER)
+// NOTE(tbt): the user layer is compiled and linked into the executable, so there is nothing to load.
+//            `lib_path` is the path of the executable itself
+static _LcddlUserLayer
+get_user_callback_functions(char *lib_path,
+                            bool load_copy)
+{
+ (void)lib_path;
+ (void)load_copy;
+ 
+ _LcddlUserLayer result = {0};
+ result.callback        = lcddl_user_callback;
+ return result;
+}
+
+static void
+unload_user_layer(_LcddlUserLayer *layer)
+{
+ memset(layer, 0, sizeof(*layer));
+}
+#else
+// NOTE(tbt): a layer which may be rebuilt while LCDDL is running is loaded from a uniquely named copy,
+//            so that the rebuilt library is never confused with a stale mapping of the old one, and so
+//            that the original is not locked on windows
+static char *
+_lcddl_make_user_layer_copy(char *lib_path)
+{
+ static unsigned int copy_count = 0;
+ copy_count += 1;
+ 
+ char *result = calloc(1, 4096);
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+ char temporary_directory[MAX_PATH + 1];
+ GetTempPathA(sizeof(temporary_directory), temporary_directory);
+ snprintf(result, 4096, "%slcddl_user_layer_%lu_%u.dll", temporary_directory, GetCurrentProcessId(), copy_count);
+#else
+ char *temporary_directory = getenv("TMPDIR");
+ snprintf(result, 4096, "%s/lcddl_user_layer_%d_%u.so", temporary_directory ? temporary_directory : "/tmp", getpid(), copy_count);
+#endif
+ 
+ if (!_lcddl_copy_file(lib_path, result))
+ {
+  free(result);
+  result = NULL;
+ }
+ 
+ return result;
+}
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+static _LcddlUserLayer
+get_user_callback_functions(char *lib_path,
+                            bool load_copy)
+{
+ _LcddlUserLayer result = {0};
+ 
+ if (load_copy)
+ {
+  result.loaded_path = _lcddl_make_user_layer_copy(lib_path);
+ }
+ 
+ HINSTANCE library = LoadLibrary(result.loaded_path ? result.loaded_path : lib_path);
+ if (!library)
+ {
+  fprintf(stderr, "ERROR: Could not open custom layer library '%s'\n", lib_path);
+  unload_user_layer(&result);
+  return result;
+ }
+ result.library = library;
+ 
+ result.callback = (_LcddlUserCallback)GetProcAddress(library, "lcddl_user_callback");
+ 
+ if (!result.callback)
+ {
+  fprintf(stderr, "ERROR: Could not find callback in user layer library '%s'\n", lib_path);
+  unload_user_layer(&result);
+ }
+ 
+ return result;
+}
+
+static void
+unload_user_layer(_LcddlUserLayer *layer)
+{
+ if (layer->library)
+ {
+  FreeLibrary(layer->library);
+ }
+ if (layer->loaded_path)
+ {
+  DeleteFileA(layer->loaded_path);
+  free(layer->loaded_path);
+ }
+ memset(layer, 0, sizeof(*layer));
+}
+#else
+static _LcddlUserLayer
+get_user_callback_functions(char *lib_path,
+                            bool load_copy)
+{
+ _LcddlUserLayer result = {0};
+ 
+ if (load_copy)
+ {
+  result.loaded_path = _lcddl_make_user_layer_copy(lib_path);
+ }
+ 
+ // NOTE(tbt): several layers, or a reloaded copy and the old copy of the same layer, are open at once. their
+ //            symbols are kept local so that each layer's calls to its own functions bind to its own
+ //            definitions rather than to whichever was loaded first. `lcddl_*` still resolve to the
+ //            executable, which exports them with -rdynamic
+ void *library = dlopen(result.loaded_path ? result.loaded_path : lib_path, RTLD_NOW | RTLD_LOCAL);
+ if (!library)
+ {
+  fprintf(stderr, "ERROR: Could not open user layer library '%s'\n", lib_path);
+  unload_user_layer(&result);
+  return result;
+ }
+ result.library = library;
+ 
+ // NOTE(tbt): the mapping outlives the file, so the copy can be removed straight away
+ if (result.loaded_path)
+ {
+  remove(result.loaded_path);
+  free(result.loaded_path);
+  result.loaded_path = NULL;
+ }
+ 
+ result.callback = dlsym(library, "lcddl_user_callback");
+ 
+ if (!result.callback)
+ {
+  fprintf(stderr, "ERROR: Could not find callback in user layer library '%s'\n", lib_path);
+  unload_user_layer(&result);
+ }
+ 
+ return result;
+}
+
+static void
+unload_user_layer(_LcddlUserLayer *layer)
+{
+ if (layer->library)
+ {
+  dlclose(layer->library);
+ }
+ if (layer->loaded_path)
+ {
+  remove(layer->loaded_path);
+  free(layer->loaded_path);
+ }
+ memset(layer, 0, sizeof(*layer));
+}
+#endif
+#endif
+
+#endif
+
+///////////////////////////////////////////
+// MAIN
+//~
+
+static LcddlNode *_lcddl_global_root;
+static _LcddlStringList _lcddl_output_paths; // every file written through a path writer
+static LcddlOutputSummary _lcddl_output_summary;
+static _LcddlMutex _lcddl_output_mutex = LCDDL_MUTEX_INITIALISER; // user layers may run concurrently
+
+static void
+_lcddl_free_tree(LcddlNode *root)
+{
+ if (root && root->reference_count)
+ {
+  // NOTE(tbt): interned nodes are shared, so are only freed along with their last reference
+  root->reference_count -= 1;
+  if (root->reference_count)
+  {
+   return;
+  }
+  _lcddl_remove_interned_node(root);
+ }
+ 
+ if (root)
+ {
+  // free sub-type specific data
+  switch(root->kind)
+  {
+   case LCDDL_NODE_KIND_file:
+   {
+    _lcddl_free_string(root->file.filename);
+    _lcddl_free_source(root->file.source);
+    break;
+   }
+   
+   case LCDDL_NODE_KIND_declaration:
+   {
+    _lcddl_free_string(root->declaration.name);
+    _lcddl_free_tree(root->declaration.type);
+    _lcddl_free_tree(root->declaration.value);
+    break;
+   }
+   
+   case LCDDL_NODE_KIND_type:
+   {
+    _lcddl_free_string(root->type.type_name);
+    break;
+   }
+   
+   case LCDDL_NODE_KIND_binary_operator:
+   {
+    _lcddl_free_tree(root->binary_operator.left);
+    _lcddl_free_tree(root->binary_operator.right);
+    break;
+   }
+   
+   case LCDDL_NODE_KIND_unary_operator:
+   {
+    _lcddl_free_tree(root->unary_operator.operand);
+    break;
+   }
+   
+   case LCDDL_NODE_KIND_string_literal:
+   case LCDDL_NODE_KIND_float_literal:
+   case LCDDL_NODE_KIND_integer_literal:
+   {
+    _lcddl_free_string(root->literal.value);
+    break;
+   }
+   
+   case LCDDL_NODE_KIND_variable_reference:
+   {
+    _lcddl_free_string(root->var_reference.name);
+    break;
+   }
+   
+   case LCDDL_NODE_KIND_annotation:
+   {
+    _lcddl_free_string(root->annotation.tag);
+    _lcddl_free_tree(root->annotation.value);
+    break;
+   }
+   
+   case LCDDL_NODE_KIND_root:
+   {
+    // NOTE(tbt): the root only owns its children
+    break;
+   }
+  }
+  
+  // free children
+  for (unsigned int i = 0;
+       i < root->child_count;
+       ++i)
+  {
+   _lcddl_free_tree(root->children[i]);
+  }
+  _lcddl_free(root->children, root->child_count * sizeof(*root->children));
+  
+  // free annotations
+  for (unsigned int i = 0;
+       i < root->annotation_count;
+       ++i)
+  {
+   _lcddl_free_tree(root->annotations[i]);
+  }
+  _lcddl_free(root->annotations, root->annotation_count * sizeof(*root->annotations));
+  
+  // free the node itself
+  _lcddl_free_node(root);
+ }
+}
+
+// NOTE(tbt): every top-level declaration of every file in the root, open addressed by a hash of its name, so
+//            that declarations can be found by name without searching every file. declarations which share a
+//            name are all kept, and stay in the order they were added - nothing is ever left between an entry
+//            and its home slot, so a new entry always goes after any others with the same name. the table is
+//            updated as files are added to and removed from the root, and only read while user layers run
+typedef struct
+{
+ unsigned long long name_hash;
+ LcddlNode *declaration; // NULL for an empty slot
+ LcddlNode *file;
+} _LcddlSymbol;
+
+typedef struct
+{
+ _LcddlSymbol *symbols;
+ unsigned int count;
+ unsigned int capacity;
+ unsigned int duplicate_count; // number of declarations which have the same name as an earlier one
+} _LcddlSymbolTable;
+
+static _LcddlSymbolTable _lcddl_symbol_table;
+
+static bool
+_lcddl_symbol_has_name(_LcddlSymbol *symbol,
+                       unsigned long long name_hash,
+                       char *name)
+{
+ return (symbol->name_hash == name_hash &&
+         0 == strcmp(symbol->declaration->declaration.name, name));
+}
+
+// NOTE(tbt): returns the slot of the first declaration called `name`, or of the empty slot ending its run
+static unsigned int
+_lcddl_find_symbol_slot(unsigned long long name_hash,
+                        char *name)
+{
+ unsigned int mask = _lcddl_symbol_table.capacity - 1;
+ unsigned int slot = name_hash & mask;
+ while (_lcddl_symbol_table.symbols[slot].declaration &&
+        !_lcddl_symbol_has_name(&_lcddl_symbol_table.symbols[slot], name_hash, name))
+ {
+  slot = (slot + 1) & mask;
+ }
+ return slot;
+}
+
+static void
+_lcddl_insert_symbol(_LcddlSymbol symbol)
+{
+ unsigned int mask = _lcddl_symbol_table.capacity - 1;
+ unsigned int slot = symbol.name_hash & mask;
+ while (_lcddl_symbol_table.symbols[slot].declaration)
+ {
+  slot = (slot + 1) & mask;
+ }
+ _lcddl_symbol_table.symbols[slot] = symbol;
+}
+
+static void
+_lcddl_add_symbol(LcddlNode *file,
+                  LcddlNode *declaration)
+{
+ // NOTE(tbt): keep the table at most three quarters full
+ if ((_lcddl_symbol_table.count + 1) * 4 > _lcddl_symbol_table.capacity * 3)
+ {
+  _LcddlSymbol *old_symbols    = _lcddl_symbol_table.symbols;
+  unsigned int old_capacity    = _lcddl_symbol_table.capacity;
+  _lcddl_symbol_table.capacity = old_capacity ? old_capacity * 2 : 1024;
+  _lcddl_symbol_table.symbols  = calloc(_lcddl_symbol_table.capacity, sizeof(*_lcddl_symbol_table.symbols));
+  
+  // NOTE(tbt): starting just after an empty slot means no run is split across the end of the old table, so
+  //            declarations with the same name are reinserted in the same order
+  unsigned int start = 0;
+  while (start < old_capacity &&
+         old_symbols[start].declaration)
+  {
+   start += 1;
+  }
+  for (unsigned int i = 1;
+       i <= old_capacity;
+       ++i)
+  {
+   _LcddlSymbol *old_symbol = &old_symbols[(start + i) & (old_capacity - 1)];
+   if (old_symbol->declaration)
+   {
+    _lcddl_insert_symbol(*old_symbol);
+   }
+  }
+  free(old_symbols);
+ }
+ 
+ _LcddlSymbol symbol = {0};
+ symbol.name_hash    = _lcddl_hash_bytes(declaration->declaration.name, strlen(declaration->declaration.name));
+ symbol.declaration  = declaration;
+ symbol.file         = file;
+ 
+ if (_lcddl_symbol_table.symbols[_lcddl_find_symbol_slot(symbol.name_hash, declaration->declaration.name)].declaration)
+ {
+  _lcddl_symbol_table.duplicate_count += 1;
+ }
+ _lcddl_insert_symbol(symbol);
+ _lcddl_symbol_table.count += 1;
+}
+
+static void
+_lcddl_remove_symbol(LcddlNode *declaration)
+{
+ unsigned int mask = _lcddl_symbol_table.capacity - 1;
+ unsigned int hole = _lcddl_hash_bytes(declaration->declaration.name, strlen(declaration->declaration.name)) & mask;
+ while (_lcddl_symbol_table.symbols[hole].declaration != declaration)
+ {
+  hole = (hole + 1) & mask;
+ }
+ _LcddlSymbol removed = _lcddl_symbol_table.symbols[hole];
+ 
+ // NOTE(tbt): shift back any later symbols in the same run which would no longer be found past the hole
+ for (unsigned int slot = (hole + 1) & mask;
+      NULL != _lcddl_symbol_table.symbols[slot].declaration;
+      slot = (slot + 1) & mask)
+ {
+  unsigned int home = _lcddl_symbol_table.symbols[slot].name_hash & mask;
+  if (((slot - home) & mask) >= ((slot - hole) & mask))
+  {
+   _lcddl_symbol_table.symbols[hole] = _lcddl_symbol_table.symbols[slot];
+   hole                              = slot;
+  }
+ }
+ _lcddl_symbol_table.symbols[hole].declaration = NULL;
+ _lcddl_symbol_table.count                    -= 1;
+ 
+ if (_lcddl_symbol_table.symbols[_lcddl_find_symbol_slot(removed.name_hash, declaration->declaration.name)].declaration)
+ {
+  _lcddl_symbol_table.duplicate_count -= 1;
+ }
+}
+
+static void
+_lcddl_add_file_symbols(LcddlNode *file)
+{
+ for (unsigned int i = 0;
+      i < file->child_count;
+      ++i)
+ {
+  if (file->children[i]->kind == LCDDL_NODE_KIND_declaration)
+  {
+   _lcddl_add_symbol(file, file->children[i]);
+  }
+ }
+}
+
+static void
+_lcddl_remove_file_symbols(LcddlNode *file)
+{
+ for (unsigned int i = 0;
+      i < file->child_count;
+      ++i)
+ {
+  if (file->children[i]->kind == LCDDL_NODE_KIND_declaration)
+  {
+   _lcddl_remove_symbol(file->children[i]);
+  }
+ }
+}
+
+// NOTE(tbt): returns the first declaration called `name` in any file, or NULL if there are none
+static LcddlNode *
+_lcddl_find_symbol(char *name)
+{
+ LcddlNode *result = NULL;
+ if (_lcddl_symbol_table.count)
+ {
+  unsigned long long name_hash = _lcddl_hash_bytes(name, strlen(name));
+  result                       = _lcddl_symbol_table.symbols[_lcddl_find_symbol_slot(name_hash, name)].declaration;
+ }
+ return result;
+}
+
+// NOTE(tbt): pushes a diagnostic for each declaration which has the same name as an earlier one, at the later
+//            declaration and giving the location of the earlier, and returns how many there were
+static unsigned int
+_lcddl_report_duplicate_declarations(void)
+{
+ unsigned int result = 0;
+ 
+ for (unsigned int i = 0;
+      i < _lcddl_symbol_table.capacity &&
+      result < _lcddl_symbol_table.duplicate_count;
+      ++i)
+ {
+  _LcddlSymbol *symbol = &_lcddl_symbol_table.symbols[i];
+  if (symbol->declaration)
+  {
+   _LcddlSymbol *first = &_lcddl_symbol_table.symbols[_lcddl_find_symbol_slot(symbol->name_hash,
+                                                                              symbol->declaration->declaration.name)];
+   if (first != symbol)
+   {
+    LcddlLocation location       = lcddl_node_location(symbol->file, symbol->declaration);
+    LcddlLocation first_location = lcddl_node_location(first->file, first->declaration);
+    if (first_location.line)
+    {
+     _lcddl_push_diagnostic(location.path, location.line, location.column,
+                            "'%s' is already declared at %s:%lu:%lu",
+                            symbol->declaration->declaration.name,
+                            first_location.path, first_location.line, first_location.column);
+    }
+    else
+    {
+     _lcddl_push_diagnostic(location.path, location.line, location.column,
+                            "'%s' is already declared in '%s'",
+                            symbol->declaration->declaration.name,
+                            first_location.path);
+    }
+    result += 1;
+   }
+  }
+ }
+ 
+ return result;
+}
+
+// NOTE(tbt): the children of the root are added and removed as inputs are parsed and freed, so unlike other
+//            nodes its `children` array is grown as needed. each file remembers its index in the array, so
+//            adding, removing and replacing a file are all constant time. files are kept in the order they were
+//            added, except that removing a file moves the last file into its place
+static unsigned int _lcddl_global_root_capacity;
+
+static void _lcddl_invalidate_layouts(void);
+
+// NOTE(tbt): updates the `first_child` or `next_sibling` pointer which should point to the child at `index`.
+//            `index` may be one past the last child, in which case the last child's `next_sibling` is cleared
+static void
+_lcddl_link_root_child(unsigned int index)
+{
+ LcddlNode *root  = _lcddl_global_root;
+ LcddlNode *child = index < root->child_count ? root->children[index] : NULL;
+ if (index == 0) { root->first_child                       = child; }
+ else            { root->children[index - 1]->next_sibling = child; }
+}
+
+static void
+_lcddl_push_file_to_root(LcddlNode *file)
+{
+ LcddlNode *root = _lcddl_global_root;
+ if (root->child_count == _lcddl_global_root_capacity)
+ {
+  _lcddl_global_root_capacity = _lcddl_global_root_capacity ? _lcddl_global_root_capacity * 2 : 16;
+  root->children              = realloc(root->children, _lcddl_global_root_capacity * sizeof(*root->children));
+ }
+ file->file.index                    = root->child_count;
+ root->children[root->child_count++] = file;
+ _lcddl_link_root_child(file->file.index);
+ _lcddl_link_root_child(root->child_count);
+ _lcddl_add_file_symbols(file);
+ _lcddl_invalidate_layouts();
+}
+
+// NOTE(tbt): the executable only ever replaces files, so this is only needed by the library
+#ifdef LCDDL_AS_LIBRARY
+static void
+_lcddl_remove_file_from_root(LcddlNode *file)
+{
+ LcddlNode *root    = _lcddl_global_root;
+ unsigned int index = file->file.index;
+ LcddlNode *last    = root->children[root->child_count - 1];
+ root->child_count -= 1;
+ _lcddl_remove_file_symbols(file);
+ _lcddl_invalidate_layouts();
+ 
+ if (last != file)
+ {
+  root->children[index] = last;
+  last->file.index      = index;
+  _lcddl_link_root_child(index);
+  _lcddl_link_root_child(index + 1);
+ }
+ _lcddl_link_root_child(root->child_count);
+}
+#endif
+
+static void
+_lcddl_replace_file_in_root(LcddlNode *old_file,
+                            LcddlNode *new_file)
+{
+ unsigned int index                  = old_file->file.index;
+ new_file->file.index                = index;
+ _lcddl_global_root->children[index] = new_file;
+ _lcddl_link_root_child(index);
+ _lcddl_link_root_child(index + 1);
+ _lcddl_remove_file_symbols(old_file);
+ _lcddl_add_file_symbols(new_file);
+ _lcddl_invalidate_layouts();
+}
+
+#ifndef LCDDL_AS_LIBRARY
+
+typedef struct
+{
+ char **user_layer_paths;
+ int user_layer_count;
+ int job_count;
+ char **input_paths;
+ int input_count;
+ char *depfile_path;
+ char *cache_dir;
+ char *shared_memory_name;
+ char *serve_socket_path;
+ char *connect_socket_path;
+ char *stats_json_path;
+ char *trace_path;
+ unsigned long long memory_limit;
+ bool stats;
+ bool watch;
+ bool intern;
+} _LcddlOptions;
+
+// NOTE(tbt): wall clock times of each phase of a run, for --stats
+typedef struct
+{
+ unsigned long long start_time;
+ unsigned long long load_user_layers_time;
+ unsigned long long parse_time;
+ unsigned long long user_layers_time;
+ unsigned long long *user_layer_times; // one for each user layer
+ unsigned int run_count;
+} _LcddlPhaseTimes;
+
+static _LcddlPhaseTimes _lcddl_phase_times;
+
+// NOTE(tbt): one user layer path per line. blank lines and lines beginning with '#' are ignored.
+//            relative paths are relative to the directory containing the manifest
+static void
+_lcddl_read_user_layer_manifest(char *manifest_path,
+                                _LcddlStringList *user_layer_paths)
+{
+ FILE *file = fopen(manifest_path, "rb");
+ if (!file)
+ {
+  fprintf(stderr, "ERROR: Could not open user layer manifest '%s'\n", manifest_path);
+  exit(EXIT_FAILURE);
+ }
+ 
+ char *separator       = strrchr(manifest_path, '/');
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+ char *back_separator  = strrchr(manifest_path, '\\');
+ if (back_separator > separator)
+ {
+  separator = back_separator;
+ }
+#endif
+ int directory_length  = separator ? separator - manifest_path + 1 : 0;
+ 
+ char line[4096];
+ while (fgets(line, sizeof(line), file))
+ {
+  char *begin = line;
+  while (*begin && _lcddl_is_char_space(*begin))
+  {
+   begin += 1;
+  }
+  char *end = begin + strlen(begin);
+  while (end > begin && _lcddl_is_char_space(end[-1]))
+  {
+   end -= 1;
+  }
+  *end = '\0';
+  
+  if (*begin &&
+      *begin != '#')
+  {
+   bool is_absolute = (*begin == '/');
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+   is_absolute = is_absolute || *begin == '\\' || (*begin && begin[1] == ':');
+#endif
+   char *path = calloc(1, directory_length + strlen(begin) + 1);
+   if (!is_absolute)
+   {
+    strncpy(path, manifest_path, directory_length);
+   }
+   strcat(path, begin);
+   _lcddl_push_string(user_layer_paths, path);
+   free(path);
+  }
+ }
+ 
+ fclose(file);
+}
+
+static _LcddlOptions
+_lcddl_parse_command_line(int argc,
+                          char **argv)
+{
+ _LcddlOptions result              = {0};
+ result.input_paths                = calloc(argc, sizeof(*result.input_paths));
+ result.job_count                  = 1;
+ _LcddlStringList user_layer_paths = {0};
+ bool is_user_layer_given          = false;
+ 
+ for (int i = 1;
+      i < argc;
+      ++i)
+ {
+  if (0 == strcmp(argv[i], "--layer") &&
+      i + 1 < argc)
+  {
+   _lcddl_push_string(&user_layer_paths, argv[++i]);
+   is_user_layer_given = true;
+  }
+  else if (0 == strcmp(argv[i], "--layers") &&
+           i + 1 < argc)
+  {
+   _lcddl_read_user_layer_manifest(argv[++i], &user_layer_paths);
+   is_user_layer_given = true;
+  }
+  else if (0 == strcmp(argv[i], "--jobs") &&
+           i + 1 < argc)
+  {
+   result.job_count = atoi(argv[++i]);
+   if (result.job_count < 1)
+   {
+    fprintf(stderr, "ERROR: --jobs must be at least 1\n");
+    exit(EXIT_FAILURE);
+   }
+  }
+  else if (0 == strcmp(argv[i], "--depfile") &&
+      i + 1 < argc)
+  {
+   result.depfile_path = argv[++i];
+  }
+  else if (0 == strcmp(argv[i], "--cache-dir") &&
+           i + 1 < argc)
+  {
+   result.cache_dir = argv[++i];
+  }
+  else if (0 == strcmp(argv[i], "--publish-shm") &&
+           i + 1 < argc)
+  {
+   result.shared_memory_name = argv[++i];
+  }
+  else if (0 == strcmp(argv[i], "--serve") &&
+           i + 1 < argc)
+  {
+   result.serve_socket_path = argv[++i];
+  }
+  else if (0 == strcmp(argv[i], "--connect") &&
+           i + 1 < argc)
+  {
+   result.connect_socket_path = argv[++i];
+  }
+  else if (0 == strcmp(argv[i], "--watch"))
+  {
+   result.watch = true;
+  }
+  else if (0 == strcmp(argv[i], "--stats"))
+  {
+   result.stats = true;
+  }
+  else if (0 == strcmp(argv[i], "--intern"))
+  {
+   result.intern = true;
+  }
+  else if (0 == strcmp(argv[i], "--memory-limit") &&
+           i + 1 < argc)
+  {
+   result.memory_limit = strtoull(argv[++i], NULL, 10);
+   if (!result.memory_limit)
+   {
+    fprintf(stderr, "ERROR: --memory-limit must be at least 1 byte\n");
+    exit(EXIT_FAILURE);
+   }
+  }
+  else if (0 == strcmp(argv[i], "--stats-json") &&
+           i + 1 < argc)
+  {
+   result.stats_json_path = argv[++i];
+  }
+  else if (0 == strcmp(argv[i], "--trace") &&
+           i + 1 < argc)
+  {
+   result.trace_path = argv[++i];
+  }
+  else if (0 == strncmp(argv[i], "--", 2))
+  {
+   fprintf(stderr, "ERROR: Unknown option '%s'\n", argv[i]);
+   exit(EXIT_FAILURE);
+  }
+#if !defined(LCDDL_STATIC_USER_LAYER)
+  else if (!is_user_layer_given &&
+           !user_layer_paths.count)
+  {
+   // NOTE(tbt): without --layer or --layers, the first positional argument is the only user layer
+   _lcddl_push_string(&user_layer_paths, argv[i]);
+  }
+#endif
+  else
+  {
+   result.input_paths[result.input_count++] = argv[i];
+  }
+ }
+ 
+#if defined(LCDDL_STATIC_USER_LAYER)
+ // NOTE(tbt): the executable is the user layer, as far as the depfile is concerned
+ if (is_user_layer_given ||
+     result.serve_socket_path ||
+     result.connect_socket_path)
+ {
+  fprintf(stderr, "ERROR: This build of LCDDL has a built in user layer, so does not support --layer, --layers, --serve or --connect\n");
+  exit(EXIT_FAILURE);
+ }
+ _lcddl_push_string(&user_layer_paths, argv[0]);
+#endif
+ 
+ result.user_layer_paths = user_layer_paths.strings;
+ result.user_layer_count = user_layer_paths.count;
+ 
+ if (result.serve_socket_path)
+ {
+  // NOTE(tbt): the daemon takes everything else from each request
+  if (result.user_layer_count)
+  {
+   fprintf(stderr, "ERROR: --serve does not take a user layer or input files\n");
+   exit(EXIT_FAILURE);
+  }
+ }
+ else if (!result.user_layer_count ||
+          !result.input_count)
+ {
+#if defined(LCDDL_STATIC_USER_LAYER)
+  fprintf(stderr, "Usage: %s [--jobs count] [--depfile path] [--cache-dir path] [--publish-shm name] [--watch] [--intern] [--memory-limit bytes] [--stats] [--stats-json path] [--trace path] input_file_1 input_file_2...\n", argv[0]);
+#else
+  fprintf(stderr, "Usage: %s [options] custom_layer_library_path input_file_1 input_file_2...\n"
+          "       %s [options] --layer custom_layer_library_path... [--layers manifest_path] input_file_1 input_file_2...\n"
+          "       %s --serve socket_path\n"
+          "       %s --connect socket_path [--depfile path] custom_layer_library_path input_file_1 input_file_2...\n"
+          "options: [--jobs count] [--depfile path] [--cache-dir path] [--publish-shm name] [--watch] [--intern] [--memory-limit bytes] [--stats] [--stats-json path] [--trace path]\n",
+          argv[0], argv[0], argv[0], argv[0]);
+#endif
+  exit(EXIT_FAILURE);
+ }
+ else if (result.connect_socket_path &&
+          (result.cache_dir || result.shared_memory_name || result.watch || result.intern || result.memory_limit || result.stats || result.stats_json_path || result.trace_path || result.user_layer_count > 1))
+ {
+  fprintf(stderr, "ERROR: --connect only supports --depfile and a single user layer\n");
+  exit(EXIT_FAILURE);
+ }
+ 
+ return result;
+}
+
+// NOTE(tbt): escapes the characters which are special in make and ninja depfiles
+static void
+_lcddl_write_depfile_path(LcddlWriter *writer,
+                          char *path)
+{
+ for (char *c = path;
+      *c;
+      ++c)
+ {
+  if (*c == ' ' || *c == '#')
+  {
+   lcddl_writer_put_char(writer, '\\', 1);
+  }
+  else if (*c == '$')
+  {
+   lcddl_writer_put_char(writer, '$', 1);
+  }
+  lcddl_writer_put_char(writer, *c, 1);
+ }
+}
+
+// NOTE(tbt): every output written through a path writer depends on every input and the user layer.
+//            if there were no such outputs, the depfile itself is used as the target
+static void
+_lcddl_write_depfile(_LcddlOptions *options)
+{
+ FILE *file = fopen(options->depfile_path, "wb");
+ if (!file)
+ {
+  fprintf(stderr, "ERROR: Could not open depfile '%s'\n", options->depfile_path);
+  exit(EXIT_FAILURE);
+ }
+ 
+ LcddlWriter writer = lcddl_writer_for_file(file);
+ 
+ if (_lcddl_output_paths.count)
+ {
+  for (unsigned int i = 0;
+       i < _lcddl_output_paths.count;
+       ++i)
+  {
+   if (i)
+   {
+    lcddl_writer_put_char(&writer, ' ', 1);
+   }
+   _lcddl_write_depfile_path(&writer, _lcddl_output_paths.strings[i]);
+  }
+ }
+ else
+ {
+  _lcddl_write_depfile_path(&writer, options->depfile_path);
+ }
+ lcddl_writer_put_char(&writer, ':', 1);
+ 
+ for (int i = 0;
+      i < options->user_layer_count;
+      ++i)
+ {
+  lcddl_writer_put_string(&writer, i ? " \\\n " : " ");
+  _lcddl_write_depfile_path(&writer, options->user_layer_paths[i]);
+ }
+ for (int i = 0;
+      i < options->input_count;
+      ++i)
+ {
+  lcddl_writer_put_string(&writer, " \\\n ");
+  _lcddl_write_depfile_path(&writer, options->input_paths[i]);
+ }
+ lcddl_writer_put_char(&writer, '\n', 1);
+ 
+ // NOTE(tbt): phony rules for each dependency so that make does not fail when one is deleted
+ lcddl_writer_put_char(&writer, '\n', 1);
+ for (int i = 0;
+      i < options->user_layer_count;
+      ++i)
+ {
+  _lcddl_write_depfile_path(&writer, options->user_layer_paths[i]);
+  lcddl_writer_put_string(&writer, ":\n");
+ }
+ for (int i = 0;
+      i < options->input_count;
+      ++i)
+ {
+  _lcddl_write_depfile_path(&writer, options->input_paths[i]);
+  lcddl_writer_put_string(&writer, ":\n");
+ }
+ 
+ lcddl_writer_close(&writer);
+ fclose(file);
+}
+
+static unsigned int _lcddl_cache_hits;
+static unsigned int _lcddl_cache_misses;
+
+// NOTE(tbt): parsed trees are cached in `cache_dir` as binary images, named by a hash of the file's
+//            contents and the version of LCDDL which parsed them
+static LcddlNode *
+_lcddl_parse_file_with_cache(char *path,
+                             char *cache_dir)
+{
+ LcddlNode *result    = NULL;
+ _LcddlStream stream  = _lcddl_load_entire_file_as_stream(path);
+ 
+ static unsigned long long version_hash = 0;
+ if (!version_hash)
+ {
+  char version[64];
+  snprintf(version, sizeof(version), "%s:%d", LCDDL_VERSION, LCDDL_BINARY_FORMAT_VERSION);
+  version_hash = _lcddl_hash_bytes(version, strlen(version));
+ }
+ unsigned long long key = _lcddl_hash_bytes(stream.buffer, stream.size) ^ version_hash;
+ 
+ char *cache_path = calloc(1, strlen(cache_dir) + 32);
+ sprintf(cache_path, "%s/%016llx.lcdb", cache_dir, key);
+ 
+ // NOTE(tbt): a file which could not be loaded is left for the parser to fail on, rather than being looked
+ //            up as if it were empty
+ _lcddl_trace_begin("cache lookup", path);
+ FILE *file = stream.error_count ? NULL : fopen(cache_path, "rb");
+ if (file)
+ {
+  fseek(file, 0, SEEK_END);
+  unsigned long long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *buffer = malloc(size);
+  if (buffer &&
+      fread(buffer, 1, size, file) == size)
+  {
+   result = _lcddl_deserialise_tree(buffer, size);
+  }
+  free(buffer);
+  fclose(file);
+ }
+ _lcddl_trace_end("cache lookup", path);
+ 
+ if (result &&
+     result->kind == LCDDL_NODE_KIND_file)
+ {
+  // NOTE(tbt): the same contents may have been cached under a different path
+  _lcddl_free_string(result->file.filename);
+  result->file.filename = _lcddl_copy_string(path, strlen(path));
+  result->file.source   = _lcddl_take_source(&stream);
+  if (!result->file.filename ||
+      !result->file.source)
+  {
+   _lcddl_push_out_of_memory_diagnostic(path);
+   _lcddl_free_tree(result);
+   result = NULL;
+  }
+  else
+  {
+   // NOTE(tbt): the hash of a file covers its filename
+   result->hash       = _lcddl_hash_node(result);
+   _lcddl_cache_hits += 1;
+  }
+ }
+ else
+ {
+  result = _lcddl_parse_stream(&stream);
+  if (result)
+  {
+   LcddlWriter writer = lcddl_writer_for_memory();
+   _lcddl_serialise_tree(result, &writer);
+   _lcddl_replace_file_atomically(cache_path, writer.buffer, writer.size);
+   free(lcddl_writer_close(&writer));
+  }
+  _lcddl_cache_misses += 1;
+ }
+ 
+ _lcddl_free_stream(&stream);
+ free(cache_path);
+ 
+ return result;
+}
+
+static LcddlNode *
+_lcddl_parse_input(_LcddlOptions *options,
+                   char *path)
+{
+ unsigned long long start_time = _lcddl_stats.is_enabled ? _lcddl_get_time() : 0;
+ 
+ LcddlNode *result = NULL;
+ if (options->cache_dir)
+ {
+  result = _lcddl_parse_file_with_cache(path, options->cache_dir);
+ }
+ else
+ {
+  _LcddlStream stream = _lcddl_load_entire_file_as_stream(path);
+  result              = _lcddl_parse_stream(&stream);
+  _lcddl_free_stream(&stream);
+ }
+ 
+ if (_lcddl_stats.is_enabled)
+ {
+  _lcddl_phase_times.parse_time += _lcddl_get_time() - start_time;
+ }
+ 
+ return result;
+}
+
+static char *_lcddl_node_kind_names[LCDDL_NODE_KIND_COUNT] =
+{
+ [LCDDL_NODE_KIND_root]               = "root",
+ [LCDDL_NODE_KIND_file]               = "file",
+ [LCDDL_NODE_KIND_declaration]        = "declaration",
+ [LCDDL_NODE_KIND_type]               = "type",
+ [LCDDL_NODE_KIND_binary_operator]    = "binary_operator",
+ [LCDDL_NODE_KIND_unary_operator]     = "unary_operator",
+ [LCDDL_NODE_KIND_string_literal]     = "string_literal",
+ [LCDDL_NODE_KIND_float_literal]      = "float_literal",
+ [LCDDL_NODE_KIND_integer_literal]    = "integer_literal",
+ [LCDDL_NODE_KIND_variable_reference] = "variable_reference",
+ [LCDDL_NODE_KIND_annotation]         = "annotation",
+};
+
+static void
+_lcddl_write_stats_table(_LcddlOptions *options,
+                         LcddlWriter *writer)
+{
+ double total_time = (_lcddl_get_time() - _lcddl_phase_times.start_time) * 1e-6;
+ double parse_time = _lcddl_phase_times.parse_time * 1e-6;
+ 
+ lcddl_writer_printf(writer, "lcddl stats:\n");
+ lcddl_writer_printf(writer, " %-40s %12s\n", "phase", "time (ms)");
+ lcddl_writer_printf(writer, " %-40s %12.3f\n", "load user layers", _lcddl_phase_times.load_user_layers_time * 1e-6);
+ lcddl_writer_printf(writer, " %-40s %12.3f\n", "parse inputs", parse_time);
+ lcddl_writer_printf(writer, " %-40s %12.3f\n", "user layers", _lcddl_phase_times.user_layers_time * 1e-6);
+ for (int i = 0;
+      i < options->user_layer_count;
+      ++i)
+ {
+  lcddl_writer_printf(writer, "  %-39s %12.3f\n", options->user_layer_paths[i], _lcddl_phase_times.user_layer_times[i] * 1e-6);
+ }
+ lcddl_writer_printf(writer, " %-40s %12.3f\n", "  of which write helpers", _lcddl_stats.write_helper_time * 1e-6);
+ lcddl_writer_printf(writer, " %-40s %12.3f\n", "total", total_time);
+ if (_lcddl_phase_times.run_count > 1)
+ {
+  lcddl_writer_printf(writer, " (user layer times are summed over %u runs)\n", _lcddl_phase_times.run_count);
+ }
+ 
+ lcddl_writer_printf(writer, "\n %-40s %12s\n", "counter", "value");
+ lcddl_writer_printf(writer, " %-40s %12llu\n", "bytes read", _lcddl_stats.bytes_read);
+ if (parse_time > 0.0)
+ {
+  lcddl_writer_printf(writer, " %-40s %12.1f\n", "parse throughput (MB/s)", _lcddl_stats.bytes_read / (parse_time * 1e3));
+ }
+ lcddl_writer_printf(writer, " %-40s %12llu\n", "tokens", _lcddl_stats.token_count);
+ lcddl_writer_printf(writer, " %-40s %12llu\n", "parser allocations", _lcddl_stats.allocation_count);
+ lcddl_writer_printf(writer, " %-40s %12llu\n", "parser bytes allocated", _lcddl_stats.bytes_allocated);
+ lcddl_writer_printf(writer, " %-40s %12llu\n", "peak bytes in use", _lcddl_memory.stats.peak_bytes);
+ lcddl_writer_printf(writer, " %-40s %12llu\n", "nodes deduplicated by interning", _lcddl_stats.deduplicated_node_count);
+ lcddl_writer_printf(writer, " %-40s %12u\n", "parse cache hits", _lcddl_cache_hits);
+ lcddl_writer_printf(writer, " %-40s %12u\n", "parse cache misses", _lcddl_cache_misses);
+ lcddl_writer_printf(writer, " %-40s %12llu\n", "write helper calls", _lcddl_stats.write_helper_calls);
+ lcddl_writer_printf(writer, " %-40s %12llu\n", "bytes written", _lcddl_stats.bytes_written);
+ for (int i = 0;
+      i < LCDDL_NODE_KIND_COUNT;
+      ++i)
+ {
+  lcddl_writer_printf(writer, " nodes: %-33s %12llu\n", _lcddl_node_kind_names[i], _lcddl_stats.node_counts[i]);
+ }
+ 
+ if (_lcddl_stats.file_count)
+ {
+  lcddl_writer_printf(writer, "\n %-40s %12s %12s %12s %12s %12s\n", "file", "bytes", "load (ms)", "parse (ms)", "tokens", "nodes");
+  for (unsigned int i = 0;
+       i < _lcddl_stats.file_count;
+       ++i)
+  {
+   _LcddlFileStats *file = &_lcddl_stats.files[i];
+   lcddl_writer_printf(writer, " %-40s %12llu %12.3f %12.3f %12llu %12llu\n",
+                       file->path,
+                       file->bytes_read,
+                       file->load_time * 1e-6,
+                       file->parse_time * 1e-6,
+                       file->token_count,
+                       file->node_count);
+  }
+ }
+}
+
+static void
+_lcddl_write_stats_json(_LcddlOptions *options,
+                        LcddlWriter *writer)
+{
+ lcddl_writer_printf(writer, "{\n \"times_ns\": {\"total\": %llu, \"load_user_layers\": %llu, \"parse_inputs\": %llu, \"user_layers\": %llu, \"write_helpers\": %llu},\n",
+                     _lcddl_get_time() - _lcddl_phase_times.start_time,
+                     _lcddl_phase_times.load_user_layers_time,
+                     _lcddl_phase_times.parse_time,
+                     _lcddl_phase_times.user_layers_time,
+                     _lcddl_stats.write_helper_time);
+ lcddl_writer_printf(writer, " \"runs\": %u,\n", _lcddl_phase_times.run_count);
+ 
+ lcddl_writer_put_string(writer, " \"user_layers\": [");
+ for (int i = 0;
+      i < options->user_layer_count;
+      ++i)
+ {
+  lcddl_writer_put_string(writer, i ? ",\n  {\"path\": " : "\n  {\"path\": ");
+  _lcddl_write_json_string(writer, options->user_layer_paths[i]);
+  lcddl_writer_printf(writer, ", \"time_ns\": %llu}", _lcddl_phase_times.user_layer_times[i]);
+ }
+ lcddl_writer_put_string(writer, "\n ],\n");
+ 
+ lcddl_writer_printf(writer, " \"counters\": {\"bytes_read\": %llu, \"tokens\": %llu, \"allocations\": %llu, \"bytes_allocated\": %llu, \"peak_bytes\": %llu, \"deduplicated_nodes\": %llu, \"cache_hits\": %u, \"cache_misses\": %u, \"write_helper_calls\": %llu, \"bytes_written\": %llu},\n",
+                     _lcddl_stats.bytes_read,
+                     _lcddl_stats.token_count,
+                     _lcddl_stats.allocation_count,
+                     _lcddl_stats.bytes_allocated,
+                     _lcddl_memory.stats.peak_bytes,
+                     _lcddl_stats.deduplicated_node_count,
+                     _lcddl_cache_hits,
+                     _lcddl_cache_misses,
+                     _lcddl_stats.write_helper_calls,
+                     _lcddl_stats.bytes_written);
+ 
+ lcddl_writer_put_string(writer, " \"nodes\": {");
+ for (int i = 0;
+      i < LCDDL_NODE_KIND_COUNT;
+      ++i)
+ {
+  lcddl_writer_printf(writer, "%s\"%s\": %llu", i ? ", " : "", _lcddl_node_kind_names[i], _lcddl_stats.node_counts[i]);
+ }
+ lcddl_writer_put_string(writer, "},\n");
+ 
+ lcddl_writer_put_string(writer, " \"files\": [");
+ for (unsigned int i = 0;
+      i < _lcddl_stats.file_count;
+      ++i)
+ {
+  _LcddlFileStats *file = &_lcddl_stats.files[i];
+  lcddl_writer_put_string(writer, i ? ",\n  {\"path\": " : "\n  {\"path\": ");
+  _lcddl_write_json_string(writer, file->path);
+  lcddl_writer_printf(writer, ", \"bytes_read\": %llu, \"load_time_ns\": %llu, \"parse_time_ns\": %llu, \"tokens\": %llu, \"nodes\": %llu}",
+                      file->bytes_read,
+                      file->load_time,
+                      file->parse_time,
+                      file->token_count,
+                      file->node_count);
+ }
+ lcddl_writer_put_string(writer, "\n ]\n}\n");
+}
+
+// NOTE(tbt): returns false if the JSON file could not be written
+static bool
+_lcddl_report_stats(_LcddlOptions *options)
+{
+ // NOTE(tbt): count the nodes in the whole tree, including those loaded from the parse cache
+ memset(_lcddl_stats.node_counts, 0, sizeof(_lcddl_stats.node_counts));
+ _lcddl_count_nodes(_lcddl_global_root);
+ 
+ if (options->stats)
+ {
+  LcddlWriter writer = lcddl_writer_for_file(stderr);
+  _lcddl_write_stats_table(options, &writer);
+  lcddl_writer_close(&writer);
+ }
+ 
+ bool result = true;
+ if (options->stats_json_path)
+ {
+  LcddlWriter writer = lcddl_writer_for_memory();
+  _lcddl_write_stats_json(options, &writer);
+  result = _lcddl_replace_file_atomically(options->stats_json_path, writer.buffer, writer.size);
+  free(lcddl_writer_close(&writer));
+ }
+ return result;
+}
+
+typedef struct
+{
+ _LcddlUserLayer *user_layers;
+ char **user_layer_paths;
+ int user_layer_count;
+ int next_user_layer;
+ _LcddlMutex mutex;
+} _LcddlUserLayerJobs;
+
+static void
+_lcddl_run_user_layer_jobs(_LcddlUserLayerJobs *jobs)
+{
+ for (;;)
+ {
+  _lcddl_mutex_lock(&jobs->mutex);
+  int index = jobs->next_user_layer++;
+  _lcddl_mutex_unlock(&jobs->mutex);
+  
+  if (index >= jobs->user_layer_count)
+  {
+   break;
+  }
+  
+  _lcddl_trace_begin("user layer", jobs->user_layer_paths[index]);
+  unsigned long long start_time = _lcddl_stats.is_enabled ? _lcddl_get_time() : 0;
+  jobs->user_layers[index].callback(_lcddl_global_root);
+  if (_lcddl_stats.is_enabled)
+  {
+   // NOTE(tbt): each layer is only run by one thread at a time
+   _lcddl_phase_times.user_layer_times[index] += _lcddl_get_time() - start_time;
+  }
+  _lcddl_trace_end("user layer", jobs->user_layer_paths[index]);
+ }
+}
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+static DWORD WINAPI
+_lcddl_user_layer_thread_proc(LPVOID jobs)
+{
+ _lcddl_run_user_layer_jobs(jobs);
+ return 0;
+}
+#else
+static void *
+_lcddl_user_layer_thread_proc(void *jobs)
+{
+ _lcddl_run_user_layer_jobs(jobs);
+ return NULL;
+}
+#endif
+
+// NOTE(tbt): the tree is not modified once parsing has finished, so independent layers can walk it
+//            at the same time. with a single job the layers run in order on the main thread.
+//            returns false if any output, the JSON statistics or the trace could not be written
+static bool
+_lcddl_run_user_layers(_LcddlOptions *options,
+                       _LcddlUserLayer *user_layers)
+{
+ // NOTE(tbt): only report on the outputs of this run
+ memset(&_lcddl_output_summary, 0, sizeof(_lcddl_output_summary));
+ for (unsigned int i = 0;
+      i < _lcddl_output_paths.count;
+      ++i)
+ {
+  free(_lcddl_output_paths.strings[i]);
+ }
+ _lcddl_output_paths.count = 0;
+ 
+ _LcddlUserLayerJobs jobs = {0};
+ jobs.user_layers         = user_layers;
+ jobs.user_layer_paths    = options->user_layer_paths;
+ jobs.user_layer_count    = options->user_layer_count;
+ jobs.mutex               = (_LcddlMutex)LCDDL_MUTEX_INITIALISER;
+ 
+ unsigned long long start_time = 0;
+ if (_lcddl_stats.is_enabled)
+ {
+  start_time = _lcddl_get_time();
+  if (!_lcddl_phase_times.user_layer_times)
+  {
+   _lcddl_phase_times.user_layer_times = calloc(options->user_layer_count, sizeof(*_lcddl_phase_times.user_layer_times));
+  }
+ }
+ 
+ int thread_count = options->job_count < options->user_layer_count ? options->job_count : options->user_layer_count;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+ HANDLE *threads = calloc(thread_count, sizeof(*threads));
+ for (int i = 1;
+      i < thread_count;
+      ++i)
+ {
+  threads[i] = CreateThread(NULL, 0, _lcddl_user_layer_thread_proc, &jobs, 0, NULL);
+ }
+ _lcddl_run_user_layer_jobs(&jobs);
+ for (int i = 1;
+      i < thread_count;
+      ++i)
+ {
+  if (threads[i])
+  {
+   WaitForSingleObject(threads[i], INFINITE);
+   CloseHandle(threads[i]);
+  }
+ }
+#else
+ pthread_t *threads   = calloc(thread_count, sizeof(*threads));
+ bool *is_thread_live = calloc(thread_count, sizeof(*is_thread_live));
+ for (int i = 1;
+      i < thread_count;
+      ++i)
+ {
+  is_thread_live[i] = (0 == pthread_create(&threads[i], NULL, _lcddl_user_layer_thread_proc, &jobs));
+ }
+ _lcddl_run_user_layer_jobs(&jobs);
+ for (int i = 1;
+      i < thread_count;
+      ++i)
+ {
+  if (is_thread_live[i])
+  {
+   pthread_join(threads[i], NULL);
+  }
+ }
+ free(is_thread_live);
+#endif
+ free(threads);
+ 
+ if (_lcddl_stats.is_enabled)
+ {
+  _lcddl_phase_times.user_layers_time += _lcddl_get_time() - start_time;
+  _lcddl_phase_times.run_count        += 1;
+ }
+ 
+ LcddlOutputSummary summary = lcddl_get_output_summary();
+ if (summary.files_failed)
+ {
+  fprintf(stderr,
+          "lcddl: %u output files written, %u unchanged, %u could not be written\n",
+          summary.files_written,
+          summary.files_unchanged,
+          summary.files_failed);
+ }
+ else if (summary.files_written || summary.files_unchanged)
+ {
+  fprintf(stderr, "lcddl: %u output files written, %u unchanged\n", summary.files_written, summary.files_unchanged);
+ }
+ bool result = (0 == summary.files_failed);
+ 
+ if (options->cache_dir)
+ {
+  fprintf(stderr, "lcddl: parse cache %u hits, %u misses\n", _lcddl_cache_hits, _lcddl_cache_misses);
+ }
+ 
+ if (options->depfile_path)
+ {
+  _lcddl_write_depfile(options);
+ }
+ 
+ if (_lcddl_stats.is_enabled)
+ {
+  result = _lcddl_report_stats(options) && result;
+ }
+ 
+ if (_lcddl_trace.is_enabled)
+ {
+  // NOTE(tbt): rewritten after every run in watch mode, so that it is always complete
+  _lcddl_mutex_lock(&_lcddl_trace.mutex);
+  LcddlWriter writer = lcddl_writer_for_memory();
+  lcddl_writer_put_string(&writer, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  lcddl_writer_write(&writer, _lcddl_trace.events.buffer, _lcddl_trace.events.size);
+  lcddl_writer_put_string(&writer, "\n]}\n");
+  result = _lcddl_replace_file_atomically(options->trace_path, writer.buffer, writer.size) && result;
+  free(lcddl_writer_close(&writer));
+  _lcddl_mutex_unlock(&_lcddl_trace.mutex);
+ }
+ 
+ return result;
+}
+
+#if defined(__linux__)
+// NOTE(tbt): `name` is set to the part of `path` after the directory
+static int
+_lcddl_watch_parent_directory(int inotify_fd,
+                              char *path,
+                              char **name)
+{
+ char *separator = strrchr(path, '/');
+ char *directory = calloc(1, strlen(path) + 2);
+ 
+ if (separator)
+ {
+  strncpy(directory, path, separator - path + 1);
+  *name = separator + 1;
+ }
+ else
+ {
+  strcpy(directory, ".");
+  *name = path;
+ }
+ 
+ int result = inotify_add_watch(inotify_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+ if (result < 0)
+ {
+  fprintf(stderr, "ERROR: Could not watch directory '%s'\n", directory);
+  exit(EXIT_FAILURE);
+ }
+ 
+ free(directory);
+ return result;
+}
+
+// NOTE(tbt): the directories containing the inputs are watched rather than the inputs themselves,
+//            because many editors save by writing a new file and renaming it over the old one.
+//            user layer libraries are watched in the same way, and reloaded if they are rebuilt
+static void
+_lcddl_watch(_LcddlOptions *options,
+             _LcddlUserLayer *user_layers,
+             LcddlNode **input_files)
+{
+ int inotify_fd = inotify_init1(IN_CLOEXEC);
+ if (inotify_fd < 0)
+ {
+  fprintf(stderr, "ERROR: Could not initialise inotify\n");
+  exit(EXIT_FAILURE);
+ }
+ 
+ int *watch_descriptors = calloc(options->input_count, sizeof(*watch_descriptors));
+ char **file_names      = calloc(options->input_count, sizeof(*file_names));
+ bool *is_dirty         = calloc(options->input_count, sizeof(*is_dirty));
+ 
+ for (int i = 0;
+      i < options->input_count;
+      ++i)
+ {
+  watch_descriptors[i] = _lcddl_watch_parent_directory(inotify_fd, options->input_paths[i], &file_names[i]);
+ }
+ 
+ int *user_layer_watch_descriptors = calloc(options->user_layer_count, sizeof(*user_layer_watch_descriptors));
+ char **user_layer_names           = calloc(options->user_layer_count, sizeof(*user_layer_names));
+ bool *is_user_layer_dirty         = calloc(options->user_layer_count, sizeof(*is_user_layer_dirty));
+ 
+ // NOTE(tbt): a built in user layer can not be reloaded
+#if !defined(LCDDL_STATIC_USER_LAYER)
+ for (int i = 0;
+      i < options->user_layer_count;
+      ++i)
+ {
+  user_layer_watch_descriptors[i] = _lcddl_watch_parent_directory(inotify_fd, options->user_layer_paths[i], &user_layer_names[i]);
+ }
+#endif
+ 
+ fprintf(stderr, "lcddl: watching %d input files and %d user layers\n", options->input_count, options->user_layer_count);
+ 
+ char events[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+ 
+ for (;;)
+ {
+  // NOTE(tbt): block until something changes, then keep draining for a couple of milliseconds so
+  //            that a burst of events from one save only causes one run
+  int timeout = -1;
+  bool any_dirty = false;
+  bool any_user_layer_dirty = false;
+  unsigned long long change_time = 0;
+  struct pollfd poll_fd = { .fd = inotify_fd, .events = POLLIN };
+  
+  while (poll(&poll_fd, 1, timeout) > 0)
+  {
+   long long bytes_read = read(inotify_fd, events, sizeof(events));
+   if (bytes_read <= 0)
+   {
+    break;
+   }
+   
+   for (char *cursor = events;
+        cursor < events + bytes_read;
+        cursor += sizeof(struct inotify_event) + ((struct inotify_event *)cursor)->len)
+   {
+    struct inotify_event *event = (struct inotify_event *)cursor;
+    if (!event->len)
+    {
+     continue;
+    }
+    
+    for (int i = 0;
+         i < options->user_layer_count;
+         ++i)
+    {
+     if (user_layer_watch_descriptors[i] == event->wd &&
+         0 == strcmp(user_layer_names[i], event->name))
+     {
+      is_user_layer_dirty[i] = true;
+      any_user_layer_dirty   = true;
+     }
+    }
+    
+    for (int i = 0;
+         i < options->input_count;
+         ++i)
+    {
+     if (watch_descriptors[i] == event->wd &&
+         0 == strcmp(file_names[i], event->name))
+     {
+      is_dirty[i] = true;
+      any_dirty   = true;
+     }
+    }
+   }
+   
+   timeout = (any_dirty || any_user_layer_dirty) ? 2 : -1;
+   if (timeout >= 0 && !change_time)
+   {
+    change_time = _lcddl_get_time();
+   }
+  }
+  unsigned long long rebuild_start_time = _lcddl_get_time();
+  
+  for (int i = 0;
+       i < options->user_layer_count;
+       ++i)
+  {
+   if (is_user_layer_dirty[i])
+   {
+    // NOTE(tbt): keep using the old layer if the new one can not be loaded, e.g. if it is only half written
+    _LcddlUserLayer new_user_layer = get_user_callback_functions(options->user_layer_paths[i], true);
+    if (new_user_layer.callback)
+    {
+     fprintf(stderr, "lcddl: reloaded user layer '%s'\n", options->user_layer_paths[i]);
+     unload_user_layer(&user_layers[i]);
+     user_layers[i] = new_user_layer;
+    }
+    is_user_layer_dirty[i] = false;
+   }
+  }
+  
+  if (any_dirty || any_user_layer_dirty)
+  {
+   for (int i = 0;
+        i < options->input_count;
+        ++i)
+   {
+    if (is_dirty[i])
+    {
+     fprintf(stderr, "lcddl: '%s' changed\n", options->input_paths[i]);
+     LcddlNode *file = _lcddl_parse_input(options, options->input_paths[i]);
+     if (file)
+     {
+      _lcddl_replace_file_in_root(input_files[i], file);
+      _lcddl_free_tree(input_files[i]);
+      input_files[i] = file;
+     }
+     else
+     {
+      fprintf(stderr, "lcddl: keeping the last version of '%s' which parsed\n", options->input_paths[i]);
+     }
+     is_dirty[i] = false;
+    }
+   }
+   
+   unsigned int duplicate_count = _lcddl_report_duplicate_declarations();
+   _lcddl_clear_diagnostics();
+   
+   if (duplicate_count)
+   {
+    fprintf(stderr, "lcddl: %u top-level declarations have the same name as another, not running user layers\n", duplicate_count);
+   }
+   else
+   {
+    _lcddl_run_user_layers(options, user_layers);
+   }
+   
+   // NOTE(tbt): measured from when the first event was read, so the time the kernel took to deliver it is
+   //            not included. the wait is the 2ms spent draining any further events from the same save
+   unsigned long long end_time = _lcddl_get_time();
+   fprintf(stderr,
+           "lcddl: rebuilt in %.2fms after the change was seen (%.2fms waiting for further changes)\n",
+           (end_time - change_time) * 1e-6,
+           (rebuild_start_time - change_time) * 1e-6);
+  }
+ }
+}
+#endif
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) && !defined(__NT__)
+// NOTE(tbt): the daemon keeps every file it has parsed in memory, keyed by absolute path. a file is
+//            a hit if its mtime and size are unchanged, or failing that if its contents hash the same.
+//            each request is run in a forked child with its output going straight to the client, so a
+//            syntax error or a crashing user layer only ever takes down that one request. the child
+//            parses any misses and sends them back to the daemon as binary images to be cached.
+//            user layers are loaded once by the daemon and so are already mapped in every child.
+//            the daemon never blocks on a client or a child, so requests run side by side - see `_lcddl_serve`
+//
+//            a request is the client's working directory, the user layer path, the depfile path (empty
+//            if none) and then each input path, all NUL terminated. the client then shuts down its end
+//            for writing. the response is the output of the request followed by a NUL and the exit status
+
+typedef struct
+{
+ char *path; // absolute. NULL if the slot is empty
+ long long mtime_seconds;
+ long long mtime_nanoseconds;
+ long long size;
+ unsigned long long hash;
+ LcddlNode *file;
+ LcddlSource *source; // the text `file` was parsed from, so that hits have locations
+} _LcddlServerFile;
+
+typedef struct
+{
+ char *path; // absolute
+ long long mtime_seconds;
+ long long mtime_nanoseconds;
+ _LcddlUserLayer layer;
+} _LcddlServerLayer;
+
+typedef enum
+{
+ SERVER_REQUEST_STATE_none,       // the slot is free
+ SERVER_REQUEST_STATE_reading,    // the request is still being read from the client
+ SERVER_REQUEST_STATE_running,    // a child is running the request
+ SERVER_REQUEST_STATE_responding, // the trailer, or an error, is being sent to the client
+} _LcddlServerRequestState;
+
+typedef struct
+{
+ _LcddlServerRequestState state;
+ int client;
+ LcddlWriter request; // everything read from the client so far
+ 
+ pid_t child;         // 0 once the child has been reaped
+ int exit_status;
+ int image_pipe;      // -1 once everything the child sent back has been read
+ LcddlWriter images;
+ int input_count;
+ char **miss_paths;   // absolute path of each input the child parses and sends back, NULL for the others
+ unsigned long long *hashes;
+ struct stat *statuses;
+ LcddlSource **sources;
+ 
+ LcddlWriter response;
+ unsigned long long response_sent;
+} _LcddlServerRequest;
+
+typedef struct
+{
+ _LcddlServerFile *files;
+ unsigned int file_count;
+ unsigned int file_capacity; // always a power of 2
+ 
+ _LcddlServerLayer *layers;
+ unsigned int layer_count;
+ unsigned int layer_capacity;
+ 
+ int listener;
+ int wake_pipe[2]; // written to whenever a child exits
+ _LcddlServerRequest *requests;
+ unsigned int request_capacity;
+} _LcddlServer;
+
+// NOTE(tbt): each image is followed by `padding` zero bytes so that the next header, and the image after it,
+//            start 8 byte aligned in the buffer the daemon reads them into
+typedef struct
+{
+ unsigned int input_index;
+ unsigned int padding;
+ unsigned long long size;
+} _LcddlServerImageHeader;
+
+static bool
+_lcddl_write_all(int fd,
+                 char *buffer,
+                 unsigned long long size)
+{
+ while (size)
+ {
+  ssize_t bytes_written = write(fd, buffer, size);
+  if (bytes_written <= 0)
+  {
+   return false;
+  }
+  buffer += bytes_written;
+  size   -= bytes_written;
+ }
+ return true;
+}
+
+// NOTE(tbt): reads until end of file. the result is NUL terminated, but the terminator is not included in `size`
+static char *
+_lcddl_read_all(int fd,
+                unsigned long long *size)
+{
+ LcddlWriter writer = lcddl_writer_for_memory();
+ char buffer[4096];
+ ssize_t bytes_read;
+ while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0)
+ {
+  lcddl_writer_write(&writer, buffer, bytes_read);
+ }
+ *size = writer.size;
+ return lcddl_writer_close(&writer);
+}
+
+static char *
+_lcddl_make_absolute_path(char *working_directory,
+                          char *path)
+{
+ char *result = calloc(1, strlen(working_directory) + strlen(path) + 2);
+ if ('/' == path[0])
+ {
+  strcpy(result, path);
+ }
+ else
+ {
+  sprintf(result, "%s/%s", working_directory, path);
+ }
+ return result;
+}
+
+static void
+_lcddl_get_mtime(struct stat *status,
+                 long long *seconds,
+                 long long *nanoseconds)
+{
+ *seconds = status->st_mtime;
+#if defined(__APPLE__)
+ *nanoseconds = status->st_mtimespec.tv_nsec;
+#else
+ *nanoseconds = status->st_mtim.tv_nsec;
+#endif
+}
+
+static _LcddlServerFile *
+_lcddl_server_find_file(_LcddlServer *server,
+                        char *path)
+{
+ if (2 * (server->file_count + 1) > server->file_capacity)
+ {
+  _LcddlServerFile *old_files   = server->files;
+  unsigned int old_capacity     = server->file_capacity;
+  server->file_capacity         = old_capacity ? 2 * old_capacity : 64;
+  server->files                 = calloc(server->file_capacity, sizeof(*server->files));
+  for (unsigned int i = 0;
+       i < old_capacity;
+       ++i)
+  {
+   if (old_files[i].path)
+   {
+    unsigned long long slot = _lcddl_hash_bytes(old_files[i].path, strlen(old_files[i].path));
+    while (server->files[slot & (server->file_capacity - 1)].path)
+    {
+     slot += 1;
+    }
+    server->files[slot & (server->file_capacity - 1)] = old_files[i];
+   }
+  }
+  free(old_files);
+ }
+ 
+ unsigned long long slot = _lcddl_hash_bytes(path, strlen(path));
+ _LcddlServerFile *result;
+ for (;;)
+ {
+  result = &server->files[slot & (server->file_capacity - 1)];
+  if (!result->path ||
+      0 == strcmp(result->path, path))
+  {
+   break;
+  }
+  slot += 1;
+ }
+ 
+ if (!result->path)
+ {
+  result->path = calloc(1, strlen(path) + 1);
+  strcpy(result->path, path);
+  server->file_count += 1;
+ }
+ 
+ return result;
+}
+
+// NOTE(tbt): reloads the layer if it has been rebuilt since it was last loaded
+static _LcddlUserLayer *
+_lcddl_server_find_layer(_LcddlServer *server,
+                         char *path)
+{
+ struct stat status;
+ if (0 != stat(path, &status))
+ {
+  return NULL;
+ }
+ long long mtime_seconds, mtime_nanoseconds;
+ _lcddl_get_mtime(&status, &mtime_seconds, &mtime_nanoseconds);
+ 
+ _LcddlServerLayer *result = NULL;
+ for (unsigned int i = 0;
+      i < server->layer_count;
+      ++i)
+ {
+  if (0 == strcmp(server->layers[i].path, path))
+  {
+   result = &server->layers[i];
+   break;
+  }
+ }
+ 
+ if (!result)
+ {
+  if (server->layer_count == server->layer_capacity)
+  {
+   server->layer_capacity = server->layer_capacity ? 2 * server->layer_capacity : 8;
+   server->layers         = realloc(server->layers, server->layer_capacity * sizeof(*server->layers));
+  }
+  result = &server->layers[server->layer_count++];
+  memset(result, 0, sizeof(*result));
+  result->path = calloc(1, strlen(path) + 1);
+  strcpy(result->path, path);
+ }
+ 
+ if (!result->layer.callback ||
+     result->mtime_seconds != mtime_seconds ||
+     result->mtime_nanoseconds != mtime_nanoseconds)
+ {
+  unload_user_layer(&result->layer);
+  result->layer             = get_user_callback_functions(path, true);
+  result->mtime_seconds     = mtime_seconds;
+  result->mtime_nanoseconds = mtime_nanoseconds;
+ }
+ 
+ return result->layer.callback ? &result->layer : NULL;
+}
+
+// NOTE(tbt): responses are queued and sent as the client is ready for them, so that a client which
+//            stops reading only ever holds up its own request
+static void
+_lcddl_server_respond(_LcddlServerRequest *request,
+                      char *data,
+                      unsigned long long size)
+{
+ lcddl_writer_write(&request->response, data, size);
+ request->state = SERVER_REQUEST_STATE_responding;
+}
+
+static void
+_lcddl_server_respond_with_error(_LcddlServerRequest *request,
+                                 char *message,
+                                 char *argument)
+{
+ char buffer[4096];
+ int length = snprintf(buffer, sizeof(buffer) - 2, "ERROR: %s '%s'\n", message, argument);
+ if (length > (int)sizeof(buffer) - 3)
+ {
+  length = sizeof(buffer) - 3;
+ }
+ buffer[length++] = 0;
+ buffer[length++] = EXIT_FAILURE;
+ _lcddl_server_respond(request, buffer, length);
+}
+
+static void
+_lcddl_server_free_request(_LcddlServerRequest *request)
+{
+ if (request->client >= 0)
+ {
+  close(request->client);
+ }
+ if (request->image_pipe >= 0)
+ {
+  close(request->image_pipe);
+ }
+ for (int i = 0;
+      i < request->input_count;
+      ++i)
+ {
+  free(request->miss_paths[i]);
+  _lcddl_free_source(request->sources[i]);
+ }
+ free(request->miss_paths);
+ free(request->hashes);
+ free(request->statuses);
+ free(request->sources);
+ free(request->request.buffer);
+ free(request->images.buffer);
+ free(request->response.buffer);
+ 
+ memset(request, 0, sizeof(*request));
+ request->client     = -1;
+ request->image_pipe = -1;
+}
+
+// NOTE(tbt): called once the whole request has been read. works out which inputs are hits, then forks a
+//            child to run the request. the child's output goes straight to the client, and its images come
+//            back through `image_pipe`, which is polled along with everything else
+static void
+_lcddl_server_start_request(_LcddlServer *server,
+                            unsigned int request_index,
+                            char *request_buffer,
+                            unsigned long long request_size)
+{
+ _LcddlServerRequest *request = &server->requests[request_index];
+ int client                   = request->client;
+ 
+ int field_count = 0;
+ for (unsigned long long i = 0;
+      i < request_size;
+      ++i)
+ {
+  field_count += (0 == request_buffer[i]);
+ }
+ if (field_count < 4 ||
+     (request_size && request_buffer[request_size - 1]))
+ {
+  _lcddl_server_respond_with_error(request, "Malformed request", "");
+  return;
+ }
+ 
+ char **fields = calloc(field_count, sizeof(*fields));
+ char *field   = request_buffer;
+ for (int i = 0;
+      i < field_count;
+      ++i)
+ {
+  fields[i]  = field;
+  field     += strlen(field) + 1;
+ }
+ 
+ _LcddlOptions options        = {0};
+ char *working_directory      = fields[0];
+ options.user_layer_paths     = &fields[1];
+ options.user_layer_count     = 1;
+ options.job_count            = 1;
+ options.depfile_path         = fields[2][0] ? fields[2] : NULL;
+ options.input_paths          = &fields[3];
+ options.input_count          = field_count - 3;
+ 
+ char *layer_path            = _lcddl_make_absolute_path(working_directory, options.user_layer_paths[0]);
+ _LcddlUserLayer *user_layer = _lcddl_server_find_layer(server, layer_path);
+ free(layer_path);
+ if (!user_layer)
+ {
+  _lcddl_server_respond_with_error(request, "Could not load user layer", options.user_layer_paths[0]);
+  free(fields);
+  return;
+ }
+ 
+ // NOTE(tbt): other requests may add files to the cache while this one runs, moving the entries, so only
+ //            the child, which has its own copy of the cache, keeps pointers to them. the daemon finds the
+ //            entries for the misses again by path once the child's images come back
+ _LcddlServerFile **entries = calloc(options.input_count, sizeof(*entries));
+ char **contents            = calloc(options.input_count, sizeof(*contents));
+ unsigned long long *sizes  = calloc(options.input_count, sizeof(*sizes));
+ bool *is_hit               = calloc(options.input_count, sizeof(*is_hit));
+ unsigned int hits          = 0;
+ unsigned int misses        = 0;
+ request->input_count       = options.input_count;
+ request->miss_paths        = calloc(options.input_count, sizeof(*request->miss_paths));
+ request->hashes            = calloc(options.input_count, sizeof(*request->hashes));
+ request->statuses          = calloc(options.input_count, sizeof(*request->statuses));
+ request->sources           = calloc(options.input_count, sizeof(*request->sources));
+ 
+ for (int i = 0;
+      i < options.input_count;
+      ++i)
+ {
+  char *path = _lcddl_make_absolute_path(working_directory, options.input_paths[i]);
+ 
+  struct stat status;
+  if (0 == stat(path, &status))
+  {
+   long long mtime_seconds, mtime_nanoseconds;
+   _lcddl_get_mtime(&status, &mtime_seconds, &mtime_nanoseconds);
+ 
+   _LcddlServerFile *entry = _lcddl_server_find_file(server, path);
+   if (entry->file &&
+       entry->mtime_seconds == mtime_seconds &&
+       entry->mtime_nanoseconds == mtime_nanoseconds &&
+       entry->size == status.st_size)
+   {
+    is_hit[i] = true;
+   }
+   else
+   {
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0)
+    {
+     contents[i]         = _lcddl_read_all(fd, &sizes[i]);
+     request->hashes[i]  = _lcddl_hash_bytes(contents[i], sizes[i]);
+     close(fd);
+ 
+     // NOTE(tbt): touched but not changed
+     if (entry->file &&
+         entry->hash == request->hashes[i])
+     {
+      entry->mtime_seconds     = mtime_seconds;
+      entry->mtime_nanoseconds = mtime_nanoseconds;
+      entry->size              = status.st_size;
+      is_hit[i]                = true;
+     }
+     else
+     {
+      // NOTE(tbt): the entry is only updated once the child has successfully parsed the new contents
+      request->miss_paths[i] = path;
+      request->statuses[i]   = status;
+      path                   = NULL;
+     }
+    }
+   }
+ 
+   if (is_hit[i])
+   {
+    entries[i] = entry;
+   }
+  }
+ 
+  hits   += is_hit[i];
+  misses += !is_hit[i];
+  free(path);
+ }
+ 
+ int image_pipe[2] = { -1, -1 };
+ pid_t child       = -1;
+ if (0 == pipe(image_pipe))
+ {
+  fflush(NULL);
+  child = fork();
+ }
+ 
+ if (0 == child)
+ {
+  // NOTE(tbt): only this request's client and image pipe are kept open, so that other clients see their
+  //            connections close as soon as the daemon is done with them
+  signal(SIGCHLD, SIG_DFL);
+  close(server->listener);
+  close(server->wake_pipe[0]);
+  close(server->wake_pipe[1]);
+  for (unsigned int i = 0;
+       i < server->request_capacity;
+       ++i)
+  {
+   if (i != request_index &&
+       server->requests[i].state != SERVER_REQUEST_STATE_none)
+   {
+    close(server->requests[i].client);
+    if (server->requests[i].image_pipe >= 0)
+    {
+     close(server->requests[i].image_pipe);
+    }
+   }
+  }
+ 
+  close(image_pipe[0]);
+  dup2(client, STDOUT_FILENO);
+  dup2(client, STDERR_FILENO);
+  if (0 != chdir(working_directory))
+  {
+   fprintf(stderr, "ERROR: Could not change directory to '%s'\n", working_directory);
+   _exit(EXIT_FAILURE);
+  }
+ 
+  _lcddl_global_root       = calloc(1, sizeof *_lcddl_global_root);
+  _lcddl_global_root->kind = LCDDL_NODE_KIND_root;
+ 
+  int error_count = 0;
+  for (int i = 0;
+       i < options.input_count;
+       ++i)
+  {
+   LcddlNode *file = NULL;
+ 
+   if (is_hit[i] &&
+       entries[i]->file)
+   {
+    // NOTE(tbt): the cached tree may have been parsed for another client, under another relative path.
+    //            this is the child's own copy of it, so it can be relinked and renamed freely. it is
+    //            taken out of the cache so that an input given twice is not linked in twice
+    file                = entries[i]->file;
+    file->file.source   = entries[i]->source;
+    entries[i]->file    = NULL;
+    entries[i]->source  = NULL;
+    _lcddl_free_string(file->file.filename);
+    file->file.filename = _lcddl_copy_string(options.input_paths[i], strlen(options.input_paths[i]));
+    if (!file->file.filename)
+    {
+     _lcddl_push_out_of_memory_diagnostic(options.input_paths[i]);
+     _lcddl_free_tree(file);
+     file = NULL;
+    }
+    else
+    {
+     // NOTE(tbt): the hash of a file covers its filename
+     file->hash = _lcddl_hash_node(file);
+    }
+   }
+   else if (contents[i])
+   {
+    _LcddlStream stream = _lcddl_make_memory_stream(contents[i], sizes[i], options.input_paths[i]);
+    file                = _lcddl_parse_stream(&stream);
+    _lcddl_free_stream(&stream);
+ 
+    if (file)
+    {
+     LcddlWriter writer = lcddl_writer_for_memory();
+     _lcddl_serialise_tree(file, &writer);
+     char zeroes[8]                 = {0};
+     _LcddlServerImageHeader header = {0};
+     header.input_index             = i;
+     header.padding                 = (8 - writer.size % 8) % 8;
+     header.size                    = writer.size;
+     _lcddl_write_all(image_pipe[1], (char *)&header, sizeof(header));
+     _lcddl_write_all(image_pipe[1], writer.buffer, writer.size);
+     _lcddl_write_all(image_pipe[1], zeroes, header.padding);
+     free(lcddl_writer_close(&writer));
+    }
+   }
+   else
+   {
+    _LcddlStream stream = _lcddl_load_entire_file_as_stream(options.input_paths[i]);
+    file                = _lcddl_parse_stream(&stream);
+    _lcddl_free_stream(&stream);
+   }
+ 
+   if (file)
+   {
+    _lcddl_push_file_to_root(file);
+   }
+   else
+   {
+    error_count += 1;
+   }
+  }
+  close(image_pipe[1]);
+ 
+  if (error_count)
+  {
+   fprintf(stderr, "lcddl: %d of %d inputs could not be parsed\n", error_count, options.input_count);
+   fflush(NULL);
+   _exit(EXIT_FAILURE);
+  }
+ 
+  unsigned int duplicate_count = _lcddl_report_duplicate_declarations();
+  if (duplicate_count)
+  {
+   fprintf(stderr, "lcddl: %u top-level declarations have the same name as another\n", duplicate_count);
+   fflush(NULL);
+   _exit(EXIT_FAILURE);
+  }
+ 
+  bool is_output_written = _lcddl_run_user_layers(&options, user_layer);
+  fflush(stdout);
+  fprintf(stderr, "lcddl: daemon cache %u hits, %u misses\n", hits, misses);
+ 
+  fflush(NULL);
+  _exit(is_output_written ? EXIT_SUCCESS : EXIT_FAILURE);
+ }
+ 
+ if (image_pipe[1] >= 0)
+ {
+  close(image_pipe[1]);
+ }
+ 
+ if (child > 0)
+ {
+  request->state      = SERVER_REQUEST_STATE_running;
+  request->child      = child;
+  request->image_pipe = image_pipe[0];
+  
+  // NOTE(tbt): the text of each miss is kept to go in the cache along with its image
+  for (int i = 0;
+       i < options.input_count;
+       ++i)
+  {
+   if (request->miss_paths[i])
+   {
+    _LcddlStream stream = {0};
+    stream.buffer       = contents[i];
+    stream.size         = sizes[i];
+    request->sources[i] = _lcddl_take_source(&stream);
+   }
+  }
+ }
+ else
+ {
+  fprintf(stderr, "ERROR: Could not fork to handle request from '%s'\n", working_directory);
+  if (image_pipe[0] >= 0)
+  {
+   close(image_pipe[0]);
+  }
+  char trailer[2] = { 0, EXIT_FAILURE };
+  _lcddl_server_respond(request, trailer, sizeof(trailer));
+ }
+ 
+ for (int i = 0;
+      i < options.input_count;
+      ++i)
+ {
+  free(contents[i]);
+ }
+ free(contents);
+ free(sizes);
+ free(is_hit);
+ free(entries);
+ free(fields);
+}
+
+// NOTE(tbt): called once the child has been reaped and everything it sent back has been read. the images
+//            of the inputs it parsed replace their entries in the cache
+static void
+_lcddl_server_finish_request(_LcddlServer *server,
+                             _LcddlServerRequest *request)
+{
+ char *images                   = request->images.buffer;
+ unsigned long long images_size = request->images.size;
+ for (unsigned long long offset = 0;
+      offset + sizeof(_LcddlServerImageHeader) <= images_size;)
+ {
+  _LcddlServerImageHeader header;
+  memcpy(&header, images + offset, sizeof(header));
+  offset += sizeof(header);
+  if (header.size > images_size - offset                       ||
+      header.padding > images_size - offset - header.size      ||
+      header.input_index >= (unsigned int)request->input_count ||
+      !request->miss_paths[header.input_index])
+  {
+   break;
+  }
+ 
+  LcddlNode *file = _lcddl_deserialise_tree(images + offset, header.size);
+  if (file)
+  {
+   unsigned int i          = header.input_index;
+   _LcddlServerFile *entry = _lcddl_server_find_file(server, request->miss_paths[i]);
+   _lcddl_free_tree(entry->file);
+   _lcddl_free_source(entry->source);
+   entry->file         = file;
+   entry->source       = request->sources[i];
+   request->sources[i] = NULL;
+   entry->hash         = request->hashes[i];
+   entry->size         = request->statuses[i].st_size;
+   _lcddl_get_mtime(&request->statuses[i], &entry->mtime_seconds, &entry->mtime_nanoseconds);
+  }
+  offset += header.size + header.padding;
+ }
+ 
+ char trailer[2] = { 0, (char)request->exit_status };
+ _lcddl_server_respond(request, trailer, sizeof(trailer));
+}
+
+static bool
+_lcddl_make_socket_address(char *socket_path,
+                           struct sockaddr_un *address)
+{
+ memset(address, 0, sizeof(*address));
+ address->sun_family = AF_UNIX;
+ if (strlen(socket_path) >= sizeof(address->sun_path))
+ {
+  fprintf(stderr, "ERROR: Socket path '%s' is too long\n", socket_path);
+  return false;
+ }
+ strcpy(address->sun_path, socket_path);
+ return true;
+}
+
+// NOTE(tbt): children are reaped from the poll loop. the handler only wakes it up
+static int _lcddl_server_wake_fd = -1;
+
+static void
+_lcddl_server_handle_child_exit(int signal_number)
+{
+ (void)signal_number;
+ int saved_errno = errno;
+ char byte       = 0;
+ ssize_t result  = write(_lcddl_server_wake_fd, &byte, 1);
+ (void)result;
+ errno = saved_errno;
+}
+
+// NOTE(tbt): a single thread polls the listener, every client whose request is still being read or whose
+//            response is still being sent, and the image pipe of every running child. nothing in the loop
+//            waits on any one client or child, so requests run side by side
+static int
+_lcddl_serve(char *socket_path)
+{
+ // NOTE(tbt): a client going away mid-request should not take the daemon with it
+ signal(SIGPIPE, SIG_IGN);
+ 
+ struct sockaddr_un address;
+ if (!_lcddl_make_socket_address(socket_path, &address))
+ {
+  return EXIT_FAILURE;
+ }
+ 
+ _LcddlServer server = {0};
+ server.listener     = socket(AF_UNIX, SOCK_STREAM, 0);
+ unlink(socket_path);
+ if (server.listener < 0 ||
+     0 != bind(server.listener, (struct sockaddr *)&address, sizeof(address)) ||
+     0 != listen(server.listener, 64) ||
+     0 != pipe(server.wake_pipe))
+ {
+  fprintf(stderr, "ERROR: Could not listen on '%s'\n", socket_path);
+  return EXIT_FAILURE;
+ }
+ fcntl(server.listener, F_SETFL, fcntl(server.listener, F_GETFL) | O_NONBLOCK);
+ fcntl(server.wake_pipe[0], F_SETFL, fcntl(server.wake_pipe[0], F_GETFL) | O_NONBLOCK);
+ fcntl(server.wake_pipe[1], F_SETFL, fcntl(server.wake_pipe[1], F_GETFL) | O_NONBLOCK);
+ 
+ _lcddl_server_wake_fd = server.wake_pipe[1];
+ struct sigaction action;
+ memset(&action, 0, sizeof(action));
+ action.sa_handler = _lcddl_server_handle_child_exit;
+ action.sa_flags   = SA_RESTART | SA_NOCLDSTOP;
+ sigemptyset(&action.sa_mask);
+ sigaction(SIGCHLD, &action, NULL);
+ 
+ fprintf(stderr, "lcddl: serving on '%s'\n", socket_path);
+ 
+ struct pollfd *poll_fds     = NULL;
+ unsigned int *poll_requests = NULL; // the request each entry of `poll_fds` belongs to, past the first 2
+ unsigned int poll_capacity  = 0;
+ for (;;)
+ {
+  if (poll_capacity < server.request_capacity + 2)
+  {
+   poll_capacity = server.request_capacity + 2;
+   poll_fds      = realloc(poll_fds, poll_capacity * sizeof(*poll_fds));
+   poll_requests = realloc(poll_requests, poll_capacity * sizeof(*poll_requests));
+  }
+ 
+  unsigned int poll_count = 0;
+  poll_fds[poll_count++]  = (struct pollfd){ .fd = server.listener, .events = POLLIN };
+  poll_fds[poll_count++]  = (struct pollfd){ .fd = server.wake_pipe[0], .events = POLLIN };
+  for (unsigned int i = 0;
+       i < server.request_capacity;
+       ++i)
+  {
+   _LcddlServerRequest *request = &server.requests[i];
+   struct pollfd poll_fd        = { .fd = -1 };
+   if (request->state == SERVER_REQUEST_STATE_reading)
+   {
+    poll_fd = (struct pollfd){ .fd = request->client, .events = POLLIN };
+   }
+   else if (request->state == SERVER_REQUEST_STATE_running &&
+            request->image_pipe >= 0)
+   {
+    poll_fd = (struct pollfd){ .fd = request->image_pipe, .events = POLLIN };
+   }
+   else if (request->state == SERVER_REQUEST_STATE_responding)
+   {
+    poll_fd = (struct pollfd){ .fd = request->client, .events = POLLOUT };
+   }
+ 
+   if (poll_fd.fd >= 0)
+   {
+    poll_requests[poll_count] = i;
+    poll_fds[poll_count++]    = poll_fd;
+   }
+  }
+ 
+  if (poll(poll_fds, poll_count, -1) < 0)
+  {
+   continue;
+  }
+ 
+  for (unsigned int i = 2;
+       i < poll_count;
+       ++i)
+  {
+   if (!poll_fds[i].revents)
+   {
+    continue;
+   }
+ 
+   _LcddlServerRequest *request = &server.requests[poll_requests[i]];
+   char buffer[4096];
+   if (request->state == SERVER_REQUEST_STATE_reading)
+   {
+    // NOTE(tbt): the client shuts down its end once the whole request has been sent
+    ssize_t bytes_read = read(request->client, buffer, sizeof(buffer));
+    if (bytes_read > 0)
+    {
+     lcddl_writer_write(&request->request, buffer, bytes_read);
+    }
+    else if (0 == bytes_read)
+    {
+     unsigned long long request_size = request->request.size;
+     char *request_buffer            = lcddl_writer_close(&request->request);
+     _lcddl_server_start_request(&server, poll_requests[i], request_buffer, request_size);
+     free(request_buffer);
+    }
+    else if (errno != EINTR &&
+             errno != EAGAIN)
+    {
+     _lcddl_server_free_request(request);
+    }
+   }
+   else if (request->state == SERVER_REQUEST_STATE_running)
+   {
+    ssize_t bytes_read = read(request->image_pipe, buffer, sizeof(buffer));
+    if (bytes_read > 0)
+    {
+     lcddl_writer_write(&request->images, buffer, bytes_read);
+    }
+    else if (0 == bytes_read ||
+             (errno != EINTR && errno != EAGAIN))
+    {
+     close(request->image_pipe);
+     request->image_pipe = -1;
+    }
+   }
+   else if (request->state == SERVER_REQUEST_STATE_responding)
+   {
+    ssize_t bytes_sent = send(request->client,
+                              request->response.buffer + request->response_sent,
+                              request->response.size - request->response_sent,
+                              MSG_DONTWAIT);
+    if (bytes_sent > 0)
+    {
+     request->response_sent += bytes_sent;
+    }
+    if (request->response_sent == request->response.size ||
+        (bytes_sent < 0 && errno != EINTR && errno != EAGAIN))
+    {
+     _lcddl_server_free_request(request);
+    }
+   }
+  }
+ 
+  if (poll_fds[1].revents)
+  {
+   char buffer[64];
+   while (read(server.wake_pipe[0], buffer, sizeof(buffer)) > 0);
+ 
+   pid_t child;
+   int wait_status;
+   while ((child = waitpid(-1, &wait_status, WNOHANG)) > 0)
+   {
+    for (unsigned int i = 0;
+         i < server.request_capacity;
+         ++i)
+    {
+     _LcddlServerRequest *request = &server.requests[i];
+     if (request->state == SERVER_REQUEST_STATE_running &&
+         request->child == child)
+     {
+      request->child       = 0;
+      request->exit_status = WIFEXITED(wait_status) ? WEXITSTATUS(wait_status) : EXIT_FAILURE;
+      break;
+     }
+    }
+   }
+  }
+ 
+  for (unsigned int i = 0;
+       i < server.request_capacity;
+       ++i)
+  {
+   _LcddlServerRequest *request = &server.requests[i];
+   if (request->state == SERVER_REQUEST_STATE_running &&
+       !request->child &&
+       request->image_pipe < 0)
+   {
+    _lcddl_server_finish_request(&server, request);
+   }
+  }
+ 
+  if (poll_fds[0].revents)
+  {
+   int client;
+   while ((client = accept(server.listener, NULL, NULL)) >= 0)
+   {
+    // NOTE(tbt): on some platforms accepted sockets inherit the listener's O_NONBLOCK. the child writes
+    //            its output to the client with ordinary blocking writes
+    fcntl(client, F_SETFL, fcntl(client, F_GETFL) & ~O_NONBLOCK);
+    
+    unsigned int index = 0;
+    while (index < server.request_capacity &&
+           server.requests[index].state != SERVER_REQUEST_STATE_none)
+    {
+     index += 1;
+    }
+    if (index == server.request_capacity)
+    {
+     server.request_capacity = server.request_capacity ? 2 * server.request_capacity : 16;
+     server.requests         = realloc(server.requests, server.request_capacity * sizeof(*server.requests));
+     for (unsigned int i = index;
+          i < server.request_capacity;
+          ++i)
+     {
+      memset(&server.requests[i], 0, sizeof(server.requests[i]));
+      server.requests[i].client     = -1;
+      server.requests[i].image_pipe = -1;
+     }
+    }
+ 
+    _LcddlServerRequest *request = &server.requests[index];
+    request->state               = SERVER_REQUEST_STATE_reading;
+    request->client              = client;
+    request->request             = lcddl_writer_for_memory();
+    request->images              = lcddl_writer_for_memory();
+    request->response            = lcddl_writer_for_memory();
+   }
+  }
+ }
+}
+
+static int
+_lcddl_connect(_LcddlOptions *options)
+{
+ struct sockaddr_un address;
+ if (!_lcddl_make_socket_address(options->connect_socket_path, &address))
+ {
+  return EXIT_FAILURE;
+ }
+ 
+ int server = socket(AF_UNIX, SOCK_STREAM, 0);
+ if (server < 0 ||
+     0 != connect(server, (struct sockaddr *)&address, sizeof(address)))
+ {
+  fprintf(stderr, "ERROR: Could not connect to '%s'\n", options->connect_socket_path);
+  return EXIT_FAILURE;
+ }
+ 
+ char working_directory[4096];
+ if (!getcwd(working_directory, sizeof(working_directory)))
+ {
+  fprintf(stderr, "ERROR: Could not get the working directory\n");
+  return EXIT_FAILURE;
+ }
+ 
+ LcddlWriter request = lcddl_writer_for_memory();
+ lcddl_writer_write(&request, working_directory, strlen(working_directory) + 1);
+ lcddl_writer_write(&request, options->user_layer_paths[0], strlen(options->user_layer_paths[0]) + 1);
+ lcddl_writer_write(&request, options->depfile_path ? options->depfile_path : "", options->depfile_path ? strlen(options->depfile_path) + 1 : 1);
+ for (int i = 0;
+      i < options->input_count;
+      ++i)
+ {
+  lcddl_writer_write(&request, options->input_paths[i], strlen(options->input_paths[i]) + 1);
+ }
+ bool is_sent = _lcddl_write_all(server, request.buffer, request.size);
+ free(lcddl_writer_close(&request));
+ shutdown(server, SHUT_WR);
+ 
+ // NOTE(tbt): the last 2 bytes are the trailer, so always hold them back
+ char buffer[4096];
+ unsigned long long held = 0;
+ ssize_t bytes_read;
+ while (is_sent &&
+        (bytes_read = read(server, buffer + held, sizeof(buffer) - held)) > 0)
+ {
+  held += bytes_read;
+  if (held > 2)
+  {
+   fwrite(buffer, 1, held - 2, stdout);
+   memmove(buffer, buffer + held - 2, 2);
+   held = 2;
+  }
+ }
+ fflush(stdout);
+ close(server);
+ 
+ if (2 == held &&
+     0 == buffer[0])
+ {
+  return (unsigned char)buffer[1];
+ }
+ else
+ {
+  fprintf(stderr, "ERROR: Lost connection to the LCDDL daemon\n");
+  return EXIT_FAILURE;
+ }
+}
+#endif
+
+int
+main(int argc,
+     char **argv)
+{
+ _LcddlOptions options = _lcddl_parse_command_line(argc, argv);
+ 
+ _lcddl_diagnostics.is_printed = true;
+ 
+ if (options.serve_socket_path ||
+     options.connect_socket_path)
+ {
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) && !defined(__NT__)
+  return options.serve_socket_path ? _lcddl_serve(options.serve_socket_path) : _lcddl_connect(&options);
+#else
+  fprintf(stderr, "ERROR: --serve and --connect are not supported on this platform\n");
+  return EXIT_FAILURE;
+#endif
+ }
+ 
+ _lcddl_stats.is_enabled         = options.stats || options.stats_json_path;
+ _lcddl_phase_times.start_time   = _lcddl_stats.is_enabled ? _lcddl_get_time() : 0;
+ _lcddl_trace.is_enabled         = !!options.trace_path;
+ _lcddl_trace.start_time         = _lcddl_get_time();
+ _lcddl_intern_table.is_enabled  = options.intern;
+ _lcddl_memory.stats.limit_bytes = options.memory_limit;
+ 
+ _LcddlUserLayer *user_layers = calloc(options.user_layer_count, sizeof(*user_layers));
+ for (int i = 0;
+      i < options.user_layer_count;
+      ++i)
+ {
+  user_layers[i] = get_user_callback_functions(options.user_layer_paths[i], options.watch);
+  if (!user_layers[i].callback)
+  {
+   return EXIT_FAILURE;
+  }
+ }
+ if (_lcddl_stats.is_enabled)
+ {
+  _lcddl_phase_times.load_user_layers_time = _lcddl_get_time() - _lcddl_phase_times.start_time;
+ }
+ 
+ _lcddl_global_root       = calloc(1, sizeof *_lcddl_global_root);
+ _lcddl_global_root->kind = LCDDL_NODE_KIND_root;
+ 
+ if (options.cache_dir)
+ {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  CreateDirectoryA(options.cache_dir, NULL);
+#else
+  mkdir(options.cache_dir, 0777);
+#endif
+ }
+ 
+ LcddlNode **input_files = calloc(options.input_count, sizeof(*input_files));
+ 
+ // NOTE(tbt): every input is parsed even once one has failed, so that all of their errors are reported at once
+ int error_count = 0;
+ for (int i = 0;
+      i < options.input_count;
+      ++i)
+ {
+  LcddlNode *file = _lcddl_parse_input(&options, options.input_paths[i]);
+  if (file)
+  {
+   _lcddl_push_file_to_root(file);
+  }
+  else
+  {
+   error_count += 1;
+  }
+  input_files[i] = file;
+ }
+ 
+ if (error_count)
+ {
+  fprintf(stderr, "lcddl: %d of %d inputs could not be parsed\n", error_count, options.input_count);
+  return EXIT_FAILURE;
+ }
+ 
+ // NOTE(tbt): user layers would otherwise generate a definition for each of them, which would not compile
+ unsigned int duplicate_count = _lcddl_report_duplicate_declarations();
+ if (duplicate_count)
+ {
+  fprintf(stderr, "lcddl: %u top-level declarations have the same name as another\n", duplicate_count);
+  return EXIT_FAILURE;
+ }
+ 
+ if (options.shared_memory_name &&
+     !lcddl_publish_shared(_lcddl_global_root, options.shared_memory_name))
+ {
+  return EXIT_FAILURE;
+ }
+ 
+ bool is_output_written = _lcddl_run_user_layers(&options, user_layers);
+ 
+ if (options.watch)
+ {
+#if defined(__linux__)
+  _lcddl_watch(&options, user_layers, input_files);
+#else
+  fprintf(stderr, "ERROR: --watch is not supported on this platform\n");
+  return EXIT_FAILURE;
+#endif
+ }
+ 
+ return is_output_written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#else
+
+void
+lcddl_initialise(void)
+{
+ _lcddl_global_root       = calloc(1, sizeof *_lcddl_global_root);
+ _lcddl_global_root->kind = LCDDL_NODE_KIND_root;
+}
+
+LcddlNode *
+lcddl_parse_file(char *filename)
+{
+ _LcddlStream stream = _lcddl_load_entire_file_as_stream(filename);
+ LcddlNode *file     = _lcddl_parse_stream(&stream);
+ _lcddl_free_stream(&stream);
+ if (file)
+ {
+  _lcddl_push_file_to_root(file);
+ }
+ 
+ return file;
+}
+
+LcddlNode *
+lcddl_parse_from_memory(char *buffer,
+                        unsigned long long buffer_size)
+{
+ _LcddlStream stream = _lcddl_make_memory_stream(buffer, buffer_size, "memory");
+ LcddlNode *file     = _lcddl_parse_stream(&stream);
+ _lcddl_free_stream(&stream);
+ if (file)
+ {
+  _lcddl_push_file_to_root(file);
+ }
+ 
+ return file;
+}
+
+LcddlNode *
+lcddl_parse_cstring(char *string)
+{
+ return lcddl_parse_from_memory(string, strlen(string));
+}
+
+void
+lcddl_free_file(LcddlNode *root)
+{
+ if (root->kind == LCDDL_NODE_KIND_file)
+ {
+  // remove from global tree
+  _lcddl_remove_file_from_root(root);
+  
+  // free the tree
+  _lcddl_free_tree(root);
+ }
+}
+
+void
+lcddl_replace_file(LcddlNode *old_file,
+                   LcddlNode *new_file)
+{
+ if (old_file->kind == LCDDL_NODE_KIND_file &&
+     new_file->kind == LCDDL_NODE_KIND_file &&
+     old_file != new_file)
+ {
+  // NOTE(tbt): `new_file` was added to the end of the global tree when it was parsed, so taking it out is cheap
+  _lcddl_remove_file_from_root(new_file);
+  _lcddl_replace_file_in_root(old_file, new_file);
+  _lcddl_free_tree(old_file);
+ }
+}
+
+void
+lcddl_set_interning(bool is_enabled)
+{
+ _lcddl_intern_table.is_enabled = is_enabled;
+}
+
+void
+lcddl_set_allocator(LcddlAllocator allocator)
+{
+ if (_lcddl_memory.stats.live_allocations)
+ {
+  fprintf(stderr, "ERROR: The allocator can not be changed while any trees are still allocated\n");
+ }
+ else
+ {
+  _lcddl_memory.allocator = allocator;
+ }
+}
+
+void
+lcddl_set_memory_limit(unsigned long long limit_bytes)
+{
+ _lcddl_memory.stats.limit_bytes = limit_bytes;
+}
+
+unsigned int
+lcddl_diagnostic_count(void)
+{
+ return _lcddl_diagnostics.count;
+}
+
+LcddlDiagnostic *
+lcddl_diagnostic_at(unsigned int index)
+{
+ return index < _lcddl_diagnostics.count ? &_lcddl_diagnostics.diagnostics[index] : NULL;
+}
+
+void
+lcddl_clear_diagnostics(void)
+{
+ _lcddl_clear_diagnostics();
+}
+
+unsigned int
+lcddl_report_duplicate_declarations(void)
+{
+ return _lcddl_report_duplicate_declarations();
+}
+
+#endif
+
+///////////////////////////////////////////
+// WRITER
+//~
+
+#define LCDDL_WRITER_FLUSH_THRESHOLD (64 * 1024)
+
+static LcddlWriter
+_lcddl_make_writer(LcddlWriterKind kind)
+{
+ LcddlWriter result = {0};
+ result.kind        = kind;
+ result.capacity    = LCDDL_WRITER_FLUSH_THRESHOLD;
+ result.buffer      = malloc(result.capacity);
+ return result;
+}
+
+LcddlWriter
+lcddl_writer_for_file(FILE *file)
+{
+ LcddlWriter result = _lcddl_make_writer(LCDDL_WRITER_KIND_file);
+ result.file        = file;
+ return result;
+}
+
+LcddlWriter
+lcddl_writer_for_fd(int fd)
+{
+ LcddlWriter result = _lcddl_make_writer(LCDDL_WRITER_KIND_fd);
+ result.fd          = fd;
  return result;
-} 
+}
 
-static void
-_lcddl_consume_token(_LcddlStream *stream,
-                     _LcddlTokenKind required_kind)
+LcddlWriter
+lcddl_writer_for_memory(void)
 {
- if (stream->current_token.kind == required_kind)
- {
-  stream->current_token = _lcddl_get_next_token(stream);
- }
- else
- {
-  print_error_and_exit_f(stream,
-                         "Expected '%s', got '%s'",
-                         token_kind_to_string(required_kind),
-                         token_kind_to_string(stream->current_token.kind));
- }
+ return _lcddl_make_writer(LCDDL_WRITER_KIND_memory);
 }
 
-static LcddlOperatorKind
-_lcddl_token_to_operator_kind(_LcddlToken token,
-                              bool unary) // whether to use the unary or binary version if ambiguous
+LcddlWriter
+lcddl_writer_for_path(char *path)
 {
- switch (token.kind)
+ LcddlWriter result = _lcddl_make_writer(LCDDL_WRITER_KIND_path);
+ result.path        = calloc(1, strlen(path) + 1);
+ strcpy(result.path, path);
+ return result;
+}
+
+LcddlOutputSummary
+lcddl_get_output_summary(void)
+{
+ return _lcddl_output_summary;
+}
+
+void
+lcddl_writer_flush(LcddlWriter *writer)
+{
+ if (_lcddl_stats.is_enabled &&
+     writer->kind != LCDDL_WRITER_KIND_memory &&
+     writer->kind != LCDDL_WRITER_KIND_path)
  {
-  case TOKEN_KIND_tilde:
-  {
-   return LCDDL_UN_OP_KIND_bitwise_not;
-  }
-  case TOKEN_KIND_exclamation:
-  {
-   return LCDDL_UN_OP_KIND_boolean_not;
-  }
-  case TOKEN_KIND_add:
-  {
-   if (unary) { return LCDDL_UN_OP_KIND_positive; }
-   else       { return LCDDL_BIN_OP_KIND_add; }
-  }
-  case TOKEN_KIND_dash:
-  {
-   if (unary) { return LCDDL_UN_OP_KIND_negative; }
-   else       { return LCDDL_BIN_OP_KIND_subtract; }
-  }
-  case TOKEN_KIND_asterisk:
-  {
-   return LCDDL_BIN_OP_KIND_multiply;
-  }
-  case TOKEN_KIND_slash:
-  {
-   return LCDDL_BIN_OP_KIND_divide;
-  }
-  case TOKEN_KIND_lesser_than:
-  {
-   return LCDDL_BIN_OP_KIND_lesser_than;
-  }
-  case TOKEN_KIND_greater_than:
-  {
-   return LCDDL_BIN_OP_KIND_greater_than;
-  }
-  case TOKEN_KIND_lesser_than_or_equal_to:
-  {
-   return LCDDL_BIN_OP_KIND_lesser_than_or_equal_to;
-  }
-  case TOKEN_KIND_greater_than_or_equal_to:
-  {
-   return LCDDL_BIN_OP_KIND_greater_than_or_equal_to;
-  }
-  case TOKEN_KIND_equality:
-  {
-   return LCDDL_BIN_OP_KIND_equality;
-  }
-  case TOKEN_KIND_not_equal_to:
+  _lcddl_record_bytes_written(writer->size);
+ }
+ 
+ switch (writer->kind)
+ {
+  case LCDDL_WRITER_KIND_file:
   {
-   return LCDDL_BIN_OP_KIND_not_equal_to;
+   fwrite(writer->buffer, 1, writer->size, writer->file);
+   writer->size = 0;
+   break;
   }
-  case TOKEN_KIND_bit_shift_left:
+  
+  case LCDDL_WRITER_KIND_fd:
   {
-   return LCDDL_BIN_OP_KIND_bit_shift_left;
+   unsigned long long bytes_written = 0;
+   while (bytes_written < writer->size)
+   {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    long long result = _write(writer->fd, writer->buffer + bytes_written, (unsigned int)(writer->size - bytes_written));
+#else
+    long long result = write(writer->fd, writer->buffer + bytes_written, writer->size - bytes_written);
+#endif
+    if (result <= 0)
+    {
+     fprintf(stderr, "ERROR: Could not write to file descriptor %d\n", writer->fd);
+     break;
+    }
+    bytes_written += result;
+   }
+   writer->size = 0;
+   break;
   }
-  case TOKEN_KIND_bit_shift_right:
+  
+  case LCDDL_WRITER_KIND_memory:
+  case LCDDL_WRITER_KIND_path:
   {
-   return LCDDL_BIN_OP_KIND_bit_shift_right;
+   // NOTE(tbt): nothing is written until the writer is closed
+   break;
   }
-  case TOKEN_KIND_bitwise_and:
+ }
+}
+
+// NOTE(tbt): makes room for at least `size` more bytes, either by flushing or by growing the buffer
+static void
+_lcddl_writer_reserve(LcddlWriter *writer,
+                      unsigned long long size)
+{
+ if (writer->size + size > writer->capacity)
+ {
+  lcddl_writer_flush(writer);
+  
+  if (writer->size + size > writer->capacity)
   {
-   return LCDDL_BIN_OP_KIND_bitwise_and;
+   while (writer->size + size > writer->capacity)
+   {
+    writer->capacity *= 2;
+   }
+   writer->buffer = realloc(writer->buffer, writer->capacity);
   }
-  case TOKEN_KIND_bitwise_or:
+ }
+}
+
+void
+lcddl_writer_write(LcddlWriter *writer,
+                   char *data,
+                   unsigned long long size)
+{
+ _lcddl_writer_reserve(writer, size);
+ memcpy(writer->buffer + writer->size, data, size);
+ writer->size += size;
+}
+
+void
+lcddl_writer_put_char(LcddlWriter *writer,
+                      char c,
+                      unsigned int count)
+{
+ _lcddl_writer_reserve(writer, count);
+ memset(writer->buffer + writer->size, c, count);
+ writer->size += count;
+}
+
+void
+lcddl_writer_put_string(LcddlWriter *writer,
+                        char *string)
+{
+ lcddl_writer_write(writer, string, strlen(string));
+}
+
+void
+lcddl_writer_printf(LcddlWriter *writer,
+                    char *format,
+                    ...)
+{
+ va_list args;
+ va_start(args, format);
+ 
+ va_list args_copy;
+ va_copy(args_copy, args);
+ int length = vsnprintf(writer->buffer + writer->size, writer->capacity - writer->size, format, args_copy);
+ va_end(args_copy);
+ 
+ if (length >= 0)
+ {
+  if (writer->size + length + 1 > writer->capacity)
   {
-   return LCDDL_BIN_OP_KIND_bitwise_or;
+   _lcddl_writer_reserve(writer, length + 1);
+   vsnprintf(writer->buffer + writer->size, writer->capacity - writer->size, format, args);
   }
-  case TOKEN_KIND_bitwise_xor:
+  writer->size += length;
+ }
+ 
+ va_end(args);
+}
+
+char *
+lcddl_writer_close(LcddlWriter *writer)
+{
+ char *result = NULL;
+ 
+ if (writer->kind == LCDDL_WRITER_KIND_memory)
+ {
+  _lcddl_writer_reserve(writer, 1);
+  writer->buffer[writer->size] = '\0';
+  result = writer->buffer;
+ }
+ else if (writer->kind == LCDDL_WRITER_KIND_path)
+ {
+  _lcddl_trace_begin("write output", writer->path);
+  bool is_unchanged = _lcddl_does_file_match(writer->path, writer->buffer, writer->size);
+  bool is_written   = false;
+  if (!is_unchanged)
   {
-   return LCDDL_BIN_OP_KIND_bitwise_xor;
+   is_written = _lcddl_replace_file_atomically(writer->path, writer->buffer, writer->size);
+   if (is_written &&
+       _lcddl_stats.is_enabled)
+   {
+    _lcddl_record_bytes_written(writer->size);
+   }
   }
-  case TOKEN_KIND_boolean_and:
+  
+  // NOTE(tbt): a file which could not be written is not an output as far as the depfile is concerned,
+  //            so that the build system runs LCDDL again rather than trusting a stale file
+  _lcddl_mutex_lock(&_lcddl_output_mutex);
+  if (is_unchanged ||
+      is_written)
   {
-   return LCDDL_BIN_OP_KIND_boolean_and;
+   _lcddl_push_string(&_lcddl_output_paths, writer->path);
   }
-  case TOKEN_KIND_boolean_or:
+  _lcddl_output_summary.files_unchanged += is_unchanged;
+  _lcddl_output_summary.files_written   += is_written;
+  _lcddl_output_summary.files_failed    += !is_unchanged && !is_written;
+  _lcddl_mutex_unlock(&_lcddl_output_mutex);
+  _lcddl_trace_end("write output", writer->path);
+  free(writer->buffer);
+  free(writer->path);
+  writer->path = NULL;
+ }
+ else
+ {
+  lcddl_writer_flush(writer);
+  free(writer->buffer);
+ }
+ 
+ writer->buffer   = NULL;
+ writer->size     = 0;
+ writer->capacity = 0;
+ 
+ return result;
+}
+
+///////////////////////////////////////////
+// USER LAYER HELPERS
+//~
+
+unsigned int
+lcddl_child_count(LcddlNode *node)
+{
+ return node->child_count;
+}
+
+unsigned long long
+lcddl_node_hash(LcddlNode *node)
+{
+ // NOTE(tbt): files are added to and removed from the root at any time, so its hash is worked out when asked for
+ return node->kind == LCDDL_NODE_KIND_root ? _lcddl_hash_node(node) : node->hash;
+}
+
+LcddlNode *
+lcddl_child_at(LcddlNode *node,
+               unsigned int index)
+{
+ return index < node->child_count ? node->children[index] : NULL;
+}
+
+// NOTE(tbt): user layers may ask for locations from several threads at once, and the first to ask about a
+//            file builds its line table
+static _LcddlMutex _lcddl_source_mutex = LCDDL_MUTEX_INITIALISER;
+
+LcddlLocation
+lcddl_node_location(LcddlNode *file,
+                    LcddlNode *node)
+{
+ LcddlLocation result = {0};
+ result.path          = file->file.filename;
+ 
+ // NOTE(tbt): an interned node may be shared between several places, in this file or in others, and its offset
+ //            is only that of whichever was parsed first, so it has no location of its own
+ if (node->reference_count)
+ {
+  return result;
+ }
+ 
+ result.offset = node->offset;
+ 
+ LcddlSource *source = file->file.source;
+ if (source)
+ {
+  _lcddl_mutex_lock(&_lcddl_source_mutex);
+  if (!source->line_offsets)
   {
-   return LCDDL_BIN_OP_KIND_boolean_or;
+   _lcddl_build_line_offsets(source->buffer, source->size, &source->line_offsets, &source->line_count);
   }
-  default:
+  _lcddl_mutex_unlock(&_lcddl_source_mutex);
+  
+  if (source->line_offsets)
   {
-   return -1;
+   _lcddl_find_line_and_column(source->line_offsets, source->line_count, node->offset, &result.line, &result.column);
   }
  }
+ 
+ return result;
 }
 
-static bool
-_lcddl_is_token_usable_as_binary_operator(_LcddlToken token)
+LcddlNode *
+lcddl_get_annotation_value(LcddlNode *node,
+                           char *tag)
 {
- LcddlOperatorKind kind = _lcddl_token_to_operator_kind(token, false);
- if (kind == -1                          ||
-     kind <= LCDDL_BINARY_OPERATOR_BEGIN ||
-     kind >= LCDDL_BINARY_OPERATOR_END)
+ for (unsigned int i = 0;
+      i < node->annotation_count;
+      ++i)
  {
-  return false;
+  LcddlNode *a = node->annotations[i];
+  if (0 == strcmp(a->annotation.tag, tag))
+  {
+   return a->annotation.value;
+  }
  }
- return true;
+ 
+ return NULL;
 }
 
-static bool
-_lcddl_is_token_usable_as_unary_operator(_LcddlToken token)
+bool
+lcddl_does_node_have_tag(LcddlNode *node,
+                         char *tag)
 {
- LcddlOperatorKind kind = _lcddl_token_to_operator_kind(token, true);
- if (kind == -1                          ||
-     kind <= LCDDL_UNARY_OPERATOR_BEGIN ||
-     kind >= LCDDL_UNARY_OPERATOR_END)
+ for (unsigned int i = 0;
+      i < node->annotation_count;
+      ++i)
  {
-  return false;
+  if (0 == strcmp(node->annotations[i]->annotation.tag, tag))
+  {
+   return true;
+  }
  }
- return true;
+ 
+ return false;
 }
 
-///////////////////////////////////////////
-// PARSER
-//~
-
-static LcddlNode *_lcddl_parse_file(char *path);
-static LcddlNode *_lcddl_parse_statement(_LcddlStream *stream);
-static LcddlNode *_lcddl_parse_statement_list(_LcddlStream *stream);
-static LcddlNode *_lcddl_parse_annotations(_LcddlStream *stream);
-static LcddlNode *_lcddl_parse_declaration(_LcddlStream *stream);
-static LcddlNode *_lcddl_parse_type(_LcddlStream *stream);
-static LcddlNode *_lcddl_parse_binary_operator_rhs(_LcddlStream *stream, unsigned int expression_precedence, LcddlNode *lhs);
-static LcddlNode *_lcddl_parse_expression(_LcddlStream *stream);
-static LcddlNode *_lcddl_parse_parenthesis(_LcddlStream *lexer);
-static LcddlNode *_lcddl_parse_primary(_LcddlStream *stream);
-static LcddlNode *_lcddl_parse_unary_operator(_LcddlStream *stream);
-static LcddlNode *_lcddl_parse_literal(_LcddlStream *stream);
-static LcddlNode *_lcddl_parse_variable_reference(_LcddlStream *stream);
-
-static LcddlNode *
-_lcddl_parse_stream(_LcddlStream stream)
+static void
+_lcddl_write_field_as_c(LcddlNode *node,
+                        unsigned int indentation,
+                        LcddlWriter *writer)
 {
- LcddlNode *result     = calloc(1, sizeof *result);
- result->kind          = LCDDL_NODE_KIND_file;
- result->file.filename = calloc(1, strlen(stream.path) + 1);
- strcpy(result->file.filename, stream.path);
- result->first_child   = _lcddl_parse_statement_list(&stream);
+ lcddl_writer_put_char(writer, '\t', indentation);
  
- return result;
+ if (node->kind == LCDDL_NODE_KIND_declaration)
+ {
+  if (node->child_count)
+  {
+   if (!node->declaration.type->type.indirection_level &&
+       !node->declaration.type->type.array_count)
+   {
+    if (0 == strcmp(node->declaration.type->type.type_name, "struct"))
+    {
+     lcddl_writer_put_string(writer, "struct\n{\n");
+    }
+    else if (0 == strcmp(node->declaration.type->type.type_name, "union"))
+    {
+     lcddl_writer_put_string(writer, "union\n{\n");
+    }
+    else
+    {
+     lcddl_writer_printf(writer, "struct // type '%s' not available in c\n{\n", node->declaration.type->type.type_name);
+    }
+    
+    for (unsigned int i = 0;
+         i < node->child_count;
+         ++i)
+    {
+     _lcddl_write_field_as_c(node->children[i], indentation + 1, writer);
+    }
+    
+    lcddl_writer_put_string(writer, "};\n");
+   }
+   else
+   {
+    lcddl_writer_printf(writer, "// could not write field '%s' as c\n", node->declaration.name);
+   }
+  }
+  else
+  {
+   lcddl_writer_put_string(writer, node->declaration.type->type.type_name);
+   lcddl_writer_put_char(writer, ' ', 1);
+   lcddl_writer_put_char(writer, '*', node->declaration.type->type.indirection_level);
+   lcddl_writer_put_string(writer, node->declaration.name);
+   
+   if (node->declaration.type->type.array_count)
+   {
+    lcddl_writer_printf(writer, "[%u]", node->declaration.type->type.array_count);
+   }
+   
+   lcddl_writer_put_char(writer, ';', 1);
+   
+   if (node->declaration.value)
+   {
+    lcddl_writer_put_string(writer, " // c does not support initialisers in structs/unions");
+   }
+   
+   lcddl_writer_put_char(writer, '\n', 1);
+  }
+ }
+ else
+ {
+  lcddl_writer_put_string(writer, "// could not write field");
+ }
 }
 
-static LcddlNode *
-_lcddl_parse_statement(_LcddlStream *stream)
+void
+lcddl_write_node_to_writer_as_c_struct(LcddlNode *node,
+                                       LcddlWriter *writer)
 {
- LcddlNode *result      = NULL;
- LcddlNode *annotations = _lcddl_parse_annotations(stream);
+ unsigned long long start_time = _lcddl_stats.is_enabled ? _lcddl_get_time() : 0;
  
- if (stream->current_token.kind == TOKEN_KIND_identifier)
+ if (node->kind == LCDDL_NODE_KIND_declaration)
  {
-  result = _lcddl_parse_declaration(stream);
-  _lcddl_consume_token(stream, TOKEN_KIND_semicolon);
+  lcddl_writer_printf(writer,
+                      "typedef struct %s %s;\nstruct %s\n{\n",
+                      node->declaration.name,
+                      node->declaration.name,
+                      node->declaration.name);
+  
+  for (unsigned int i = 0;
+       i < node->child_count;
+       ++i)
+  {
+   _lcddl_write_field_as_c(node->children[i], 1, writer);
+  }
+  lcddl_writer_put_string(writer, "};\n\n");
  }
  else
  {
-  print_error_and_exit(stream, "Expected a statement");
+  lcddl_writer_put_string(writer, "// could not write node as struct");
  }
  
- result->first_annotation = annotations;
- return result;
+ if (_lcddl_stats.is_enabled)
+ {
+  _lcddl_record_write_helper(start_time);
+ }
 }
 
-static LcddlNode *
-_lcddl_parse_statement_list(_LcddlStream *stream)
+void
+lcddl_write_node_to_writer_as_c_enum(LcddlNode *node,
+                                     LcddlWriter *writer)
 {
- LcddlNode *result = NULL;
+ unsigned long long start_time = _lcddl_stats.is_enabled ? _lcddl_get_time() : 0;
  
- while (stream->current_token.kind == TOKEN_KIND_identifier ||
-        stream->current_token.kind == TOKEN_KIND_at_symbol)
+ if (node->kind == LCDDL_NODE_KIND_declaration)
+ {
+  lcddl_writer_put_string(writer, "typedef enum\n{\n");
+  
+  for (unsigned int i = 0;
+       i < node->child_count;
+       ++i)
+  {
+   LcddlNode *child = node->children[i];
+   if (child->kind == LCDDL_NODE_KIND_declaration)
+   {
+    lcddl_writer_printf(writer, "\t%s,\n", child->declaration.name);
+   }
+  }
+  lcddl_writer_printf(writer, "} %s;\n\n", node->declaration.name);
+ }
+ else
  {
-  LcddlNode *node    = _lcddl_parse_statement(stream);
-  node->next_sibling = result;
-  result             = node;
+  lcddl_writer_put_string(writer, "// could not write node as enum");
  }
  
- return result;
+ if (_lcddl_stats.is_enabled)
+ {
+  _lcddl_record_write_helper(start_time);
+ }
 }
 
-static LcddlNode *
-_lcddl_parse_annotations(_LcddlStream *stream)
+void
+lcddl_write_node_to_file_as_c_struct(LcddlNode *node,
+                                     FILE *file)
 {
- LcddlNode *result = NULL;
+ LcddlWriter writer = lcddl_writer_for_file(file);
+ lcddl_write_node_to_writer_as_c_struct(node, &writer);
+ lcddl_writer_close(&writer);
+}
+
+void
+lcddl_write_node_to_file_as_c_enum(LcddlNode *node,
+                                   FILE *file)
+{
+ LcddlWriter writer = lcddl_writer_for_file(file);
+ lcddl_write_node_to_writer_as_c_enum(node, &writer);
+ lcddl_writer_close(&writer);
+}
+
+LcddlSearchResult *
+lcddl_find_top_level_declaration(char *name)
+{
+ LcddlSearchResult *result = NULL;
  
- while (stream->current_token.kind == TOKEN_KIND_at_symbol)
+ // NOTE(tbt): declarations with the same name are all in one run of the symbol table, in the order they were added
+ if (_lcddl_symbol_table.count)
  {
-  _lcddl_consume_token(stream, TOKEN_KIND_at_symbol);
-  LcddlNode *annotation      = calloc(1, sizeof *annotation);
-  annotation->kind           = LCDDL_NODE_KIND_annotation;
-  annotation->annotation.tag = calloc(1, stream->current_token.len + 1);
-  strncpy(annotation->annotation.tag,
-          stream->current_token.value,
-          stream->current_token.len);
-  _lcddl_consume_token(stream, TOKEN_KIND_identifier);
-  
-  if (stream->current_token.kind == TOKEN_KIND_equals)
+  unsigned int mask            = _lcddl_symbol_table.capacity - 1;
+  unsigned long long name_hash = _lcddl_hash_bytes(name, strlen(name));
+  for (unsigned int slot = name_hash & mask;
+       NULL != _lcddl_symbol_table.symbols[slot].declaration;
+       slot = (slot + 1) & mask)
   {
-   _lcddl_consume_token(stream, TOKEN_KIND_equals);
-   annotation->annotation.value = _lcddl_parse_expression(stream);
+   if (_lcddl_symbol_has_name(&_lcddl_symbol_table.symbols[slot], name_hash, name))
+   {
+    LcddlSearchResult *search_node = calloc(1, sizeof(*search_node));
+    search_node->next = result;
+    result = search_node;
+    search_node->node = _lcddl_symbol_table.symbols[slot].declaration;
+   }
   }
-  
-  annotation->next_annotation = result;
-  result = annotation;
  }
  
  return result;
 }
 
-static LcddlNode *
-_lcddl_parse_declaration(_LcddlStream *stream)
+LcddlSearchResult *
+lcddl_find_all_top_level_declarations_with_tag(char *tag)
 {
- LcddlNode *result        = calloc(1, sizeof *result);
- result->kind             = LCDDL_NODE_KIND_declaration;
- result->declaration.name = calloc(1, stream->current_token.len + 1);
- strncpy(result->declaration.name,
-         stream->current_token.value,
-         stream->current_token.len);
- 
- _lcddl_consume_token(stream, TOKEN_KIND_identifier);
+ LcddlSearchResult *result = NULL;
  
- if (stream->current_token.kind != TOKEN_KIND_semicolon)
+ for (unsigned int i = 0;
+      i < _lcddl_global_root->child_count;
+      ++i)
  {
-  if (stream->current_token.kind == TOKEN_KIND_colon)
+  LcddlNode *file = _lcddl_global_root->children[i];
+  for (unsigned int j = 0;
+       j < file->child_count;
+       ++j)
   {
-   _lcddl_consume_token(stream, TOKEN_KIND_colon);
-   
-   if (stream->current_token.kind == TOKEN_KIND_equals)
-    // NOTE(tbt): type has been ommited - go straight to value;
-   {
-    _lcddl_consume_token(stream, TOKEN_KIND_equals);
-    result->declaration.value = _lcddl_parse_expression(stream);
-   }
-   else
+   LcddlNode *node = file->children[j];
+   if (node->kind == LCDDL_NODE_KIND_declaration &&
+       lcddl_does_node_have_tag(node, tag))
    {
-    result->declaration.type = _lcddl_parse_type(stream);
-    if (stream->current_token.kind == TOKEN_KIND_equals)
-    {
-     _lcddl_consume_token(stream, TOKEN_KIND_equals);
-     result->declaration.value = _lcddl_parse_expression(stream);
-    }
+    LcddlSearchResult *search_node = calloc(1, sizeof(*search_node));
+    search_node->next = result;
+    result = search_node;
+    search_node->node = node;
    }
   }
-  
-  if (stream->current_token.kind != TOKEN_KIND_semicolon)
-  {
-   _lcddl_consume_token(stream, TOKEN_KIND_open_curly_bracket);
-   result->first_child      = _lcddl_parse_statement_list(stream);
-   _lcddl_consume_token(stream, TOKEN_KIND_close_curly_bracket);
-  }
  }
  
  return result;
 }
 
-static LcddlNode *
-_lcddl_parse_type(_LcddlStream *stream)
+LcddlNode *
+lcddl_resolve_type(LcddlNode *type)
 {
- LcddlNode *result = calloc(1, sizeof *result);
- result->kind      = LCDDL_NODE_KIND_type;
- 
- if (stream->current_token.kind == TOKEN_KIND_open_square_bracket)
+ LcddlNode *result = NULL;
+ if (type &&
+     type->kind == LCDDL_NODE_KIND_type)
  {
-  _lcddl_consume_token(stream, TOKEN_KIND_open_square_bracket);
-  char *array_count_str = calloc(1, stream->current_token.len + 1);
-  strncpy(array_count_str,
-          stream->current_token.value,
-          stream->current_token.len);
-  _lcddl_consume_token(stream, TOKEN_KIND_integer_literal);
-  
-  result->type.array_count = strtoul(array_count_str, NULL, 10);
-  
-  _lcddl_consume_token(stream, TOKEN_KIND_close_square_bracket);
+  result = _lcddl_find_symbol(type->type.type_name);
  }
- 
- result->type.type_name = calloc(1, stream->current_token.len + 1);
- strncpy(result->type.type_name,
-         stream->current_token.value,
-         stream->current_token.len);
- _lcddl_consume_token(stream, TOKEN_KIND_identifier);
- 
- while (stream->current_token.kind == TOKEN_KIND_asterisk)
- {
-  _lcddl_consume_token(stream, TOKEN_KIND_asterisk);
-  result->type.indirection_level += 1; }
- 
  return result;
 }
 
-static LcddlNode *
-_lcddl_parse_binary_operator_rhs(_LcddlStream *stream,
-                                 unsigned int expression_precedence,
-                                 LcddlNode *lhs)
+bool
+lcddl_is_declaration_type(LcddlNode *declaration,
+                          char *type_name)
 {
- static unsigned int precedence_table[1 << 8] = 
+ if (declaration->kind == LCDDL_NODE_KIND_declaration)
  {
-  [LCDDL_BIN_OP_KIND_multiply]                 = 10,
-  [LCDDL_BIN_OP_KIND_divide]                   = 10,
-  [LCDDL_BIN_OP_KIND_add]                      = 9,
-  [LCDDL_BIN_OP_KIND_subtract]                 = 9,
-  [LCDDL_BIN_OP_KIND_bit_shift_left]           = 8,
-  [LCDDL_BIN_OP_KIND_bit_shift_right]          = 8,
-  [LCDDL_BIN_OP_KIND_lesser_than]              = 7,
-  [LCDDL_BIN_OP_KIND_lesser_than_or_equal_to]  = 7,
-  [LCDDL_BIN_OP_KIND_greater_than]             = 7,
-  [LCDDL_BIN_OP_KIND_greater_than_or_equal_to] = 7,
-  [LCDDL_BIN_OP_KIND_equality]                 = 6,
-  [LCDDL_BIN_OP_KIND_not_equal_to]             = 6,
-  [LCDDL_BIN_OP_KIND_bitwise_and]              = 5,
-  [LCDDL_BIN_OP_KIND_bitwise_xor]              = 4,
-  [LCDDL_BIN_OP_KIND_bitwise_or]               = 3,
-  [LCDDL_BIN_OP_KIND_boolean_and]              = 2,
-  [LCDDL_BIN_OP_KIND_boolean_or]               = 1,
- };
- 
- for (;;)
+  return (0 == strcmp(declaration->declaration.type->type.type_name, type_name));
+ }
+ return false;
+}
+
+double
+lcddl_evaluate_expression(LcddlNode *expression)
+{
+ switch (expression->kind)
  {
-  LcddlOperatorKind operator_kind;
-  unsigned int token_precedence;
+  case LCDDL_NODE_KIND_float_literal:
+  {
+   return strtod(expression->literal.value, NULL);
+  }
   
-  if (_lcddl_is_token_usable_as_binary_operator(stream->current_token))
+  case LCDDL_NODE_KIND_integer_literal:
   {
-   operator_kind    = _lcddl_token_to_operator_kind(stream->current_token, false);
-   token_precedence = precedence_table[operator_kind];
-   
-   if (token_precedence < expression_precedence)
+   return (double)strtol(expression->literal.value, NULL, 10);
+  }
+  
+  case LCDDL_NODE_KIND_unary_operator:
+  {
+   switch (expression->unary_operator.kind)
    {
-    return lhs;
+    case LCDDL_UN_OP_KIND_positive:
+    {
+     return lcddl_evaluate_expression(expression->unary_operator.operand);
+    }
+    
+    case LCDDL_UN_OP_KIND_negative:
+    {
+     return lcddl_evaluate_expression(expression->unary_operator.operand) * -1.0;
+    }
+    
+    case LCDDL_UN_OP_KIND_bitwise_not:
+    {
+     return (double)(~((unsigned long long)lcddl_evaluate_expression(expression->unary_operator.operand)));
+    }
+    
+    case LCDDL_UN_OP_KIND_boolean_not:
+    {
+     return (double)(!((long long)lcddl_evaluate_expression(expression->unary_operator.operand)));
+    }
+   }
+  }
+  
+  case LCDDL_NODE_KIND_binary_operator:
+  {
+   switch (expression->binary_operator.kind)
+   {
+    case LCDDL_BIN_OP_KIND_multiply:
+    {
+     return lcddl_evaluate_expression(expression->binary_operator.left) * lcddl_evaluate_expression(expression->binary_operator.right);
+    }
+    
+    case LCDDL_BIN_OP_KIND_divide:
+    {
+     return lcddl_evaluate_expression(expression->binary_operator.left) / lcddl_evaluate_expression(expression->binary_operator.right);
+    }
+    
+    case LCDDL_BIN_OP_KIND_add:
+    {
+     return lcddl_evaluate_expression(expression->binary_operator.left) + lcddl_evaluate_expression(expression->binary_operator.right);
+    }
+    
+    case LCDDL_BIN_OP_KIND_subtract:
+    {
+     return lcddl_evaluate_expression(expression->binary_operator.left) - lcddl_evaluate_expression(expression->binary_operator.right);
+    }
+    
+    case LCDDL_BIN_OP_KIND_bit_shift_left:
+    {
+     return (double)((unsigned long long)lcddl_evaluate_expression(expression->binary_operator.left) << (long long)lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_bit_shift_right:
+    {
+     return (double)((unsigned long long)lcddl_evaluate_expression(expression->binary_operator.left) >> (long long)lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_lesser_than:
+    {
+     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) < lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_greater_than:
+    {
+     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) > lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_lesser_than_or_equal_to:
+    {
+     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) <= lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_greater_than_or_equal_to:
+    {
+     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) >= lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_equality:
+    {
+     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) == lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_not_equal_to:
+    {
+     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) != lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_bitwise_and:
+    {
+     return (double)((unsigned long long)lcddl_evaluate_expression(expression->binary_operator.left) & (unsigned long long)lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_bitwise_xor:
+    {
+     return (double)((unsigned long long)lcddl_evaluate_expression(expression->binary_operator.left) ^ (unsigned long long)lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_bitwise_or:
+    {
+     return (double)((unsigned long long)lcddl_evaluate_expression(expression->binary_operator.left) | (unsigned long long)lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_boolean_and:
+    {
+     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) && lcddl_evaluate_expression(expression->binary_operator.right));
+    }
+    
+    case LCDDL_BIN_OP_KIND_boolean_or:
+    {
+     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) || lcddl_evaluate_expression(expression->binary_operator.right));
+    }
    }
   }
-  else
-  {
-   return lhs;
-  }
-  
-  _lcddl_consume_token(stream, stream->current_token.kind);
   
-  LcddlNode *rhs = _lcddl_parse_primary(stream);
-  
-  if (_lcddl_is_token_usable_as_binary_operator(stream->current_token))
+  default:
   {
-   unsigned int next_precedence = precedence_table[_lcddl_token_to_operator_kind(stream->current_token, false)];
-   if (token_precedence < next_precedence)
-   {
-    rhs = _lcddl_parse_binary_operator_rhs(stream, token_precedence + 1, rhs);
-   }
+   fprintf(stderr, "Error evaluating expression.\n");
+   return 0.0;
   }
-  
-  LcddlNode *new_left             = calloc(1, sizeof *new_left);
-  new_left->kind                  = LCDDL_NODE_KIND_binary_operator;
-  new_left->binary_operator.kind  = operator_kind;
-  new_left->binary_operator.left  = lhs;
-  new_left->binary_operator.right = rhs;
-  
-  lhs = new_left;
  }
 }
 
-static LcddlNode *
-_lcddl_parse_expression(_LcddlStream *stream)
+///////////////////////////////////////////
+// DIFF
+//~
+
+// NOTE(tbt): children are matched between the two trees by name. files are matched by filename
+static char *
+_lcddl_get_node_name(LcddlNode *node)
 {
- LcddlNode *lhs = _lcddl_parse_primary(stream);
- return _lcddl_parse_binary_operator_rhs(stream, 0, lhs);
+ switch (node->kind)
+ {
+  case LCDDL_NODE_KIND_declaration: { return node->declaration.name; }
+  case LCDDL_NODE_KIND_file:        { return node->file.filename; }
+  default:                          { return NULL; }
+ }
 }
 
-static LcddlNode *
-_lcddl_parse_parenthesis(_LcddlStream *stream)
+static bool
+_lcddl_are_subtrees_equal(LcddlNode *a,
+                          LcddlNode *b)
 {
- _lcddl_consume_token(stream, TOKEN_KIND_open_bracket);  // eat '('
- LcddlNode *result = _lcddl_parse_expression(stream);
- _lcddl_consume_token(stream, TOKEN_KIND_close_bracket); // eat ')'
- 
- return result;
+ return (a == b) || (a && b && a->hash == b->hash);
 }
 
-static LcddlNode *
-_lcddl_parse_primary(_LcddlStream *stream)
+static bool
+_lcddl_are_node_arrays_equal(LcddlNode **a,
+                             unsigned int a_count,
+                             LcddlNode **b,
+                             unsigned int b_count)
 {
- switch (stream->current_token.kind)
+ if (a_count != b_count)
  {
-  case TOKEN_KIND_add:         // unary plus operator
-  case TOKEN_KIND_dash:        // unary negative operator
-  case TOKEN_KIND_tilde:       // bitwise not operator
-  case TOKEN_KIND_exclamation: // boolean not operator
-  {
-   return _lcddl_parse_unary_operator(stream);
-  }
-  case TOKEN_KIND_float_literal:
-  case TOKEN_KIND_integer_literal:
-  case TOKEN_KIND_string_literal:
-  {
-   return _lcddl_parse_literal(stream);
-  }
-  case TOKEN_KIND_identifier:
+  return false;
+ }
+ for (unsigned int i = 0;
+      i < a_count;
+      ++i)
+ {
+  if (a[i]->hash != b[i]->hash)
   {
-   return _lcddl_parse_variable_reference(stream);
+   return false;
   }
-  case TOKEN_KIND_open_bracket:
+ }
+ return true;
+}
+
+static void _lcddl_diff_children(LcddlNode *old_node, LcddlNode *new_node, LcddlDiffCallback callback, void *user_data);
+
+// NOTE(tbt): reports how a pair of nodes with the same name differ, then goes on to their children.
+//            identical subtrees have identical hashes, so are skipped straight away
+static void
+_lcddl_diff_matched_nodes(LcddlNode *old_node,
+                          LcddlNode *new_node,
+                          LcddlDiffCallback callback,
+                          void *user_data)
+{
+ if (lcddl_node_hash(old_node) == lcddl_node_hash(new_node))
+ {
+  return;
+ }
+ 
+ LcddlDiff diff = {0};
+ diff.kind      = LCDDL_DIFF_KIND_modified;
+ diff.old_node  = old_node;
+ diff.new_node  = new_node;
+ 
+ if (old_node->kind == LCDDL_NODE_KIND_declaration &&
+     new_node->kind == LCDDL_NODE_KIND_declaration)
+ {
+  if (!_lcddl_are_subtrees_equal(old_node->declaration.type, new_node->declaration.type))
   {
-   return _lcddl_parse_parenthesis(stream);
+   diff.changes |= LCDDL_DIFF_CHANGE_type;
   }
-  default:
+  if (!_lcddl_are_subtrees_equal(old_node->declaration.value, new_node->declaration.value))
   {
-   print_error_and_exit_f(stream,
-                          "Got unexpected token '%s' when expecting an expression",
-                          token_kind_to_string(stream->current_token.kind));
-   return NULL;
+   diff.changes |= LCDDL_DIFF_CHANGE_value;
   }
  }
+ if (!_lcddl_are_node_arrays_equal(old_node->annotations, old_node->annotation_count,
+                                   new_node->annotations, new_node->annotation_count))
+ {
+  diff.changes |= LCDDL_DIFF_CHANGE_annotations;
+ }
+ if (!_lcddl_are_node_arrays_equal(old_node->children, old_node->child_count,
+                                   new_node->children, new_node->child_count))
+ {
+  diff.changes |= LCDDL_DIFF_CHANGE_children;
+ }
+ 
+ // NOTE(tbt): the nodes passed to `lcddl_diff` may differ only in their names, which are not reported
+ if (diff.changes)
+ {
+  callback(&diff, user_data);
+ }
+ if (diff.changes & LCDDL_DIFF_CHANGE_children)
+ {
+  _lcddl_diff_children(old_node, new_node, callback, user_data);
+ }
 }
 
-static LcddlNode *
-_lcddl_parse_unary_operator(_LcddlStream *stream)
+static void
+_lcddl_diff_children(LcddlNode *old_node,
+                     LcddlNode *new_node,
+                     LcddlDiffCallback callback,
+                     void *user_data)
 {
- LcddlNode *result = calloc(1, sizeof *result);
- result->kind      = LCDDL_NODE_KIND_unary_operator;
+ LcddlNode **old_children = old_node->children;
+ LcddlNode **new_children = new_node->children;
+ unsigned int old_count   = old_node->child_count;
+ unsigned int new_count   = new_node->child_count;
  
- if (_lcddl_is_token_usable_as_unary_operator(stream->current_token))
+ // NOTE(tbt): edits are usually local, so unchanged runs of children at either end are skipped by comparing
+ //            hashes, without looking at any names
+ while (old_count && new_count &&
+        old_children[0]->hash == new_children[0]->hash)
  {
-  result->unary_operator.kind = _lcddl_token_to_operator_kind(stream->current_token, true);
-  _lcddl_consume_token(stream, stream->current_token.kind);
+  old_children += 1;
+  new_children += 1;
+  old_count    -= 1;
+  new_count    -= 1;
  }
- else
+ while (old_count && new_count &&
+        old_children[old_count - 1]->hash == new_children[new_count - 1]->hash)
  {
-  print_error_and_exit_f(stream,
-                         "expected a unary operator, instead got '%s'",
-                         token_kind_to_string(stream->current_token.kind));
+  old_count -= 1;
+  new_count -= 1;
  }
- result->unary_operator.operand = _lcddl_parse_expression(stream);
  
- return result;
-}
-
-static LcddlNode *
-_lcddl_parse_literal(_LcddlStream *stream)
-{
- LcddlNode *result     = calloc(1, sizeof *result);
- result->literal.value = calloc(1, stream->current_token.len + 1);
- strncpy(result->literal.value,
-         stream->current_token.value,
-         stream->current_token.len);
+ // NOTE(tbt): open addressed table of the remaining new children by name, holding indices + 1
+ unsigned int table_capacity = 16;
+ while (table_capacity < new_count * 2)
+ {
+  table_capacity *= 2;
+ }
+ unsigned int *table       = calloc(table_capacity, sizeof(*table));
+ unsigned int *old_for_new = calloc(new_count + 1, sizeof(*old_for_new)); // index + 1 of the matching old child
  
- switch (stream->current_token.kind)
+ for (unsigned int i = 0;
+      i < new_count;
+      ++i)
  {
-  case TOKEN_KIND_string_literal:
+  char *name = _lcddl_get_node_name(new_children[i]);
+  if (name)
   {
-   result->kind = LCDDL_NODE_KIND_string_literal;
-   _lcddl_consume_token(stream, TOKEN_KIND_string_literal);
-   break;
+   unsigned int slot = _lcddl_hash_bytes(name, strlen(name)) & (table_capacity - 1);
+   while (table[slot])
+   {
+    slot = (slot + 1) & (table_capacity - 1);
+   }
+   table[slot] = i + 1;
   }
-  case TOKEN_KIND_integer_literal:
+ }
+ 
+ for (unsigned int i = 0;
+      i < old_count;
+      ++i)
+ {
+  char *name   = _lcddl_get_node_name(old_children[i]);
+  bool matched = false;
+  if (name)
   {
-   result->kind = LCDDL_NODE_KIND_integer_literal;
-   _lcddl_consume_token(stream, TOKEN_KIND_integer_literal);
-   break;
+   // NOTE(tbt): when a name is repeated, each old child is matched to the first new child of that name
+   //            which is not already taken
+   for (unsigned int slot = _lcddl_hash_bytes(name, strlen(name)) & (table_capacity - 1);
+        table[slot] && !matched;
+        slot = (slot + 1) & (table_capacity - 1))
+   {
+    unsigned int new_index = table[slot] - 1;
+    if (!old_for_new[new_index] &&
+        0 == strcmp(name, _lcddl_get_node_name(new_children[new_index])))
+    {
+     old_for_new[new_index] = i + 1;
+     matched                = true;
+    }
+   }
   }
-  case TOKEN_KIND_float_literal:
+  
+  if (!matched)
   {
-   result->kind = LCDDL_NODE_KIND_float_literal;
-   _lcddl_consume_token(stream, TOKEN_KIND_float_literal);
-   break;
+   LcddlDiff diff = {0};
+   diff.kind      = LCDDL_DIFF_KIND_removed;
+   diff.old_node  = old_children[i];
+   callback(&diff, user_data);
   }
-  default:
+ }
+ 
+ for (unsigned int i = 0;
+      i < new_count;
+      ++i)
+ {
+  if (old_for_new[i])
+  {
+   _lcddl_diff_matched_nodes(old_children[old_for_new[i] - 1], new_children[i], callback, user_data);
+  }
+  else
   {
-   print_error_and_exit_f(stream,
-                          "Expecting a literal, got '%s'",
-                          token_kind_to_string(stream->current_token.kind));
+   LcddlDiff diff = {0};
+   diff.kind      = LCDDL_DIFF_KIND_added;
+   diff.new_node  = new_children[i];
+   callback(&diff, user_data);
   }
  }
  
- return result;
+ free(table);
+ free(old_for_new);
 }
 
-static LcddlNode *
-_lcddl_parse_variable_reference(_LcddlStream *stream)
+void
+lcddl_diff(LcddlNode *old_node,
+           LcddlNode *new_node,
+           LcddlDiffCallback callback,
+           void *user_data)
 {
- LcddlNode *result          = calloc(1, sizeof *result);
- result->kind               = LCDDL_NODE_KIND_variable_reference;
- result->var_reference.name = calloc(1, stream->current_token.len + 1);
- strncpy(result->var_reference.name,
-         stream->current_token.value,
-         stream->current_token.len);
- 
- _lcddl_consume_token(stream, TOKEN_KIND_identifier);
- 
- return result;
+ _lcddl_diff_matched_nodes(old_node, new_node, callback, user_data);
 }
 
 ///////////////////////////////////////////
-// USER LAYER
+// BATCH EVALUATION
 //~
 
-#ifndef LCDDL_AS_LIBRARY
-
-typedef void (*_LcddlUserCallback)(LcddlNode *);
+#define LCDDL_BATCH_CHUNK_SIZE 256
 
-static _LcddlUserCallback get_user_callback_functions(char *lib_path);
+typedef enum
+{
+ INSTRUCTION_KIND_constant,        // push a constant
+ INSTRUCTION_KIND_variable,        // push one of the bound input arrays
+ INSTRUCTION_KIND_unary_operator,  // replace the top of the stack
+ INSTRUCTION_KIND_binary_operator, // replace the top two elements of the stack
+} _LcddlInstructionKind;
 
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-static _LcddlUserCallback
-get_user_callback_functions(char *lib_path)
+typedef struct
 {
- _LcddlUserCallback result = NULL;
- 
- HINSTANCE library = LoadLibrary(lib_path);
- if (!library)
- {
-  fprintf(stderr, "ERROR: Could not open custom layer library '%s'\n", lib_path);
-  exit(EXIT_FAILURE);
- }
- 
- result = (_LcddlUserCallback)GetProcAddress(library, "lcddl_user_callback");
- 
- if (!result)
+ _LcddlInstructionKind kind;
+ union
  {
-  fprintf(stderr, "ERROR: Could not find callback in user layer library '%s'\n", lib_path);
-  exit(EXIT_FAILURE);
- }
- 
- return result;
+  double constant;
+  unsigned int variable_index;
+  LcddlOperatorKind operator_kind;
+ };
+} _LcddlInstruction;
+
+struct LcddlCompiledExpression
+{
+ _LcddlInstruction *instructions;
+ unsigned int instruction_count;
+ unsigned int instruction_capacity;
+ unsigned int stack_depth;
+ unsigned int max_stack_depth;
+};
+
+#if defined(LCDDL_SIMD_AVX)
+#define LCDDL_SIMD_WIDTH 4
+typedef __m256d _LcddlWide;
+#define _lcddl_wide_load(_p)          _mm256_loadu_pd(_p)
+#define _lcddl_wide_store(_p, _x)     _mm256_storeu_pd((_p), (_x))
+#define _lcddl_wide_set(_x)           _mm256_set1_pd(_x)
+#define _lcddl_wide_add(_a, _b)       _mm256_add_pd((_a), (_b))
+#define _lcddl_wide_sub(_a, _b)       _mm256_sub_pd((_a), (_b))
+#define _lcddl_wide_mul(_a, _b)       _mm256_mul_pd((_a), (_b))
+#define _lcddl_wide_div(_a, _b)       _mm256_div_pd((_a), (_b))
+#define _lcddl_wide_and(_a, _b)       _mm256_and_pd((_a), (_b))
+#define _lcddl_wide_or(_a, _b)        _mm256_or_pd((_a), (_b))
+#define _lcddl_wide_xor(_a, _b)       _mm256_xor_pd((_a), (_b))
+#define _lcddl_wide_and_not(_a, _b)   _mm256_andnot_pd((_a), (_b))
+#define _lcddl_wide_lt(_a, _b)        _mm256_cmp_pd((_a), (_b), _CMP_LT_OQ)
+#define _lcddl_wide_gt(_a, _b)        _mm256_cmp_pd((_a), (_b), _CMP_GT_OQ)
+#define _lcddl_wide_le(_a, _b)        _mm256_cmp_pd((_a), (_b), _CMP_LE_OQ)
+#define _lcddl_wide_ge(_a, _b)        _mm256_cmp_pd((_a), (_b), _CMP_GE_OQ)
+#define _lcddl_wide_eq(_a, _b)        _mm256_cmp_pd((_a), (_b), _CMP_EQ_OQ)
+#define _lcddl_wide_ne(_a, _b)        _mm256_cmp_pd((_a), (_b), _CMP_NEQ_UQ)
+#elif defined(LCDDL_SIMD_SSE2)
+#define LCDDL_SIMD_WIDTH 2
+typedef __m128d _LcddlWide;
+#define _lcddl_wide_load(_p)          _mm_loadu_pd(_p)
+#define _lcddl_wide_store(_p, _x)     _mm_storeu_pd((_p), (_x))
+#define _lcddl_wide_set(_x)           _mm_set1_pd(_x)
+#define _lcddl_wide_add(_a, _b)       _mm_add_pd((_a), (_b))
+#define _lcddl_wide_sub(_a, _b)       _mm_sub_pd((_a), (_b))
+#define _lcddl_wide_mul(_a, _b)       _mm_mul_pd((_a), (_b))
+#define _lcddl_wide_div(_a, _b)       _mm_div_pd((_a), (_b))
+#define _lcddl_wide_and(_a, _b)       _mm_and_pd((_a), (_b))
+#define _lcddl_wide_or(_a, _b)        _mm_or_pd((_a), (_b))
+#define _lcddl_wide_xor(_a, _b)       _mm_xor_pd((_a), (_b))
+#define _lcddl_wide_and_not(_a, _b)   _mm_andnot_pd((_a), (_b))
+#define _lcddl_wide_lt(_a, _b)        _mm_cmplt_pd((_a), (_b))
+#define _lcddl_wide_gt(_a, _b)        _mm_cmpgt_pd((_a), (_b))
+#define _lcddl_wide_le(_a, _b)        _mm_cmple_pd((_a), (_b))
+#define _lcddl_wide_ge(_a, _b)        _mm_cmpge_pd((_a), (_b))
+#define _lcddl_wide_eq(_a, _b)        _mm_cmpeq_pd((_a), (_b))
+#define _lcddl_wide_ne(_a, _b)        _mm_cmpneq_pd((_a), (_b))
+#endif
+
+// NOTE(tbt): `a` and `b` are bound to the current elements of `left` and `right`
+//            in both the wide and the scalar expression
+#if defined(LCDDL_SIMD_WIDTH)
+#define _lcddl_batch_loop(_wide_expression, _scalar_expression)   \
+for (; i + LCDDL_SIMD_WIDTH <= count; i += LCDDL_SIMD_WIDTH)        \
+{                                                                    \
+ _LcddlWide a = _lcddl_wide_load(&left[i]);                          \
+ _LcddlWide b = _lcddl_wide_load(&right[i]);                         \
+ (void)b;                                                            \
+ _lcddl_wide_store(&result[i], (_wide_expression));                  \
+}                                                                    \
+for (; i < count; ++i)                                               \
+{                                                                    \
+ double a = left[i];                                                 \
+ double b = right[i];                                                \
+ (void)b;                                                            \
+ result[i] = (_scalar_expression);                                   \
 }
 #else
-static _LcddlUserCallback
-get_user_callback_functions(char *lib_path)
+#define _lcddl_batch_loop(_wide_expression, _scalar_expression)   \
+for (; i < count; ++i)                                               \
+{                                                                    \
+ double a = left[i];                                                 \
+ double b = right[i];                                                \
+ (void)b;                                                            \
+ result[i] = (_scalar_expression);                                   \
+}
+#endif
+
+static double
+_lcddl_apply_unary_operator(LcddlOperatorKind kind,
+                            double operand)
 {
- _LcddlUserCallback result;
- 
- void *library = dlopen(lib_path, RTLD_NOW | RTLD_GLOBAL);
- if (!library)
+ switch (kind)
  {
-  fprintf(stderr, "ERROR: Could not open user layer library '%s'\n", lib_path);
-  exit(EXIT_FAILURE);
+  case LCDDL_UN_OP_KIND_positive:    { return operand; }
+  case LCDDL_UN_OP_KIND_negative:    { return operand * -1.0; }
+  case LCDDL_UN_OP_KIND_bitwise_not: { return (double)(~((unsigned long long)operand)); }
+  case LCDDL_UN_OP_KIND_boolean_not: { return (double)(!((long long)operand)); }
+  default:                           { return 0.0; }
  }
- 
- result = dlsym(library, "lcddl_user_callback");
- 
- if (!result)
+}
+
+static double
+_lcddl_apply_binary_operator(LcddlOperatorKind kind,
+                             double left,
+                             double right)
+{
+ switch (kind)
  {
-  fprintf(stderr, "ERROR: Could not find callback in user layer library '%s'\n", lib_path);
-  exit(EXIT_FAILURE);
+  case LCDDL_BIN_OP_KIND_multiply:                 { return left * right; }
+  case LCDDL_BIN_OP_KIND_divide:                   { return left / right; }
+  case LCDDL_BIN_OP_KIND_add:                      { return left + right; }
+  case LCDDL_BIN_OP_KIND_subtract:                 { return left - right; }
+  case LCDDL_BIN_OP_KIND_bit_shift_left:           { return (double)((unsigned long long)left << (long long)right); }
+  case LCDDL_BIN_OP_KIND_bit_shift_right:          { return (double)((unsigned long long)left >> (long long)right); }
+  case LCDDL_BIN_OP_KIND_lesser_than:              { return (double)(left < right); }
+  case LCDDL_BIN_OP_KIND_greater_than:             { return (double)(left > right); }
+  case LCDDL_BIN_OP_KIND_lesser_than_or_equal_to:  { return (double)(left <= right); }
+  case LCDDL_BIN_OP_KIND_greater_than_or_equal_to: { return (double)(left >= right); }
+  case LCDDL_BIN_OP_KIND_equality:                 { return (double)(left == right); }
+  case LCDDL_BIN_OP_KIND_not_equal_to:             { return (double)(left != right); }
+  case LCDDL_BIN_OP_KIND_bitwise_and:              { return (double)((unsigned long long)left & (unsigned long long)right); }
+  case LCDDL_BIN_OP_KIND_bitwise_xor:              { return (double)((unsigned long long)left ^ (unsigned long long)right); }
+  case LCDDL_BIN_OP_KIND_bitwise_or:               { return (double)((unsigned long long)left | (unsigned long long)right); }
+  case LCDDL_BIN_OP_KIND_boolean_and:              { return (double)(left && right); }
+  case LCDDL_BIN_OP_KIND_boolean_or:               { return (double)(left || right); }
+  default:                                         { return 0.0; }
  }
- 
- return result;
 }
-#endif
 
+static void
+_lcddl_batch_unary_operator(LcddlOperatorKind kind,
+                            double *operand,
+                            double *result,
+                            unsigned int count)
+{
+ double *left  = operand;
+ double *right = operand;
+ unsigned int i = 0;
+ 
+#if defined(LCDDL_SIMD_WIDTH)
+ _LcddlWide one       = _lcddl_wide_set(1.0);
+ _LcddlWide sign_mask = _lcddl_wide_set(-0.0);
 #endif
+ 
+ switch (kind)
+ {
+  case LCDDL_UN_OP_KIND_positive:
+  {
+   _lcddl_batch_loop(a, a);
+   break;
+  }
+  case LCDDL_UN_OP_KIND_negative:
+  {
+   _lcddl_batch_loop(_lcddl_wide_xor(a, sign_mask), a * -1.0);
+   break;
+  }
+  case LCDDL_UN_OP_KIND_boolean_not:
+  {
+   // NOTE(tbt): the scalar evaluator truncates to an integer before negating,
+   //            so anything with a magnitude less than one is 'false'
+   _lcddl_batch_loop(_lcddl_wide_and(_lcddl_wide_lt(_lcddl_wide_and_not(sign_mask, a), one), one),
+                     _lcddl_apply_unary_operator(kind, a));
+   break;
+  }
+  default:
+  {
+   // NOTE(tbt): no floating point vector equivalent for integer operators
+   for (; i < count; ++i)
+   {
+    result[i] = _lcddl_apply_unary_operator(kind, operand[i]);
+   }
+   break;
+  }
+ }
+}
 
-///////////////////////////////////////////
-// MAIN
-//~
-
-static LcddlNode *_lcddl_global_root;
-
-#ifndef LCDDL_AS_LIBRARY
-int
-main(int argc,
-     char **argv)
+static void
+_lcddl_batch_binary_operator(LcddlOperatorKind kind,
+                             double *left,
+                             double *right,
+                             double *result,
+                             unsigned int count)
 {
- if (argc < 3)
- {
-  fprintf(stderr, "Usage: %s custom_layer_library path input_file_1 input_file_2...\n", argv[0]);
-  return EXIT_FAILURE;
- }
+ unsigned int i = 0;
  
- _LcddlUserCallback user_callback = get_user_callback_functions(argv[1]);
- _lcddl_global_root               = calloc(1, sizeof *_lcddl_global_root);
- _lcddl_global_root->kind         = LCDDL_NODE_KIND_root;
+#if defined(LCDDL_SIMD_WIDTH)
+ _LcddlWide zero = _lcddl_wide_set(0.0);
+ _LcddlWide one  = _lcddl_wide_set(1.0);
+#endif
  
- for (int i = 2;
-      i < argc;
-      ++i)
+ switch (kind)
  {
-  LcddlNode *file                 = _lcddl_parse_stream(_lcddl_load_entire_file_as_stream(argv[i]));
-  file->next_sibling              = _lcddl_global_root->first_child;
-  _lcddl_global_root->first_child = file;
+  case LCDDL_BIN_OP_KIND_multiply:
+  {
+   _lcddl_batch_loop(_lcddl_wide_mul(a, b), a * b);
+   break;
+  }
+  case LCDDL_BIN_OP_KIND_divide:
+  {
+   _lcddl_batch_loop(_lcddl_wide_div(a, b), a / b);
+   break;
+  }
+  case LCDDL_BIN_OP_KIND_add:
+  {
+   _lcddl_batch_loop(_lcddl_wide_add(a, b), a + b);
+   break;
+  }
+  case LCDDL_BIN_OP_KIND_subtract:
+  {
+   _lcddl_batch_loop(_lcddl_wide_sub(a, b), a - b);
+   break;
+  }
+  case LCDDL_BIN_OP_KIND_lesser_than:
+  {
+   _lcddl_batch_loop(_lcddl_wide_and(_lcddl_wide_lt(a, b), one), (double)(a < b));
+   break;
+  }
+  case LCDDL_BIN_OP_KIND_greater_than:
+  {
+   _lcddl_batch_loop(_lcddl_wide_and(_lcddl_wide_gt(a, b), one), (double)(a > b));
+   break;
+  }
+  case LCDDL_BIN_OP_KIND_lesser_than_or_equal_to:
+  {
+   _lcddl_batch_loop(_lcddl_wide_and(_lcddl_wide_le(a, b), one), (double)(a <= b));
+   break;
+  }
+  case LCDDL_BIN_OP_KIND_greater_than_or_equal_to:
+  {
+   _lcddl_batch_loop(_lcddl_wide_and(_lcddl_wide_ge(a, b), one), (double)(a >= b));
+   break;
+  }
+  case LCDDL_BIN_OP_KIND_equality:
+  {
+   _lcddl_batch_loop(_lcddl_wide_and(_lcddl_wide_eq(a, b), one), (double)(a == b));
+   break;
+  }
+  case LCDDL_BIN_OP_KIND_not_equal_to:
+  {
+   _lcddl_batch_loop(_lcddl_wide_and(_lcddl_wide_ne(a, b), one), (double)(a != b));
+   break;
+  }
+  case LCDDL_BIN_OP_KIND_boolean_and:
+  {
+   _lcddl_batch_loop(_lcddl_wide_and(_lcddl_wide_and(_lcddl_wide_ne(a, zero), _lcddl_wide_ne(b, zero)), one),
+                     (double)(a && b));
+   break;
+  }
+  case LCDDL_BIN_OP_KIND_boolean_or:
+  {
+   _lcddl_batch_loop(_lcddl_wide_and(_lcddl_wide_or(_lcddl_wide_ne(a, zero), _lcddl_wide_ne(b, zero)), one),
+                     (double)(a || b));
+   break;
+  }
+  default:
+  {
+   // NOTE(tbt): no floating point vector equivalent for integer operators
+   for (; i < count; ++i)
+   {
+    result[i] = _lcddl_apply_binary_operator(kind, left[i], right[i]);
+   }
+   break;
+  }
  }
- 
- user_callback(_lcddl_global_root);
- 
- return EXIT_SUCCESS;
-}
-
-#else
-
-void
-lcddl_initialise(void)
-{
- _lcddl_global_root       = calloc(1, sizeof *_lcddl_global_root);
- _lcddl_global_root->kind = LCDDL_NODE_KIND_root;
-}
-
-LcddlNode *
-lcddl_parse_file(char *filename)
-{
- LcddlNode *file                  = _lcddl_parse_stream(_lcddl_load_entire_file_as_stream(filename));
- file->next_sibling               = _lcddl_global_root->first_child;
- _lcddl_global_root->first_child  = file;
- 
- return file;
 }
 
-LcddlNode *
-lcddl_parse_from_memory(char *buffer,
-                        unsigned long long buffer_size)
+static void
+_lcddl_push_instruction(LcddlCompiledExpression *expression,
+                        _LcddlInstruction instruction)
 {
- _LcddlStream stream              = {0};
- stream.buffer                    = buffer;
- stream.size                      = buffer_size;
- stream.path                      = "memory";
- stream.current_line              = 1;
- stream.current_token             = _lcddl_get_next_token(&stream);
- LcddlNode *file                  = _lcddl_parse_stream(stream);
- file->next_sibling               = _lcddl_global_root->first_child;
- _lcddl_global_root->first_child  = file;
+ if (expression->instruction_count == expression->instruction_capacity)
+ {
+  expression->instruction_capacity = expression->instruction_capacity ? expression->instruction_capacity * 2 : 16;
+  expression->instructions         = realloc(expression->instructions,
+                                             expression->instruction_capacity * sizeof(*expression->instructions));
+ }
+ expression->instructions[expression->instruction_count++] = instruction;
  
- return file;
+ if (instruction.kind == INSTRUCTION_KIND_constant ||
+     instruction.kind == INSTRUCTION_KIND_variable)
+ {
+  expression->stack_depth += 1;
+  if (expression->stack_depth > expression->max_stack_depth)
+  {
+   expression->max_stack_depth = expression->stack_depth;
+  }
+ }
+ else if (instruction.kind == INSTRUCTION_KIND_binary_operator)
+ {
+  expression->stack_depth -= 1;
+ }
 }
 
-LcddlNode *
-lcddl_parse_cstring(char *string)
+static bool
+_lcddl_is_instruction_constant(LcddlCompiledExpression *expression,
+                               unsigned int index_from_end)
 {
- return lcddl_parse_from_memory(string, strlen(string));
+ return (expression->instruction_count > index_from_end &&
+         expression->instructions[expression->instruction_count - 1 - index_from_end].kind == INSTRUCTION_KIND_constant);
 }
 
-static void
-_lcddl_free_tree(LcddlNode *root)
+static bool
+_lcddl_compile_expression_node(LcddlCompiledExpression *expression,
+                               LcddlNode *node,
+                               char **variable_names,
+                               unsigned int variable_count)
 {
- if (root)
+ switch (node->kind)
  {
-  // free sub-type specific data
-  switch(root->kind)
+  case LCDDL_NODE_KIND_float_literal:
+  case LCDDL_NODE_KIND_integer_literal:
   {
-   case LCDDL_NODE_KIND_file:
-   {
-    free(root->file.filename);
-    break;
-   }
-   
-   case LCDDL_NODE_KIND_declaration:
+   _LcddlInstruction instruction = { .kind = INSTRUCTION_KIND_constant };
+   instruction.constant = lcddl_evaluate_expression(node);
+   _lcddl_push_instruction(expression, instruction);
+   return true;
+  }
+  
+  case LCDDL_NODE_KIND_variable_reference:
+  {
+   for (unsigned int i = 0;
+        i < variable_count;
+        ++i)
    {
-    free(root->declaration.name);
-    _lcddl_free_tree(root->declaration.type);
-    _lcddl_free_tree(root->declaration.value);
-    break;
+    if (0 == strcmp(variable_names[i], node->var_reference.name))
+    {
+     _LcddlInstruction instruction = { .kind = INSTRUCTION_KIND_variable };
+     instruction.variable_index = i;
+     _lcddl_push_instruction(expression, instruction);
+     return true;
+    }
    }
-   
-   case LCDDL_NODE_KIND_type:
+   fprintf(stderr, "Error compiling expression: unbound variable '%s'.\n", node->var_reference.name);
+   return false;
+  }
+  
+  case LCDDL_NODE_KIND_unary_operator:
+  {
+   if (!_lcddl_compile_expression_node(expression, node->unary_operator.operand, variable_names, variable_count))
    {
-    free(root->type.type_name);
-    break;
+    return false;
    }
    
-   case LCDDL_NODE_KIND_binary_operator:
+   // NOTE(tbt): fold operators applied to constants
+   if (_lcddl_is_instruction_constant(expression, 0))
    {
-    _lcddl_free_tree(root->binary_operator.left);
-    _lcddl_free_tree(root->binary_operator.right);
-    break;
+    _LcddlInstruction *operand = &expression->instructions[expression->instruction_count - 1];
+    operand->constant = _lcddl_apply_unary_operator(node->unary_operator.kind, operand->constant);
    }
-   
-   case LCDDL_NODE_KIND_unary_operator:
+   else
    {
-    _lcddl_free_tree(root->unary_operator.operand);
-    break;
+    _LcddlInstruction instruction = { .kind = INSTRUCTION_KIND_unary_operator };
+    instruction.operator_kind = node->unary_operator.kind;
+    _lcddl_push_instruction(expression, instruction);
    }
-   
-   case LCDDL_NODE_KIND_string_literal:
-   case LCDDL_NODE_KIND_float_literal:
-   case LCDDL_NODE_KIND_integer_literal:
+   return true;
+  }
+  
+  case LCDDL_NODE_KIND_binary_operator:
+  {
+   if (!_lcddl_compile_expression_node(expression, node->binary_operator.left, variable_names, variable_count) ||
+       !_lcddl_compile_expression_node(expression, node->binary_operator.right, variable_names, variable_count))
    {
-    free(root->literal.value);
-    break;
+    return false;
    }
    
-   case LCDDL_NODE_KIND_variable_reference:
+   // NOTE(tbt): fold operators applied to constants
+   if (_lcddl_is_instruction_constant(expression, 0) &&
+       _lcddl_is_instruction_constant(expression, 1))
    {
-    free(root->var_reference.name);
-    break;
+    _LcddlInstruction *left  = &expression->instructions[expression->instruction_count - 2];
+    _LcddlInstruction *right = &expression->instructions[expression->instruction_count - 1];
+    left->constant = _lcddl_apply_binary_operator(node->binary_operator.kind, left->constant, right->constant);
+    expression->instruction_count -= 1;
+    expression->stack_depth       -= 1;
    }
-   
-   case LCDDL_NODE_KIND_annotation:
+   else
    {
-    free(root->annotation.tag);
-    _lcddl_free_tree(root->annotation.value);
-    break;
+    _LcddlInstruction instruction = { .kind = INSTRUCTION_KIND_binary_operator };
+    instruction.operator_kind = node->binary_operator.kind;
+    _lcddl_push_instruction(expression, instruction);
    }
+   return true;
   }
   
-  // free children
-  LcddlNode *next_child = NULL;
-  for (LcddlNode *child = root->first_child;
-       NULL != child;
-       child = next_child)
-  {
-   next_child = child->next_sibling;
-   _lcddl_free_tree(child);
-  }
-  
-  // free annotations
-  LcddlNode *next_annotation = NULL;
-  for (LcddlNode *annotation = root->first_annotation;
-       NULL != annotation;
-       annotation = next_annotation)
-  {
-   next_annotation = annotation->next_annotation;
-   _lcddl_free_tree(annotation);
-  }
-  
-  // free the node itself
-  free(root);
- }
-}
-
-void
-lcddl_free_file(LcddlNode *root)
-{
- if (root->kind == LCDDL_NODE_KIND_file)
- {
-  // remove from global tree
-  LcddlNode **indirect = &_lcddl_global_root->first_child;
-  while (*indirect != root)
+  default:
   {
-   indirect = &(*indirect)->next_sibling;
+   fprintf(stderr, "Error compiling expression: only numeric expressions may be compiled.\n");
+   return false;
   }
-  *indirect = (*indirect)->next_sibling;
-  
-  // free the tree
-  _lcddl_free_tree(root);
  }
 }
 
-#endif
-
-///////////////////////////////////////////
-// USER LAYER HELPERS
-//~
-
-LcddlNode *
-lcddl_get_annotation_value(LcddlNode *node,
-                           char *tag)
+LcddlCompiledExpression *
+lcddl_compile_expression(LcddlNode *expression,
+                         char **variable_names,
+                         unsigned int variable_count)
 {
- for (LcddlNode *a = node->first_annotation;
-      NULL != a;
-      a = a->next_annotation)
- {
-  if (0 == strcmp(a->annotation.tag, tag))
-  {
-   return a->annotation.value;
-  }
- }
+ LcddlCompiledExpression *result = calloc(1, sizeof *result);
  
- return NULL;
-}
-
-bool
-lcddl_does_node_have_tag(LcddlNode *node,
-                         char *tag)
-{
- for (LcddlNode *a = node->first_annotation;
-      NULL != a;
-      a = a->next_annotation)
+ if (!_lcddl_compile_expression_node(result, expression, variable_names, variable_count))
  {
-  if (0 == strcmp(a->annotation.tag, tag))
-  {
-   return true;
-  }
+  lcddl_free_compiled_expression(result);
+  result = NULL;
  }
  
- return false;
+ return result;
 }
 
-static void
-_lcddl_write_field_to_file_as_c(LcddlNode *node,
-                                unsigned int indentation,
-                                FILE *file)
+void
+lcddl_evaluate_compiled_expression_batch(LcddlCompiledExpression *expression,
+                                         double **variables,
+                                         unsigned long long count,
+                                         double *results)
 {
- for (unsigned int i = indentation;
-      0 != i;
-      --i)
- {
-  putc('\t', file);
- }
+ double *scratch = malloc(expression->max_stack_depth * LCDDL_BATCH_CHUNK_SIZE * sizeof(*scratch));
+ double **stack  = malloc(expression->max_stack_depth * sizeof(*stack));
  
- if (node->kind == LCDDL_NODE_KIND_declaration)
+ for (unsigned long long base = 0;
+      base < count;
+      base += LCDDL_BATCH_CHUNK_SIZE)
  {
-  if (node->first_child)
+  unsigned int chunk_size = (count - base < LCDDL_BATCH_CHUNK_SIZE) ? (unsigned int)(count - base) : LCDDL_BATCH_CHUNK_SIZE;
+  unsigned int depth      = 0;
+  
+  for (unsigned int i = 0;
+       i < expression->instruction_count;
+       ++i)
   {
-   if (!node->declaration.type->type.indirection_level &&
-       !node->declaration.type->type.array_count)
+   _LcddlInstruction *instruction = &expression->instructions[i];
+   
+   // NOTE(tbt): the final instruction writes straight into the caller's buffer
+   bool is_last = (i + 1 == expression->instruction_count);
+   
+   switch (instruction->kind)
    {
-    if (0 == strcmp(node->declaration.type->type.type_name, "struct"))
+    case INSTRUCTION_KIND_constant:
     {
-     fprintf(file, "struct\n{\n");
+     double *slot = is_last ? &results[base] : &scratch[depth * LCDDL_BATCH_CHUNK_SIZE];
+     for (unsigned int j = 0;
+          j < chunk_size;
+          ++j)
+     {
+      slot[j] = instruction->constant;
+     }
+     stack[depth++] = slot;
+     break;
     }
-    else if (0 == strcmp(node->declaration.type->type.type_name, "union"))
+    
+    case INSTRUCTION_KIND_variable:
     {
-     fprintf(file, "union\n{\n");
+     stack[depth++] = &variables[instruction->variable_index][base];
+     break;
     }
-    else
+    
+    case INSTRUCTION_KIND_unary_operator:
     {
-     fprintf(file, "struct // type '%s' not available in c\n{\n", node->declaration.type->type.type_name);
+     double *slot = is_last ? &results[base] : &scratch[(depth - 1) * LCDDL_BATCH_CHUNK_SIZE];
+     _lcddl_batch_unary_operator(instruction->operator_kind, stack[depth - 1], slot, chunk_size);
+     stack[depth - 1] = slot;
+     break;
     }
     
-    for (LcddlNode *child = node->first_child;
-         NULL != child;
-         child = child->next_sibling)
+    case INSTRUCTION_KIND_binary_operator:
     {
-     _lcddl_write_field_to_file_as_c(child, indentation + 1, file);
+     double *slot = is_last ? &results[base] : &scratch[(depth - 2) * LCDDL_BATCH_CHUNK_SIZE];
+     _lcddl_batch_binary_operator(instruction->operator_kind, stack[depth - 2], stack[depth - 1], slot, chunk_size);
+     stack[depth - 2] = slot;
+     depth -= 1;
+     break;
     }
-    
-    fprintf(file, "};\n");
-   }
-   else
-   {
-    fprintf(file, "// could not write field '%s' as c\n", node->declaration.name);
    }
   }
-  else
+  
+  if (stack[0] != &results[base])
+  {
+   memcpy(&results[base], stack[0], chunk_size * sizeof(*results));
+  }
+ }
+ 
+ free(stack);
+ free(scratch);
+}
+
+void
+lcddl_free_compiled_expression(LcddlCompiledExpression *expression)
+{
+ if (expression)
+ {
+  free(expression->instructions);
+  free(expression);
+ }
+}
+
+///////////////////////////////////////////
+// LAYOUT
+//~
+
+// NOTE(tbt): built in types have their natural alignment, the same as their size, on the machine LCDDL was
+//            built for. a `string` is laid out as a `char *`
+typedef struct
+{
+ char *name;
+ unsigned long long size;
+} _LcddlPrimitiveType;
+
+static _LcddlPrimitiveType _lcddl_primitive_types[] =
+{
+ { "i8",     1                },
+ { "u8",     1                },
+ { "b8",     1                },
+ { "i16",    2                },
+ { "u16",    2                },
+ { "i32",    4                },
+ { "u32",    4                },
+ { "b32",    4                },
+ { "f32",    4                },
+ { "i64",    8                },
+ { "u64",    8                },
+ { "f64",    8                },
+ { "bool",   sizeof(bool)     },
+ { "char",   sizeof(char)     },
+ { "int",    sizeof(int)      },
+ { "float",  sizeof(float)    },
+ { "double", sizeof(double)   },
+ { "string", sizeof(char *)   },
+};
+
+// NOTE(tbt): the layout of every declaration asked about so far, open addressed by a hash of the declaration's
+//            address. the layout of a declaration may depend on declarations in any other file, so the whole
+//            cache is thrown away once a file has been added to or removed from the root. that only marks it as
+//            stale, and it is emptied the next time a layout is asked for, so that adding, removing and replacing
+//            files stays constant time however many layouts are cached. while a declaration's
+//            layout is being worked out it is marked as in progress, so a type which contains itself is found
+//            when it is reached again
+typedef struct
+{
+ LcddlNode *declaration; // NULL for an empty slot
+ bool is_in_progress;
+ LcddlLayout layout;
+} _LcddlLayoutCacheEntry;
+
+typedef struct
+{
+ _LcddlLayoutCacheEntry *entries;
+ unsigned int count;
+ unsigned int capacity;
+ bool is_stale;
+} _LcddlLayoutCache;
+
+static _LcddlLayoutCache _lcddl_layout_cache;
+
+// NOTE(tbt): user layers may ask for layouts from several threads at once
+static _LcddlMutex _lcddl_layout_mutex = LCDDL_MUTEX_INITIALISER;
+
+static unsigned long long
+_lcddl_hash_pointer(void *pointer)
+{
+ return _lcddl_hash_bytes((char *)&pointer, sizeof(pointer));
+}
+
+// NOTE(tbt): returns the slot of `declaration`, or of the empty slot where it would go
+static unsigned int
+_lcddl_find_layout_slot(LcddlNode *declaration)
+{
+ unsigned int mask = _lcddl_layout_cache.capacity - 1;
+ unsigned int slot = _lcddl_hash_pointer(declaration) & mask;
+ while (_lcddl_layout_cache.entries[slot].declaration &&
+        _lcddl_layout_cache.entries[slot].declaration != declaration)
+ {
+  slot = (slot + 1) & mask;
+ }
+ return slot;
+}
+
+static void
+_lcddl_insert_layout_entry(_LcddlLayoutCacheEntry entry)
+{
+ // NOTE(tbt): keep the table at most three quarters full
+ if ((_lcddl_layout_cache.count + 1) * 4 > _lcddl_layout_cache.capacity * 3)
+ {
+  _LcddlLayoutCacheEntry *old_entries = _lcddl_layout_cache.entries;
+  unsigned int old_capacity           = _lcddl_layout_cache.capacity;
+  _lcddl_layout_cache.capacity        = old_capacity ? old_capacity * 2 : 1024;
+  _lcddl_layout_cache.entries         = calloc(_lcddl_layout_cache.capacity, sizeof(*_lcddl_layout_cache.entries));
+  for (unsigned int i = 0;
+       i < old_capacity;
+       ++i)
   {
-   fprintf(file, "%s ", node->declaration.type->type.type_name);
-   
-   for (int i = node->declaration.type->type.indirection_level;
-        0 != i;
-        --i)
-   {
-    putc('*', file);
-   }
-   
-   fprintf(file, "%s", node->declaration.name);
-   
-   if (node->declaration.type->type.array_count)
-   {
-    fprintf(file, "[%u]", node->declaration.type->type.array_count);
-   }
-   
-   putc(';', file);
-   
-   if (node->declaration.value)
+   if (old_entries[i].declaration)
    {
-    fprintf(file, " // c does not support initialisers in structs/unions");
+    _lcddl_layout_cache.entries[_lcddl_find_layout_slot(old_entries[i].declaration)] = old_entries[i];
    }
-   
-   putc('\n', file);
   }
+  free(old_entries);
  }
- else
- {
-  fprintf(file, "// could not write field");
- }
+ 
+ _lcddl_layout_cache.entries[_lcddl_find_layout_slot(entry.declaration)] = entry;
+ _lcddl_layout_cache.count += 1;
 }
 
-void
-lcddl_write_node_to_file_as_c_struct(LcddlNode *node,
-                                     FILE *file)
+static void
+_lcddl_invalidate_layouts(void)
 {
- if (node->kind == LCDDL_NODE_KIND_declaration)
+ _lcddl_layout_cache.is_stale = true;
+}
+
+static void
+_lcddl_clear_layouts(void)
+{
+ if (_lcddl_layout_cache.count)
  {
-  fprintf(file,
-          "typedef struct %s %s;\nstruct %s\n{\n",
-          node->declaration.name,
-          node->declaration.name,
-          node->declaration.name);
-  
-  for (LcddlNode *child = node->first_child;
-       NULL != child;
-       child = child->next_sibling)
+  for (unsigned int i = 0;
+       i < _lcddl_layout_cache.capacity;
+       ++i)
   {
-   _lcddl_write_field_to_file_as_c(child, 1, file);
+   free(_lcddl_layout_cache.entries[i].layout.field_offsets);
   }
-  fprintf(file, "};\n\n");
- }
- else
- {
-  fprintf(file, "// could not write node as struct");
+  memset(_lcddl_layout_cache.entries, 0, _lcddl_layout_cache.capacity * sizeof(*_lcddl_layout_cache.entries));
+  _lcddl_layout_cache.count = 0;
  }
+ _lcddl_layout_cache.is_stale = false;
 }
 
-void
-lcddl_write_node_to_file_as_c_enum(LcddlNode *node,
-                                   FILE *file)
+static unsigned long long
+_lcddl_align_up(unsigned long long value,
+                unsigned long long alignment)
 {
- if (node->kind == LCDDL_NODE_KIND_declaration)
+ return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static LcddlLayout _lcddl_get_declaration_layout(LcddlNode *declaration);
+
+static LcddlLayout
+_lcddl_get_type_layout(LcddlNode *type)
+{
+ LcddlLayout result = {0};
+ 
+ // NOTE(tbt): pointers do not need what they point to to be laid out, so may point to types which contain
+ //            them, or to types declared outside of LCDDL
+ if (type->type.indirection_level)
  {
-  fprintf(file, "typedef enum\n{\n");
+  result.size      = sizeof(void *);
+  result.alignment = sizeof(void *);
+ }
+ else
+ {
+  bool is_primitive = false;
+  for (unsigned int i = 0;
+       i < sizeof(_lcddl_primitive_types) / sizeof(_lcddl_primitive_types[0]);
+       ++i)
+  {
+   if (0 == strcmp(type->type.type_name, _lcddl_primitive_types[i].name))
+   {
+    result.size      = _lcddl_primitive_types[i].size;
+    result.alignment = _lcddl_primitive_types[i].size;
+    is_primitive     = true;
+    break;
+   }
+  }
   
-  for (LcddlNode *child = node->first_child;
-       NULL != child;
-       child = child->next_sibling)
+  if (!is_primitive)
   {
-   if (child->kind == LCDDL_NODE_KIND_declaration)
+   LcddlNode *declaration = lcddl_resolve_type(type);
+   if (declaration)
    {
-    fprintf(file, "\t%s,\n", child->declaration.name);
+    result               = _lcddl_get_declaration_layout(declaration);
+    result.field_offsets = NULL;
+   }
+   else
+   {
+    result.status = LCDDL_LAYOUT_STATUS_unknown_type;
    }
   }
-  fprintf(file, "} %s;\n\n", node->declaration.name);
  }
- else
+ 
+ if (result.status == LCDDL_LAYOUT_STATUS_ok)
+ {
+  if (type->type.array_count)
+  {
+   result.size *= type->type.array_count;
+  }
+ }
+ else if (!result.error_node)
  {
-  fprintf(file, "// could not write node as enum");
+  // NOTE(tbt): a declaration which is already in progress is reported at the type which refers back to it
+  result.error_node = type;
  }
+ 
+ return result;
 }
 
-LcddlSearchResult *
-lcddl_find_top_level_declaration(char *name)
+static LcddlLayout
+_lcddl_get_aggregate_layout(LcddlNode *declaration,
+                            bool is_union)
 {
- fprintf(stderr, "looking for top level decl '%s'\n", name);
- LcddlSearchResult *result = NULL;
+ LcddlLayout result   = {0};
+ result.alignment     = 1;
+ result.field_offsets = calloc(declaration->child_count, sizeof(*result.field_offsets));
  
- for (LcddlNode *file = _lcddl_global_root->first_child;
-      NULL != file;
-      file = file->next_sibling)
+ unsigned long long end = 0;
+ for (unsigned int i = 0;
+      i < declaration->child_count;
+      ++i)
  {
-  for (LcddlNode *node = file->first_child;
-       NULL != node;
-       node = node->next_sibling)
+  LcddlLayout field = _lcddl_get_declaration_layout(declaration->children[i]);
+  if (field.status != LCDDL_LAYOUT_STATUS_ok)
   {
-   if (node->kind == LCDDL_NODE_KIND_declaration &&
-       0 == strcmp(node->declaration.name, name))
-   {
-    LcddlSearchResult *search_node = calloc(1, sizeof(*search_node));
-    search_node->next = result;
-    result = search_node;
-    search_node->node = node;
-   }
+   free(result.field_offsets);
+   field.size          = 0;
+   field.alignment     = 0;
+   field.field_offsets = NULL;
+   return field;
   }
+  
+  unsigned long long offset = is_union ? 0 : _lcddl_align_up(end, field.alignment);
+  result.field_offsets[i]   = offset;
+  end                       = offset + field.size > end ? offset + field.size : end;
+  result.alignment          = field.alignment > result.alignment ? field.alignment : result.alignment;
  }
+ result.size = _lcddl_align_up(end, result.alignment);
  
  return result;
 }
 
-LcddlSearchResult *
-lcddl_find_all_top_level_declarations_with_tag(char *tag)
+static LcddlLayout
+_lcddl_get_declaration_layout(LcddlNode *declaration)
 {
- LcddlSearchResult *result = NULL;
+ LcddlLayout result = {0};
  
- for (LcddlNode *file = _lcddl_global_root->first_child;
-      NULL != file;
-      file = file->next_sibling)
+ if (_lcddl_layout_cache.count)
  {
-  for (LcddlNode *node = file->first_child;
-       NULL != node;
-       node = node->next_sibling)
+  _LcddlLayoutCacheEntry *entry = &_lcddl_layout_cache.entries[_lcddl_find_layout_slot(declaration)];
+  if (entry->declaration)
   {
-   if (node->kind == LCDDL_NODE_KIND_declaration &&
-       lcddl_does_node_have_tag(node, tag))
+   if (entry->is_in_progress)
    {
-    LcddlSearchResult *search_node = calloc(1, sizeof(*search_node));
-    search_node->next = result;
-    result = search_node;
-    search_node->node = node;
+    result.status = LCDDL_LAYOUT_STATUS_recursive;
+    return result;
    }
+   return entry->layout;
   }
  }
  
- return result;
-}
-
-bool
-lcddl_is_declaration_type(LcddlNode *declaration,
-                          char *type_name)
-{
- if (declaration->kind == LCDDL_NODE_KIND_declaration)
+ _LcddlLayoutCacheEntry entry = {0};
+ entry.declaration            = declaration;
+ entry.is_in_progress         = true;
+ _lcddl_insert_layout_entry(entry);
+ 
+ LcddlNode *type = declaration->kind == LCDDL_NODE_KIND_declaration ? declaration->declaration.type : NULL;
+ if (!type)
  {
-  return (0 == strcmp(declaration->declaration.type->type.type_name, type_name));
+  result.status     = LCDDL_LAYOUT_STATUS_no_layout;
+  result.error_node = declaration;
  }
- return false;
-}
-
-double
-lcddl_evaluate_expression(LcddlNode *expression)
-{
- switch (expression->kind)
+ else
  {
-  case LCDDL_NODE_KIND_float_literal:
+  // NOTE(tbt): `struct`, `union` and `enum` declare a new type from the declaration's children, even if it has none
+  bool is_plain = !type->type.indirection_level && !type->type.array_count;
+  if (is_plain &&
+      0 == strcmp(type->type.type_name, "struct"))
   {
-   return strtod(expression->literal.value, NULL);
+   result = _lcddl_get_aggregate_layout(declaration, false);
   }
-  
-  case LCDDL_NODE_KIND_integer_literal:
+  else if (is_plain &&
+           0 == strcmp(type->type.type_name, "union"))
   {
-   return (double)strtol(expression->literal.value, NULL, 10);
+   result = _lcddl_get_aggregate_layout(declaration, true);
   }
-  
-  case LCDDL_NODE_KIND_unary_operator:
+  else if (is_plain &&
+           0 == strcmp(type->type.type_name, "enum"))
   {
-   switch (expression->unary_operator.kind)
-   {
-    case LCDDL_UN_OP_KIND_positive:
-    {
-     return lcddl_evaluate_expression(expression->unary_operator.operand);
-    }
-    
-    case LCDDL_UN_OP_KIND_negative:
-    {
-     return lcddl_evaluate_expression(expression->unary_operator.operand) * -1.0;
-    }
-    
-    case LCDDL_UN_OP_KIND_bitwise_not:
-    {
-     return (double)(~((unsigned long long)lcddl_evaluate_expression(expression->unary_operator.operand)));
-    }
-    
-    case LCDDL_UN_OP_KIND_boolean_not:
-    {
-     return (double)(!((long long)lcddl_evaluate_expression(expression->unary_operator.operand)));
-    }
-   }
+   result.size      = sizeof(int);
+   result.alignment = sizeof(int);
   }
-  
-  case LCDDL_NODE_KIND_binary_operator:
+  else if (declaration->child_count)
   {
-   switch (expression->binary_operator.kind)
-   {
-    case LCDDL_BIN_OP_KIND_multiply:
-    {
-     return lcddl_evaluate_expression(expression->binary_operator.left) * lcddl_evaluate_expression(expression->binary_operator.right);
-    }
-    
-    case LCDDL_BIN_OP_KIND_divide:
-    {
-     return lcddl_evaluate_expression(expression->binary_operator.left) / lcddl_evaluate_expression(expression->binary_operator.right);
-    }
-    
-    case LCDDL_BIN_OP_KIND_add:
-    {
-     return lcddl_evaluate_expression(expression->binary_operator.left) + lcddl_evaluate_expression(expression->binary_operator.right);
-    }
-    
-    case LCDDL_BIN_OP_KIND_subtract:
-    {
-     return lcddl_evaluate_expression(expression->binary_operator.left) - lcddl_evaluate_expression(expression->binary_operator.right);
-    }
-    
-    case LCDDL_BIN_OP_KIND_bit_shift_left:
-    {
-     return (double)((unsigned long long)lcddl_evaluate_expression(expression->binary_operator.left) << (long long)lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_bit_shift_right:
-    {
-     return (double)((unsigned long long)lcddl_evaluate_expression(expression->binary_operator.left) >> (long long)lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_lesser_than:
-    {
-     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) < lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_greater_than:
-    {
-     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) > lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_lesser_than_or_equal_to:
-    {
-     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) <= lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_greater_than_or_equal_to:
-    {
-     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) >= lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_equality:
-    {
-     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) == lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_not_equal_to:
-    {
-     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) != lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_bitwise_and:
-    {
-     return (double)((unsigned long long)lcddl_evaluate_expression(expression->binary_operator.left) & (unsigned long long)lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_bitwise_xor:
-    {
-     return (double)((unsigned long long)lcddl_evaluate_expression(expression->binary_operator.left) ^ (unsigned long long)lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_bitwise_or:
-    {
-     return (double)((unsigned long long)lcddl_evaluate_expression(expression->binary_operator.left) | (unsigned long long)lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_boolean_and:
-    {
-     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) && lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-    
-    case LCDDL_BIN_OP_KIND_boolean_or:
-    {
-     return (double)(lcddl_evaluate_expression(expression->binary_operator.left) || lcddl_evaluate_expression(expression->binary_operator.right));
-    }
-   }
+   result.status     = LCDDL_LAYOUT_STATUS_no_layout;
+   result.error_node = declaration;
   }
-  
-  default:
+  else
   {
-   fprintf(stderr, "Error evaluating expression.\n");
-   return 0.0;
+   result = _lcddl_get_type_layout(type);
+   if (result.error_node == type &&
+       type->reference_count)
+   {
+    // NOTE(tbt): an interned type has no location of its own, see `lcddl_node_location`
+    result.error_node = declaration;
+   }
   }
  }
+ 
+ // NOTE(tbt): laying out the children may have grown the cache, so the entry must be found again
+ _LcddlLayoutCacheEntry *finished = &_lcddl_layout_cache.entries[_lcddl_find_layout_slot(declaration)];
+ finished->is_in_progress         = false;
+ finished->layout                 = result;
+ 
+ return result;
+}
+
+LcddlLayout
+lcddl_get_layout(LcddlNode *node)
+{
+ LcddlLayout result = {0};
+ 
+ _lcddl_mutex_lock(&_lcddl_layout_mutex);
+ if (_lcddl_layout_cache.is_stale)
+ {
+  _lcddl_clear_layouts();
+ }
+ if (node->kind == LCDDL_NODE_KIND_declaration)
+ {
+  result = _lcddl_get_declaration_layout(node);
+ }
+ else if (node->kind == LCDDL_NODE_KIND_type)
+ {
+  result = _lcddl_get_type_layout(node);
+ }
+ else
+ {
+  result.status     = LCDDL_LAYOUT_STATUS_no_layout;
+  result.error_node = node;
+ }
+ _lcddl_mutex_unlock(&_lcddl_layout_mutex);
+ 
+ return result;
 }
 
 #undef LOG_ERROR_BEGIN
-#undef LOG_WARN_BEGIN
 #undef PATH_MAX_LEN
-#undef print_warning
-#undef print_error_and_exit
-#undef print_error_and_exit_f
+#undef LCDDL_BINARY_MAGIC
+#undef LCDDL_BINARY_FORMAT_VERSION
+#undef LCDDL_BINARY_NULL
+#undef LCDDL_BATCH_CHUNK_SIZE
+#undef LCDDL_MAX_DIAGNOSTICS_PER_FILE
+#undef LCDDL_WRITER_FLUSH_THRESHOLD
+#undef _lcddl_batch_loop
+#undef LCDDL_MUTEX_INITIALISER
+#undef _lcddl_mutex_lock
+#undef _lcddl_mutex_unlock
+#undef _lcddl_trace_begin
+#undef _lcddl_trace_end
 #undef token_kind_to_string
 
 #endif
\ No newline at end of file
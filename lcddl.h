@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 
+#define LCDDL_VERSION "2.1.0"
+
 typedef enum
 {
  // binary operators
@@ -73,6 +75,11 @@ typedef enum
  LCDDL_NODE_KIND_annotation,         // extre meta information added to a statement
 } LcddlNodeKind;
 
+#define LCDDL_NODE_KIND_COUNT (LCDDL_NODE_KIND_annotation + 1)
+
+// NOTE(tbt): the text a file was parsed from, kept so that locations can be worked out. see `lcddl_node_location`
+typedef struct LcddlSource LcddlSource;
+
 typedef struct LcddlNode LcddlNode;
 struct LcddlNode
 {
@@ -84,11 +91,24 @@ struct LcddlNode
   LcddlNode *next_annotation;
  };
  
+ // NOTE(tbt): the same nodes as the `first_child` and `first_annotation` lists, in source order, so that
+ //            they can be counted and indexed without walking the lists
+ LcddlNode **children;
+ unsigned int child_count;
+ LcddlNode **annotations;
+ unsigned int annotation_count;
+ 
+ unsigned long long hash;      // structural hash of the node and everything below it. see `lcddl_node_hash`
+ unsigned int reference_count; // non zero for interned nodes, which may be shared between several parents and have no location. see `lcddl_set_interning`
+ unsigned int offset;          // byte offset in its file of the node's first token, or the operator of a binary operator. see `lcddl_node_location`
+ 
  union
  {
   struct
   {
    char *filename;
+   unsigned int index;  // position in the `children` array of the root, so that the file can be found without searching
+   LcddlSource *source; // NULL for files loaded from binary images, which only have offsets
   } file;
   
   struct
@@ -143,9 +163,126 @@ struct LcddlSearchResult
  LcddlNode *node;
 };
 
+typedef enum
+{
+ LCDDL_WRITER_KIND_file,   // flushes to a CRT `FILE *`
+ LCDDL_WRITER_KIND_fd,     // flushes to a file descriptor
+ LCDDL_WRITER_KIND_memory, // accumulates everything into a growable string
+ LCDDL_WRITER_KIND_path,   // accumulates everything, then replaces the file at a path only if its contents changed
+} LcddlWriterKind;
+
+// buffers output in memory so that it can be written in large chunks
+typedef struct LcddlWriter LcddlWriter;
+struct LcddlWriter
+{
+ LcddlWriterKind kind;
+ char *buffer;
+ unsigned long long size;
+ unsigned long long capacity;
+ union
+ {
+  FILE *file;
+  int fd;
+  char *path;
+ };
+};
+
+typedef struct
+{
+ unsigned int files_written;   // number of path writers whose output differed from the existing file
+ unsigned int files_unchanged; // number of path writers whose output matched the existing file, which was left untouched
+ unsigned int files_failed;    // number of path writers whose output could not be written
+} LcddlOutputSummary;
+
+// an expression flattened so it can be evaluated over many sets of variable bindings at once
+typedef struct LcddlCompiledExpression LcddlCompiledExpression;
+
+typedef enum
+{
+ LCDDL_DIFF_KIND_added,    // `new_node` has no counterpart in the old tree. `old_node` is NULL
+ LCDDL_DIFF_KIND_removed,  // `old_node` has no counterpart in the new tree. `new_node` is NULL
+ LCDDL_DIFF_KIND_modified, // `old_node` and `new_node` have the same name, but differ as described by `changes`
+} LcddlDiffKind;
+
+typedef enum
+{
+ LCDDL_DIFF_CHANGE_type        = 1 << 0,
+ LCDDL_DIFF_CHANGE_value       = 1 << 1,
+ LCDDL_DIFF_CHANGE_annotations = 1 << 2,
+ LCDDL_DIFF_CHANGE_children    = 1 << 3, // children were added, removed, modified or reordered
+} LcddlDiffChange;
+
+typedef struct
+{
+ LcddlDiffKind kind;
+ unsigned int changes; // combination of `LcddlDiffChange`s for `LCDDL_DIFF_KIND_modified`
+ LcddlNode *old_node;
+ LcddlNode *new_node;
+} LcddlDiff;
+
+typedef void (*LcddlDiffCallback)(LcddlDiff *diff, void *user_data);
+
+// everything LCDDL allocates for the tree goes through an allocator. `allocate` need not zero the memory, and
+// should return NULL when it can not allocate `size` bytes. `free` is passed the same size that was allocated
+typedef struct
+{
+ void *(*allocate)(unsigned long long size, void *user_data);
+ void (*free)(void *memory, unsigned long long size, void *user_data);
+ void *user_data;
+} LcddlAllocator;
+
+typedef struct
+{
+ unsigned long long live_bytes;                        // bytes currently allocated for trees and input files
+ unsigned long long peak_bytes;                        // the most that `live_bytes` has been
+ unsigned long long live_allocations;                  // number of allocations which have not been freed
+ unsigned long long limit_bytes;                       // the memory limit, or 0 if there is none
+ unsigned long long node_counts[LCDDL_NODE_KIND_COUNT]; // number of live nodes of each kind
+} LcddlMemoryStats;
+
+typedef struct
+{
+ char *path;           // the input the error was found in
+ unsigned long line;   // 1 based, or 0 if the error is not at any one place, e.g. the file could not be opened
+ unsigned long column; // 1 based
+ char *message;
+} LcddlDiagnostic;
+
+typedef enum
+{
+ LCDDL_LAYOUT_STATUS_ok,
+ LCDDL_LAYOUT_STATUS_unknown_type, // a type name is neither a built in type nor the name of a top-level declaration
+ LCDDL_LAYOUT_STATUS_recursive,    // a type contains itself, other than through a pointer
+ LCDDL_LAYOUT_STATUS_no_layout,    // a declaration has no type, or has children but is not a struct, union or enum
+} LcddlLayoutStatus;
+
+typedef struct
+{
+ LcddlLayoutStatus status;
+ unsigned long long size;
+ unsigned long long alignment;
+ // NOTE(tbt): for the declaration of a struct or union, the offset of each child, otherwise NULL. the array belongs
+ //            to LCDDL's layout cache, which is thrown away once a file is added to or removed from the tree - by
+ //            `lcddl_parse_*`, `lcddl_free_file`, `lcddl_replace_file`, or a reparse in watch mode. the pointer
+ //            must not be used after that, so copy the offsets if they are needed for longer
+ unsigned long long *field_offsets;
+ LcddlNode *error_node;             // when `status` is not ok, the declaration or type where the problem was found
+} LcddlLayout;
+
+typedef struct
+{
+ char *path;
+ unsigned int offset;
+ unsigned long line;   // 1 based, or 0 if the source of the file is not available or its lines could not be found, or for an interned node
+ unsigned long column; // 1 based
+} LcddlLocation;
+
 #ifndef LCDDL_AS_LIBRARY
 
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+// NOTE(tbt): with LCDDL_STATIC_USER_LAYER, the user layer is linked into the executable rather than loaded
+#if defined(LCDDL_STATIC_USER_LAYER)
+#define LCDDL_CALLBACK
+#elif defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 #define LCDDL_CALLBACK __declspec(dllexport)
 #else
 #define LCDDL_CALLBACK
@@ -160,15 +297,53 @@ LcddlNode *lcddl_parse_file(char *filename);
 LcddlNode *lcddl_parse_from_memory(char *buffer, unsigned long long buffer_size);
 LcddlNode *lcddl_parse_cstring(char *string);
 void lcddl_free_file(LcddlNode *root);
+void lcddl_replace_file(LcddlNode *old_file, LcddlNode *new_file);
+void lcddl_set_interning(bool is_enabled);
+void lcddl_set_allocator(LcddlAllocator allocator);
+void lcddl_set_memory_limit(unsigned long long limit_bytes);
+unsigned int lcddl_diagnostic_count(void);
+LcddlDiagnostic *lcddl_diagnostic_at(unsigned int index);
+void lcddl_clear_diagnostics(void);
+unsigned int lcddl_report_duplicate_declarations(void);
 #endif
 
+LcddlWriter lcddl_writer_for_file(FILE *file);
+LcddlWriter lcddl_writer_for_fd(int fd);
+LcddlWriter lcddl_writer_for_memory(void);
+LcddlWriter lcddl_writer_for_path(char *path);
+LcddlOutputSummary lcddl_get_output_summary(void);
+void lcddl_writer_write(LcddlWriter *writer, char *data, unsigned long long size);
+void lcddl_writer_put_char(LcddlWriter *writer, char c, unsigned int count);
+void lcddl_writer_put_string(LcddlWriter *writer, char *string);
+void lcddl_writer_printf(LcddlWriter *writer, char *format, ...);
+void lcddl_writer_flush(LcddlWriter *writer);
+char *lcddl_writer_close(LcddlWriter *writer);
+void lcddl_write_node_to_writer_as_c_struct(LcddlNode *node, LcddlWriter *writer);
+void lcddl_write_node_to_writer_as_c_enum(LcddlNode *node, LcddlWriter *writer);
 void lcddl_write_node_to_file_as_c_struct(LcddlNode *node, FILE *file);
 void lcddl_write_node_to_file_as_c_enum(LcddlNode *node, FILE *file);
+LcddlMemoryStats lcddl_get_memory_stats(void);
+LcddlLocation lcddl_node_location(LcddlNode *file, LcddlNode *node);
+unsigned int lcddl_child_count(LcddlNode *node);
+unsigned long long lcddl_node_hash(LcddlNode *node);
+void lcddl_diff(LcddlNode *old_node, LcddlNode *new_node, LcddlDiffCallback callback, void *user_data);
+LcddlNode *lcddl_child_at(LcddlNode *node, unsigned int index);
 LcddlNode *lcddl_get_annotation_value(LcddlNode *node, char *tag);
 bool lcddl_does_node_have_tag(LcddlNode *node, char *tag);
 LcddlSearchResult *lcddl_find_top_level_declaration(char *name);
 LcddlSearchResult *lcddl_find_all_top_level_declarations_with_tag(char *tag);
+LcddlNode *lcddl_resolve_type(LcddlNode *type);
+LcddlLayout lcddl_get_layout(LcddlNode *node);
 bool lcddl_is_declaration_type(LcddlNode *declaration, char *type_name);
 double lcddl_evaluate_expression(LcddlNode *expression);
+void lcddl_save_binary(LcddlNode *node, char *path);
+LcddlNode *lcddl_open_binary(char *path);
+void lcddl_close_binary(LcddlNode *root);
+bool lcddl_publish_shared(LcddlNode *node, char *name);
+LcddlNode *lcddl_attach_shared(char *name);
+void lcddl_remove_shared(char *name);
+LcddlCompiledExpression *lcddl_compile_expression(LcddlNode *expression, char **variable_names, unsigned int variable_count);
+void lcddl_evaluate_compiled_expression_batch(LcddlCompiledExpression *expression, double **variables, unsigned long long count, double *results);
+void lcddl_free_compiled_expression(LcddlCompiledExpression *expression);
 
 #endif
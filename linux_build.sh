@@ -1,4 +1,14 @@
 #!/bin/sh
 
-gcc lcddl.c -rdynamic -ldl -o lcddl
-
+# ./linux_build.sh                        builds lcddl, which loads user layers at run time
+# ./linux_build.sh static (layer sources) builds lcddl_static, with the user layer linked in
+# ./linux_build.sh bench                  builds bench/lcddl_bench and bench/lcddl_corpus
+if [ "$1" = "static" ]; then
+ shift
+ gcc -O2 -flto -DLCDDL_STATIC_USER_LAYER lcddl.c "$@" -pthread -o lcddl_static
+elif [ "$1" = "bench" ]; then
+ gcc -O2 bench/lcddl_bench.c -pthread -o bench/lcddl_bench
+ gcc -O2 -DLCDDL_AS_LIBRARY bench/lcddl_corpus.c lcddl.c -pthread -o bench/lcddl_corpus
+else
+ gcc lcddl.c -rdynamic -pthread -ldl -o lcddl
+fi
@@ -1 +1,13 @@
-cl /nologo lcddl.c /link /export:lcddl_write_node_to_file_as_c_struct /export:lcddl_write_node_to_file_as_c_enum /export:lcddl_does_node_have_tag /export:lcddl_evaluate_expression /export:lcddl_find_top_level_declaration /export:lcddl_find_all_top_level_declarations_with_tag /export:lcddl_get_annotation_value /export:lcddl_is_declaration_type /out:lcddl.exe
+@echo off
+
+rem windows_build.bat                        builds lcddl.exe, which loads user layers at run time
+rem windows_build.bat static (layer sources) builds lcddl_static.exe, with the user layer linked in
+rem windows_build.bat bench                  builds bench\lcddl_bench.exe and bench\lcddl_corpus.exe
+if "%1"=="static" (
+ cl /nologo /O2 /GL /DLCDDL_STATIC_USER_LAYER lcddl.c %2 %3 %4 %5 %6 %7 %8 %9 /link /LTCG /out:lcddl_static.exe
+) else if "%1"=="bench" (
+ cl /nologo /O2 bench\lcddl_bench.c /Febench\lcddl_bench.exe
+ cl /nologo /O2 /DLCDDL_AS_LIBRARY bench\lcddl_corpus.c lcddl.c /Febench\lcddl_corpus.exe
+) else (
+ cl /nologo lcddl.c /link /export:lcddl_write_node_to_file_as_c_struct /export:lcddl_write_node_to_file_as_c_enum /export:lcddl_write_node_to_writer_as_c_struct /export:lcddl_write_node_to_writer_as_c_enum /export:lcddl_writer_for_file /export:lcddl_writer_for_fd /export:lcddl_writer_for_memory /export:lcddl_writer_for_path /export:lcddl_get_output_summary /export:lcddl_writer_write /export:lcddl_writer_put_char /export:lcddl_writer_put_string /export:lcddl_writer_printf /export:lcddl_writer_flush /export:lcddl_writer_close /export:lcddl_child_count /export:lcddl_child_at /export:lcddl_node_location /export:lcddl_node_hash /export:lcddl_diff /export:lcddl_get_memory_stats /export:lcddl_does_node_have_tag /export:lcddl_evaluate_expression /export:lcddl_find_top_level_declaration /export:lcddl_find_all_top_level_declarations_with_tag /export:lcddl_resolve_type /export:lcddl_get_layout /export:lcddl_get_annotation_value /export:lcddl_is_declaration_type /export:lcddl_save_binary /export:lcddl_open_binary /export:lcddl_close_binary /export:lcddl_publish_shared /export:lcddl_attach_shared /export:lcddl_remove_shared /export:lcddl_compile_expression /export:lcddl_evaluate_compiled_expression_batch /export:lcddl_free_compiled_expression /out:lcddl.exe
+)